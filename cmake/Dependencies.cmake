@@ -10,6 +10,13 @@ list(APPEND Caffe_LINKER_LIBS ${Boost_LIBRARIES})
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS ${CMAKE_THREAD_LIBS_INIT})
 
+# ---[ OpenMP
+find_package(OpenMP QUIET)
+if(OPENMP_FOUND)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
+  message(STATUS "OpenMP found (${OpenMP_CXX_FLAGS})")
+endif()
+
 # ---[ Google-glog
 include("cmake/External/glog.cmake")
 include_directories(SYSTEM ${GLOG_INCLUDE_DIRS})
@@ -162,5 +169,9 @@ if (USE_MPI)
   include_directories(SYSTEM ${MPI_CXX_INCLUDE_PATH})
   list(APPEND Caffe_LINKER_LIBS ${MPI_CXX_LIBRARIES})
   add_definitions(-DUSE_MPI)
+  # shm_open for the frame cache shared by the ranks of a node.
+  if(UNIX AND NOT APPLE)
+    list(APPEND Caffe_LINKER_LIBS rt)
+  endif()
   set(CMAKE_EXE_LINKER_FLAGS "${CMAKE_SHARED_LINKER_FLAGS} ${MPI_CXX_LINK_FLAGS}")
 endif()
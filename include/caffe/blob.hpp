@@ -220,8 +220,11 @@ class Blob {
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
   const Dtype* gpu_data() const;
+  void set_gpu_data(Dtype* data);
   const Dtype* cpu_diff() const;
+  void set_cpu_diff(Dtype* diff);
   const Dtype* gpu_diff() const;
+  void set_gpu_diff(Dtype* diff);
   Dtype* mutable_cpu_data();
   Dtype* mutable_gpu_data();
   Dtype* mutable_cpu_diff();
@@ -115,12 +115,16 @@ int64_t cluster_seedgen(bool sync=true);
 class Caffe {
  public:
   ~Caffe();
-  inline static Caffe& Get() {
-    if (!singleton_.get()) {
-      singleton_.reset(new Caffe());
-    }
-    return *singleton_;
-  }
+  // Returns the context of the calling thread: its own if InitThreadContext
+  // gave it one, else the one of the process.
+  static Caffe& Get();
+  // Gives the calling thread a context of its own for the rest of its life,
+  // so that it can run nets beside the other threads: the mode, the CPU
+  // threads and the MPI settings of parent, but its own RNG, seeded with
+  // seed, and in GPU mode its own cuBLAS handle and cuRAND generator on the
+  // current device. parent is copied without a lock, its settings must not
+  // change meanwhile.
+  static void InitThreadContext(const Caffe& parent, const unsigned int seed);
   enum Brew { CPU, GPU };
 
   // This random number generator facade hides boost and CUDA rng
@@ -166,6 +170,13 @@ class Caffe {
   static void SetDevice(const int device_id);
   // Prints the current GPU status.
   static void DeviceQuery();
+  // Returns the number of threads the CPU convolutions split the images of a
+  // batch among, and the CPU pooling the channels, 1 by default. Threads take
+  // a build with OpenMP (USE_OPENMP); without it, both run on one thread.
+  inline static int cpu_threads() { return Get().cpu_threads_; }
+  // Sets the number of CPU threads. Link a single threaded BLAS to use more
+  // than one, or each thread runs as many BLAS threads.
+  static void set_cpu_threads(const int threads);
 
 #ifdef USE_MPI
   enum PARALLEL_MODE { NO, MPI };
@@ -213,6 +224,7 @@ class Caffe {
 #endif
 
   Brew mode_;
+  int cpu_threads_;
   static shared_ptr<Caffe> singleton_;
 
  private:
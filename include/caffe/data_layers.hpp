@@ -11,11 +11,15 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/data_transformer.hpp"
+#include "caffe/decode_pool.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/frame_cache.hpp"
+#include "caffe/util/frame_pack.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -74,12 +78,29 @@ protected:
 	bool output_labels_;
 };
 
+template <typename Dtype>
+class Batch {
+public:
+	Blob<Dtype> data_, label_;
+};
+
+/**
+ * @brief Base class for data layers that load their batches on a prefetch
+ *        thread.
+ *
+ * The thread lives as long as the layer. It fills the free batches of a
+ * pool of data_param.prefetch preallocated batches, and queues them for
+ * Forward, which hands each batch back once the top blobs are done with
+ * it. A slow batch thus only stalls the solver once the queue has run dry.
+ * On CPU the top blobs point into the batch itself, so no copy is made;
+ * with a pool of one batch, Forward hands it back before waiting for the
+ * next one.
+ */
 template <typename Dtype>
 class BasePrefetchingDataLayer :
 		public BaseDataLayer<Dtype>, public InternalThread {
 		public:
-	explicit BasePrefetchingDataLayer(const LayerParameter& param)
-	: BaseDataLayer<Dtype>(param) {}
+	explicit BasePrefetchingDataLayer(const LayerParameter& param);
 	// LayerSetUp: implements common data layer setup functionality, and calls
 	// DataLayerSetUp to do special data layer setup for individual layer types.
 	// This method may not be overridden.
@@ -92,13 +113,21 @@ class BasePrefetchingDataLayer :
 			const vector<Blob<Dtype>*>& top);
 
 	virtual void CreatePrefetchThread();
+	// Stops the prefetch thread and waits for it to exit.
 	virtual void JoinPrefetchThread();
-	// The thread's function
-	virtual void InternalThreadEntry() {}
 
 		protected:
-	Blob<Dtype> prefetch_data_;
-	Blob<Dtype> prefetch_label_;
+	// The thread's function, calls load_batch until the thread is stopped.
+	virtual void InternalThreadEntry();
+	// Fills batch with the next batch_size items.
+	virtual void load_batch(Batch<Dtype>* batch) = 0;
+
+	vector<shared_ptr<Batch<Dtype> > > prefetch_;
+	BlockingQueue<Batch<Dtype>*> prefetch_free_;
+	BlockingQueue<Batch<Dtype>*> prefetch_full_;
+	// The batch the top blobs point to on CPU, see Forward_cpu.
+	Batch<Dtype>* prefetch_current_;
+
 	Blob<Dtype> transformed_data_;
 };
 
@@ -118,7 +147,7 @@ public:
 
 
 protected:
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor() {
@@ -288,7 +317,7 @@ public:
 protected:
 	shared_ptr<Caffe::RNG> prefetch_rng_;
 	virtual void ShuffleImages();
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor(){
@@ -332,7 +361,13 @@ protected:
 	shared_ptr<Caffe::RNG> prefetch_rng_1_;
 	shared_ptr<Caffe::RNG> frame_prefetch_rng_;
 	virtual void ShuffleVideos();
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
+	// Reads one item of the batch picked by load_batch. Called from
+	// the decode workers of decode_pool_.
+	virtual bool ReadBatchItem(Dtype* top_label, int item_id, vector<cv::Mat>* frames);
+	// Decodes the given segments of a video, from its frame directory or from
+	// a frame pack depending on video_data_param.frame_storage.
+	bool ReadVideoToFrames(const string& filename, const vector<int>& offsets, vector<cv::Mat>* frames);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor(){
@@ -351,6 +386,15 @@ protected:
 	vector<std::pair<std::string, int> > lines_;
 	vector<int> lines_duration_;
 	int lines_id_;
+
+	shared_ptr<DecodePool<Dtype> > decode_pool_;
+	// Shared with the other video data layers, NULL if frame_cache_mb is 0.
+	shared_ptr<FrameCache> frame_cache_;
+	// The open frame packs, NULL unless frame_storage is PACK.
+	shared_ptr<FramePackCache> frame_packs_;
+	// Videos and segment offsets of the batch being prefetched.
+	vector<std::pair<std::string, int> > batch_lines_;
+	vector<vector<int> > batch_offsets_;
 };
 
 /**
@@ -377,7 +421,10 @@ protected:
 	shared_ptr<Caffe::RNG> prefetch_rng_1_;
 	shared_ptr<Caffe::RNG> frame_prefetch_rng_;
 	virtual void ShuffleVideos();
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
+	// Reads one item of the batch picked by load_batch. Called from
+	// the decode workers of decode_pool_.
+	virtual bool ReadBatchItem(Dtype* top_label, int item_id, vector<cv::Mat>* frames);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor(){
@@ -397,6 +444,14 @@ protected:
 	vector<std::pair<std::string, std::string> > lines_dir_;
 	vector<int> lines_duration_;
 	int lines_id_;
+
+	shared_ptr<DecodePool<Dtype> > decode_pool_;
+	// Shared with the other video data layers, NULL if frame_cache_mb is 0.
+	shared_ptr<FrameCache> frame_cache_;
+	// Videos and segment offsets of the batch being prefetched.
+	vector<std::pair<std::string, int> > batch_lines_;
+	vector<std::pair<std::string, std::string> > batch_dirs_;
+	vector<vector<int> > batch_offsets_;
 };
 
 template <typename Dtype>
@@ -418,7 +473,10 @@ protected:
 	shared_ptr<Caffe::RNG> prefetch_rng_1_;
 	shared_ptr<Caffe::RNG> frame_prefetch_rng_;
 	virtual void ShuffleVideos();
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
+	// Reads one item of the batch picked by load_batch. Called from
+	// the decode workers of decode_pool_.
+	virtual bool ReadBatchItem(Dtype* top_label, int item_id, vector<cv::Mat>* frames);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor(){
@@ -438,6 +496,14 @@ protected:
 	vector<std::pair<std::string, std::string> > lines_dir_;
 	vector<int> lines_duration_;
 	int lines_id_;
+
+	shared_ptr<DecodePool<Dtype> > decode_pool_;
+	// Shared with the other video data layers, NULL if frame_cache_mb is 0.
+	shared_ptr<FrameCache> frame_cache_;
+	// Videos and segment offsets of the batch being prefetched.
+	vector<std::pair<std::string, int> > batch_lines_;
+	vector<std::pair<std::string, std::string> > batch_dirs_;
+	vector<vector<int> > batch_offsets_;
 };
 
 
@@ -509,7 +575,7 @@ public:
 
 protected:
 	virtual unsigned int PrefetchRand();
-	virtual void InternalThreadEntry();
+	virtual void load_batch(Batch<Dtype>* batch);
 
 #ifdef USE_MPI
 	inline virtual void advance_cursor(){
@@ -1,6 +1,8 @@
 #ifndef CAFFE_DATA_TRANSFORMER_HPP
 #define CAFFE_DATA_TRANSFORMER_HPP
 
+#include <opencv2/core/core.hpp>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -24,6 +26,12 @@ class DataTransformer {
    *    transformation.
    */
   void InitRand();
+  /**
+   * @brief Same as InitRand(), but seeds the generator with the given value
+   *    instead of drawing it from the global Caffe RNG. This makes it safe to
+   *    call from worker threads.
+   */
+  void InitRand(unsigned int seed);
 
   /**
    * @brief Applies the transformation defined in the data layer's
@@ -75,6 +83,22 @@ class DataTransformer {
    */
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to the frames of a video segment, stacked along
+   * the channels, without going through a Datum. The result is the same as
+   * Transform(datum) on the Datum FramesToDatum() would build.
+   *
+   * @param frames
+   *    8-bit cv::Mat frames of the same size, as returned by the
+   *    ReadSegment*ToFrames readers. Each plane is one channel.
+   * @param transformed_blob
+   *    This is destination blob. It can be part of top blob's data if
+   *    set_cpu_data() is used. See decode_pool.cpp for an example.
+   */
+  void TransformFrames(const vector<cv::Mat>& frames,
+                       Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the same transformation defined in the data layer's
    * transform_param block to all the num images in a input_blob.
@@ -122,6 +146,14 @@ class DataTransformer {
    *    cv::Mat containing the data to be transformed.
    */
   vector<int> InferBlobShape(const cv::Mat& cv_img);
+  /**
+   * @brief Infers the shape of transformed_blob will have when
+   *    TransformFrames is applied to the frames.
+   *
+   * @param frames
+   *    The frames of a video segment, stacked along the channels.
+   */
+  vector<int> InferFramesBlobShape(const vector<cv::Mat>& frames);
 
  protected:
    /**
@@ -135,6 +167,14 @@ class DataTransformer {
   virtual int Rand(int n);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  /**
+   * @brief Crops the same region out of all the images, 8-bit or float and
+   *    with any number of channels, and resizes the crops to
+   *    crop_size x crop_size in a single pass. Leaves one resized plane per
+   *    channel, in order, in multi_scale_planes_.
+   */
+  void ResizeCrop(const vector<cv::Mat>& images, const cv::Rect& crop,
+      const int crop_size);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -146,6 +186,11 @@ class DataTransformer {
 
   vector<float> custom_scale_ratios_;
   int max_distort_;
+
+  // Multi-scale cropping buffers, kept to avoid reallocating them per item.
+  cv::Mat multi_scale_crop_;
+  cv::Mat multi_scale_resized_;
+  vector<cv::Mat> multi_scale_planes_;
 };
 
 }  // namespace caffe
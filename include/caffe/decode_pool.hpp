@@ -0,0 +1,87 @@
+#ifndef CAFFE_DECODE_POOL_HPP_
+#define CAFFE_DECODE_POOL_HPP_
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "boost/function.hpp"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief Reads and transforms the items of a batch with a pool of worker
+ *    threads. Each worker writes straight into the slot of the batch blob
+ *    that belongs to the item it is processing.
+ *
+ * The workers are started once with the pool and wait for the item ids of
+ * each batch on a queue, so a batch costs no thread creation. Every item
+ * gets its own transformation seed, drawn in item order before the items
+ * are queued, so the content of a batch only depends on the seed of the
+ * pool and not on the number of threads or on which worker takes an item.
+ */
+template <typename Dtype>
+class DecodePool {
+ public:
+  /**
+   * Decodes the frames of item item_id of the current batch, which are
+   * stacked along the channels by DataTransformer::TransformFrames. It is
+   * called concurrently from the worker threads, so it should only touch
+   * state that belongs to item_id. Returning false leaves the slot untouched.
+   */
+  typedef boost::function<bool (int, vector<cv::Mat>*)> ReadFunc;
+
+  /**
+   * The seed of the pool is drawn from the Caffe RNG, so construct it from
+   * the thread that owns the solver, e.g. in DataLayerSetUp.
+   */
+  DecodePool(const TransformationParameter& param, Phase phase,
+      int num_threads);
+  // Stops and joins the workers.
+  ~DecodePool();
+
+  /**
+   * @brief Fills every slot of batch with the transformed item returned by
+   *    read. Returns once all the items have been processed.
+   */
+  void Run(const ReadFunc& read, Blob<Dtype>* batch);
+
+  inline int num_threads() const { return num_threads_; }
+
+ protected:
+  void WorkerEntry(int worker_id);
+  // Reads and transforms item item_id with the transformer of worker_id.
+  void ProcessItem(int worker_id, int item_id, vector<cv::Mat>* frames);
+
+  const int num_threads_;
+  // One transformer per worker, as Transform is not reentrant.
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_data_;
+  shared_ptr<Caffe::RNG> seed_rng_;
+  // The workers, none with a single thread, where Run does the work itself.
+  vector<shared_ptr<boost::thread> > workers_;
+  // Item ids of the current batch for the workers, or -1 to stop one.
+  BlockingQueue<int> pending_items_;
+  // Item ids the workers are done with.
+  BlockingQueue<int> done_items_;
+
+  // State of the batch being processed by Run.
+  ReadFunc read_;
+  Blob<Dtype>* batch_;
+  Dtype* batch_data_;
+  vector<unsigned int> item_seeds_;
+
+  DISABLE_COPY_AND_ASSIGN(DecodePool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DECODE_POOL_HPP_
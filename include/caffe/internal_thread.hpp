@@ -27,6 +27,13 @@ class InternalThread {
   /** Will not return until the internal thread has exited. */
   bool WaitForInternalThreadToExit();
 
+  /**
+   * Asks the thread to stop, see must_stop(), and waits for it to exit.
+   * Blocking boost calls made by the thread, e.g. waiting on a condition
+   * variable, throw boost::thread_interrupted once a stop is requested.
+   */
+  bool StopInternalThread();
+
   bool is_started() const;
 
  protected:
@@ -34,6 +41,9 @@ class InternalThread {
       with the code you want your thread to run. */
   virtual void InternalThreadEntry() {}
 
+  /* Should be tested when running loops to exit when requested. */
+  bool must_stop();
+
   shared_ptr<boost::thread> thread_;
 };
 
@@ -11,6 +11,8 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/raw_weights.hpp"
 
 namespace caffe {
 
@@ -84,12 +86,20 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  /// @brief Zeroes the diffs of all the parameters.
+  void ClearParamDiffs();
 
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief For an already initialized net, copies the values of the learnable
+   *        parameters of another net into those of the layers of the same
+   *        name, which keep their own memory.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -97,7 +107,21 @@ class Net {
    *        another Net.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
+  /// Reads a .caffemodel or a raw weights file (see RawWeights).
   void CopyTrainedLayersFrom(const string trained_filename);
+  /**
+   * @brief Copies the parameters from raw weights, or with map, points them
+   *        into its mapping instead. Only float parameters outside a
+   *        contiguous arena can be mapped, the others are still copied.
+   */
+  void CopyTrainedLayersFrom(const RawWeights& weights, const bool map);
+  /**
+   * @brief For an already initialized net, maps a raw weights file and
+   *        points the parameters into it, without copying them. The net
+   *        keeps the file mapped. Processes mapping the same file share its
+   *        memory until they write to the parameters.
+   */
+  void MapTrainedLayersFrom(const string& trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
 
@@ -154,6 +178,49 @@ class Net {
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
   inline const vector<pair<int ,int> >& param_layer_indices() const {return param_layer_indices_;}
+
+  /**
+   * @brief Whether the parameters are views into one contiguous arena, see
+   *        NetParameter.contiguous_params.
+   *
+   * The data of the owned parameters come first in the arena, at the same
+   * offsets in the data and the diff arenas, and the diffs of the shared
+   * parameters follow. Each parameter starts at a multiple of 64 bytes into
+   * the arena; the padding stays zero.
+   */
+  inline bool has_param_arena() const {
+    return param_diff_arena_.get() != NULL;
+  }
+  /// @brief The number of elements of the owned parameters in the arenas
+  inline int param_arena_owned_count() const {
+    return param_arena_owned_count_;
+  }
+  /// @brief The number of elements of the diff arena
+  inline int param_arena_count() const { return param_arena_count_; }
+  /// @brief The offsets of the parameters in the arenas
+  inline const vector<int>& param_arena_offsets() const {
+    return param_arena_offsets_;
+  }
+  /**
+   * @brief Return the arenas in CPU or GPU memory, for passes over all the
+   *        parameters at once.
+   *
+   * They first bring every view up to date there, and mark it as changed
+   * there, like mutable_cpu_data and mutable_gpu_data of each blob would.
+   * The data arena only holds the owned parameters.
+   */
+  Dtype* mutable_cpu_param_data();
+  Dtype* mutable_gpu_param_data();
+  Dtype* mutable_cpu_param_diff();
+  Dtype* mutable_gpu_param_diff();
+#ifdef USE_MPI
+  /// @brief returns the compressors of the parameter gradients, NULL for
+  ///        the gradients summed as they are
+  inline const vector<shared_ptr<GradientCompressor> >&
+      param_compressors() const {
+    return param_compressors_;
+  }
+#endif
   /// @brief Input and output blob numbers
   inline int num_inputs() const { return net_input_blobs_.size(); }
   inline int num_outputs() const { return net_output_blobs_.size(); }
@@ -174,6 +241,7 @@ class Net {
   bool has_layer(const string& layer_name) const;
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
+  bool debug_info() const { return debug_info_; }
   void set_debug_info(const bool value) { debug_info_ = value; }
 
   // Helpers for Init.
@@ -219,6 +287,14 @@ class Net {
 
   /// @brief Get misc parameters, e.g. the LR multiplier and weight decay.
   void GetLearningRateAndWeightDecay();
+  /// @brief Move the parameters into the contiguous arenas.
+  void AllocateParamArena();
+  /// @brief Whether the arenas are contiguous in the memory of the current
+  ///        mode. A net built in CPU mode has no GPU arena.
+  inline bool use_param_arena() const {
+    return has_param_arena() &&
+        (Caffe::mode() == Caffe::CPU || gpu_param_diff_ != NULL);
+  }
 
   /// @brief The network name
   string name_;
@@ -263,6 +339,23 @@ class Net {
   vector<float> params_lr_;
   /// the weight decay multipliers
   vector<float> params_weight_decay_;
+  /// The contiguous arenas of the parameters, if any. Only their pointers
+  /// are used, the views keep track of where their values are.
+  shared_ptr<SyncedMemory> param_data_arena_;
+  shared_ptr<SyncedMemory> param_diff_arena_;
+  Dtype* cpu_param_data_;
+  Dtype* gpu_param_data_;
+  Dtype* cpu_param_diff_;
+  Dtype* gpu_param_diff_;
+  int param_arena_owned_count_;
+  int param_arena_count_;
+  vector<int> param_arena_offsets_;
+  /// The raw weights files the parameters are mapped from.
+  vector<shared_ptr<RawWeights> > mapped_weights_;
+#ifdef USE_MPI
+  /// the compressors of the gradients, from gradient_compression_param
+  vector<shared_ptr<GradientCompressor> > param_compressors_;
+#endif
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
@@ -5,6 +5,13 @@
 #include <vector>
 
 #include "caffe/net.hpp"
+#include "caffe/util/fused_update.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
 
 namespace caffe {
 
@@ -31,7 +38,7 @@ class Solver {
   // previously snapshotted state. You should implement the RestoreSolverState()
   // function that restores the state from a SolverState protocol buffer.
   void Restore(const char* resume_file);
-  virtual ~Solver() {}
+  virtual ~Solver();
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
     return test_nets_;
@@ -46,9 +53,36 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  // Writes a snapshot staged by Snapshot(), on the background thread with
+  // snapshot_in_background.
+  void WriteSnapshot(const shared_ptr<NetParameter> net_param,
+      const string model_filename, const shared_ptr<SolverState> state,
+      const string state_filename);
+  // Waits for the snapshot being written in the background, if any.
+  void FinishSnapshot();
+  // The summed outputs and loss of a test net over its test_iter batches.
+  struct TestResult {
+    vector<Dtype> score;
+    vector<int> score_output_id;
+    Dtype loss;
+  };
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
+  // Runs a test net with the weights it has. With sync_output, the outputs
+  // are averaged over the MPI ranks at every batch.
+  void RunTest(const int test_net_id, const bool sync_output,
+      TestResult* test_result);
+  void DisplayTestResult(const int test_net_id, const TestResult& result);
+  // Finishes the previous background test, copies the weights into the test
+  // nets and starts testing them in the background.
+  void TestAllInBackground();
+  // Waits for the background test, if any, and logs its results.
+  void FinishBackgroundTest();
+  // Runs the background test on device, in a context of its own that takes
+  // the settings of parent and is seeded with seed.
+  void BackgroundTestEntry(const int device, const Caffe* parent,
+      const unsigned int seed);
   virtual void SnapshotSolverState(SolverState* state) = 0;
   virtual void RestoreSolverState(const SolverState& state) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -58,6 +92,7 @@ class Solver {
     void SyncData();
     void SyncOutput(shared_ptr<Net<Dtype> > net);
     Dtype SyncLoss(Dtype loss);
+    void DisplayGradientCompression();
 #endif
 
   SolverParameter param_;
@@ -65,6 +100,17 @@ class Solver {
   int current_step_;
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
+  // The thread of the background test, the iteration its weights are from,
+  // and its results.
+  shared_ptr<boost::thread> test_thread_;
+  int background_test_iter_;
+  vector<TestResult> background_test_results_;
+  // The thread writing the last snapshot.
+  shared_ptr<boost::thread> snapshot_thread_;
+#ifdef USE_MPI
+  // The compressed gradient traffic of the last iteration.
+  GradientCompressionStats compression_stats_;
+#endif
 
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
@@ -92,6 +138,13 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // Normalize, Regularize, ComputeUpdateValue and the update of the net in
+  // one pass per parameter, see SolverParameter.fused_update.
+  void FusedApplyUpdate(Dtype rate);
+  // The rule ComputeUpdateValue implements.
+  virtual FusedUpdateRule fused_update_rule() const {
+    return FUSED_UPDATE_SGD;
+  }
   virtual void SnapshotSolverState(SolverState * state);
   virtual void RestoreSolverState(const SolverState& state);
   // history maintains the historical momentum data.
@@ -113,6 +166,9 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual FusedUpdateRule fused_update_rule() const {
+    return FUSED_UPDATE_NESTEROV;
+  }
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -127,6 +183,9 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual FusedUpdateRule fused_update_rule() const {
+    return FUSED_UPDATE_ADAGRAD;
+  }
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -0,0 +1,79 @@
+#ifndef CAFFE_UTIL_ALLREDUCE_HPP_
+#define CAFFE_UTIL_ALLREDUCE_HPP_
+
+#ifdef USE_MPI
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// Numbered as SolverParameter::AllreduceEngine.
+enum AllreduceAlgorithm {
+  ALLREDUCE_MPI = 0,
+  ALLREDUCE_RING = 1,
+  ALLREDUCE_HIERARCHICAL = 2
+};
+
+/**
+ * @brief Sums buffers over the ranks of a communicator with a chunked,
+ *    pipelined ring, optionally after a reduction within each host through
+ *    shared memory.
+ *
+ * Ring: the buffer is cut into one segment per rank, and every segment into
+ * chunks of chunk_bytes. Each chunk travels around the ring on its own, a
+ * reduce-scatter then an allgather, and is forwarded as soon as it has been
+ * received and added, so the chunks of a large gradient are in flight
+ * concurrently and every link carries 2 (P - 1) / P of the buffer.
+ *
+ * Hierarchical: the ranks of a host copy a chunk into a shared window, each
+ * sums its slice of the chunk over the host, the slices are summed across
+ * the hosts by a ring between the ranks with the same local index, and all
+ * copy the result back. On a single host this is a pure shared memory
+ * reduction. It falls back to the ring if the hosts have different numbers
+ * of ranks.
+ *
+ * The constructor and Allreduce are collective over the communicator.
+ */
+class Allreducer {
+ public:
+  Allreducer(MPI_Comm comm, size_t chunk_bytes);
+  ~Allreducer();
+
+  /// Sums data in place over the ranks.
+  template <typename Dtype>
+  void Allreduce(Dtype* data, int count, AllreduceAlgorithm algorithm);
+
+  size_t chunk_bytes() const { return chunk_bytes_; }
+
+ protected:
+  template <typename Dtype>
+  void Ring(Dtype* data, int count, MPI_Comm comm);
+  template <typename Dtype>
+  void Hierarchical(Dtype* data, int count);
+  // Makes the writes to the shared window visible to the other local ranks.
+  void NodeBarrier();
+
+  MPI_Comm comm_;
+  size_t chunk_bytes_;
+  // Ranks of the same host, and ranks with the same index on other hosts.
+  MPI_Comm node_comm_;
+  MPI_Comm cross_comm_;
+  int local_rank_;
+  int local_size_;
+  bool uniform_nodes_;
+  // One chunk per local rank.
+  MPI_Win window_;
+  std::vector<char*> slots_;
+  // Receives the chunks the ring adds to the local ones.
+  std::vector<char> recv_buffer_;
+
+  DISABLE_COPY_AND_ASSIGN(Allreducer);
+};
+
+}  // namespace caffe
+
+#endif  // USE_MPI
+
+#endif  // CAFFE_UTIL_ALLREDUCE_HPP_
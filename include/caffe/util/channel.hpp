@@ -10,11 +10,18 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/atomic.hpp>
 #include <boost/thread.hpp>
-#include <queue>
+#include <boost/lockfree/queue.hpp>
+#include <vector>
+#ifndef CPU_ONLY
 #include "cuda.h"
 #include <cuda_runtime.h>
+#endif
 
-using std::queue;
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/mpi_functions.hpp"
+
+using std::vector;
 using boost::mutex;
 using boost::condition_variable;
 using boost::shared_ptr;
@@ -23,7 +30,8 @@ using boost::atomic;
 namespace caffe {
 
 enum OperationType {
-    OP_SUM_ALL, OP_GATHER, OP_SCATTER, OP_BROADCAST
+    OP_SUM_ALL, OP_GATHER, OP_SCATTER, OP_BROADCAST, OP_FLUSH,
+    OP_SUM_COMPRESSED
 };
 
 class MPIJob {
@@ -33,7 +41,11 @@ public:
   int count_;
   int dtype_size_;
   OperationType op_;
+#ifndef CPU_ONLY
   cudaStream_t stream_;
+#endif
+  // Exchanges the gradient of an OP_SUM_COMPRESSED job.
+  GradientCompressor* compressor_;
 };
 
 class MPIComm{
@@ -47,28 +59,71 @@ class MPIComm{
       return *singleton_;
     }
 
-    inline static void AddMPIJob(MPIJob job){ Get().AddJob(job);};
+    inline static MPIJobFuture AddMPIJob(MPIJob job){ return Get().AddJob(job);};
     inline static void Syncrhonize(){Get().WaitAll();}
 
+    // Size of the buckets small in-place sums are packed into, 0 for none.
+    inline static void SetBucketBytes(size_t bytes){Get().bucket_bytes_.store(bytes);}
+    inline static size_t BucketBytes(){return Get().bucket_bytes_.load();}
+    // Number of MPI_Allreduce calls made for sums, packed or not.
+    inline static int NumAllreduce(){return Get().num_allreduce_.load();}
+    // Engine of the sums, taken by the sums queued after the call.
+    inline static void SetAllreduce(AllreduceAlgorithm algorithm, size_t chunk_bytes){
+      Get().allreduce_algorithm_.store(algorithm);
+      Get().allreduce_chunk_bytes_.store(chunk_bytes);
+    }
+
   private:
+    friend class MPIJobFuture;
+
+    // A job in the queue, with the state its futures wait on.
+    struct QueuedJob {
+      MPIJob job_;
+      shared_ptr<MPIJobState> state_;
+    };
+
     MPIComm();
 
     void ThreadFunc();
-    void DispatchJob(MPIJob& job);
+    void DispatchJob(QueuedJob* queued);
+    void CompleteJob(QueuedJob* queued);
+    void AddToBucket(QueuedJob* queued);
+    void FlushBucket();
+    void Sum(void* src, void* dst, int count, int dtype_size);
     bool IsRunning();
-    bool IsIdle();
     void StartProcessing();
     void EndProcessing();
-    void AddJob(MPIJob new_job);
+    MPIJobFuture AddJob(MPIJob new_job);
+    void WaitFor(const MPIJobState& state);
     void WaitAll();
 
-    queue<MPIJob> task_queue_;
-    mutable mutex queue_mutex_;
-    atomic<bool> running_, started_;
+    // Any thread pushes jobs without locking; only the communication thread
+    // pops them. The communication thread sleeps on cond_work_ when the
+    // queue is empty, and says so in idle_, so that AddJob only takes
+    // work_mutex_ to wake it up.
+    boost::lockfree::queue<QueuedJob*> task_queue_;
+    atomic<bool> running_, idle_;
     shared_ptr<boost::thread> thread_;
+    mutex work_mutex_;
     condition_variable cond_work_;
+    // Signaled when jobs are done, for the threads in WaitFor.
+    mutex finish_mutex_;
     condition_variable cond_finish_;
 
+    // The sums waiting in the bucket, packed one after the other in
+    // bucket_buffer_. Only touched by the communication thread.
+    atomic<size_t> bucket_bytes_;
+    atomic<int> num_allreduce_;
+    vector<QueuedJob*> bucket_jobs_;
+    vector<char> bucket_buffer_;
+    size_t bucket_used_;
+
+    // The ring engines. The Allreducer is created by the communication
+    // thread on its first sum, as its setup is collective.
+    atomic<int> allreduce_algorithm_;
+    atomic<size_t> allreduce_chunk_bytes_;
+    shared_ptr<Allreducer> allreducer_;
+
     static shared_ptr<MPIComm> singleton_;
 
 };
@@ -0,0 +1,100 @@
+#ifndef CAFFE_UTIL_FRAME_CACHE_HPP_
+#define CAFFE_UTIL_FRAME_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe cache of decoded and resized video frames, so that
+ *    the frames sampled again in a later epoch or test pass are not decoded
+ *    again.
+ *
+ * Frames are keyed by a string built by the segment readers from the
+ * video, the stream (modality), the frame index and the decoding options.
+ * The cv::Mat returned by Lookup must not be written.
+ */
+class FrameCache {
+ public:
+  virtual ~FrameCache() {}
+
+  /**
+   * @brief The cache shared by all the video data layers of the process,
+   *    e.g. by the train and test nets. It is created on first use, and
+   *    grown if a later caller asks for a larger capacity.
+   *
+   * With node_shared, and when running with MPI, the cache is instead a
+   * SharedFrameCache shared by all the ranks of the host, made of slots of
+   * slot_bytes. It is created by the first caller and keeps its size.
+   */
+  static shared_ptr<FrameCache> Global(size_t capacity_bytes,
+      bool node_shared = false, size_t slot_bytes = 0);
+
+  /// Returns true and sets frame if key is cached, counting a hit or a miss.
+  virtual bool Lookup(const string& key, cv::Mat* frame) = 0;
+  /// Caches frame, evicting older frames to make room.
+  virtual void Insert(const string& key, const cv::Mat& frame) = 0;
+
+  virtual size_t capacity_bytes() const = 0;
+  virtual size_t size_bytes() const = 0;
+  virtual size_t num_frames() const = 0;
+  virtual uint64_t hits() const = 0;
+  virtual uint64_t misses() const = 0;
+  virtual uint64_t evictions() const = 0;
+  /// Fraction of the lookups that were hits, 0 before the first lookup.
+  float hit_rate() const;
+};
+
+/**
+ * @brief A FrameCache local to the process, with a byte budget and exact
+ *    least recently used eviction.
+ */
+class LocalFrameCache : public FrameCache {
+ public:
+  explicit LocalFrameCache(size_t capacity_bytes);
+
+  virtual bool Lookup(const string& key, cv::Mat* frame);
+  virtual void Insert(const string& key, const cv::Mat& frame);
+
+  void set_capacity_bytes(size_t capacity_bytes);
+  virtual size_t capacity_bytes() const;
+  virtual size_t size_bytes() const;
+  virtual size_t num_frames() const;
+  virtual uint64_t hits() const;
+  virtual uint64_t misses() const;
+  virtual uint64_t evictions() const;
+
+ protected:
+  typedef std::list<std::pair<string, cv::Mat> > FrameList;
+
+  // Must be called with the lock held.
+  void EvictTo(size_t capacity_bytes);
+
+  // Hides boost::mutex from the header, see BlockingQueue.
+  class sync;
+
+  size_t capacity_bytes_;
+  size_t size_bytes_;
+  // Most recently used first.
+  FrameList frames_;
+  std::map<string, FrameList::iterator> index_;
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t evictions_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(LocalFrameCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FRAME_CACHE_HPP_
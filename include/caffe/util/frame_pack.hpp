@@ -0,0 +1,121 @@
+#ifndef CAFFE_UTIL_FRAME_PACK_H_
+#define CAFFE_UTIL_FRAME_PACK_H_
+
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+const int kFramePackNameSize = 16;
+
+/**
+ * @brief Read-only view of a frame pack: a single file holding all the
+ *    encoded frames of one video, so that reading a segment does not need
+ *    one file open per frame.
+ *
+ * A pack holds one or more named streams ("image", "flow_x", "flow_y"),
+ * each with the same number of frames, numbered from 1 like the
+ * image_%04d.jpg files they are built from. The layout is
+ *
+ *   char     magic[4]              "FPK1"
+ *   uint32_t num_streams
+ *   uint32_t num_frames
+ *   uint32_t reserved
+ *   char     names[num_streams][kFramePackNameSize]
+ *   uint64_t index[num_streams][num_frames][2]   (offset, size) in bytes
+ *   frames, stored as the original encoded files
+ *
+ * with all integers in host byte order. A missing frame has size 0.
+ * The file is memory-mapped and frames are decoded from the mapped bytes.
+ */
+class FramePack {
+ public:
+  FramePack();
+  ~FramePack();
+
+  /// Maps the pack; returns false if it is missing or malformed.
+  bool Open(const string& filename);
+  void Close();
+  inline bool is_open() const { return data_ != NULL; }
+  inline const string& filename() const { return filename_; }
+  inline int num_frames() const { return num_frames_; }
+  inline const vector<string>& streams() const { return streams_; }
+
+  /**
+   * @brief Decodes frame frame_id (1-based) of the given stream with
+   *    cv::imdecode. Returns an empty cv::Mat if the stream or the frame is
+   *    not in the pack.
+   */
+  cv::Mat DecodeFrame(const string& stream, int frame_id,
+      int cv_read_flag) const;
+
+  /**
+   * @brief Points data and size at the encoded bytes of frame frame_id
+   *    (1-based) of the given stream, without copying them. Returns false if
+   *    the stream or the frame is not in the pack.
+   */
+  bool FrameData(const string& stream, int frame_id, const uint8_t** data,
+      size_t* size) const;
+
+ private:
+  string filename_;
+  const uint8_t* data_;
+  size_t size_;
+  int num_frames_;
+  vector<string> streams_;
+  const uint64_t* index_;
+
+  DISABLE_COPY_AND_ASSIGN(FramePack);
+};
+
+/**
+ * @brief Keeps the most recently used frame packs open, so that the videos
+ *    sampled again are not opened and mapped again. Safe to use from the
+ *    decode workers; a pack stays mapped while a caller holds it, even once
+ *    evicted.
+ */
+class FramePackCache {
+ public:
+  /// Keeps at most capacity packs open.
+  explicit FramePackCache(int capacity);
+
+  /// Returns the open pack, opening it if needed; NULL if it cannot be.
+  shared_ptr<const FramePack> Open(const string& filename);
+  int size() const;
+
+ protected:
+  typedef std::list<std::pair<string, shared_ptr<const FramePack> > >
+      PackList;
+
+  // Hides boost::mutex from the header, see BlockingQueue.
+  class sync;
+
+  const int capacity_;
+  // Most recently used first.
+  PackList packs_;
+  std::map<string, PackList::iterator> index_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(FramePackCache);
+};
+
+/**
+ * @brief Writes a frame pack. frame_files[s][f] is the encoded file stored
+ *    as frame f + 1 of stream streams[s]; an empty path stores a missing
+ *    frame. Returns false if a file cannot be read or written.
+ */
+bool WriteFramePack(const string& filename, const vector<string>& streams,
+    const vector<vector<string> >& frame_files);
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_FRAME_PACK_H_
@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_FUSED_UPDATE_HPP_
+#define CAFFE_UTIL_FUSED_UPDATE_HPP_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// The update value rules of SGDSolver, NesterovSolver and AdaGradSolver.
+enum FusedUpdateRule {
+  FUSED_UPDATE_SGD,
+  FUSED_UPDATE_NESTEROV,
+  FUSED_UPDATE_ADAGRAD
+};
+
+// Weight decay, as SolverParameter.regularization_type.
+enum FusedUpdateDecay {
+  FUSED_DECAY_NONE,
+  FUSED_DECAY_L2,
+  FUSED_DECAY_L1
+};
+
+template <typename Dtype>
+struct FusedUpdateParameter {
+  FusedUpdateRule rule;
+  FusedUpdateDecay decay_type;
+  // The gradient is first scaled by normalization, 1 / iter_size.
+  Dtype normalization;
+  Dtype decay;
+  Dtype rate;
+  Dtype momentum;
+  // AdaGrad's numerical stability term.
+  Dtype delta;
+  // Whether to also subtract the update value from the data.
+  bool apply;
+};
+
+/**
+ * @brief Does what SGDSolver::Normalize, Regularize and ComputeUpdateValue,
+ *        then Blob::Update do to one parameter, in one pass over its
+ *        elements.
+ *
+ * The history is updated in place, diff is replaced by the update value, and
+ * if param.apply the data by the data minus the update value. Every element
+ * goes through the same floating point operations in the same order as in
+ * the separate passes, so the results are identical to them as long as the
+ * BLAS does not contract its axpy into fused multiply-adds. The elements are
+ * split over the OpenMP threads if Caffe is built with OpenMP.
+ */
+template <typename Dtype>
+void caffe_cpu_fused_update(const int n,
+    const FusedUpdateParameter<Dtype>& param, Dtype* data, Dtype* diff,
+    Dtype* history);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSED_UPDATE_HPP_
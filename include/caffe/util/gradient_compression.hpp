@@ -0,0 +1,118 @@
+#ifndef CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+#define CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
+
+#ifdef USE_MPI
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// Traffic of the compressed sums since the last reset.
+struct GradientCompressionStats {
+  GradientCompressionStats()
+      : raw_bytes(0), sent_bytes(0), encode_seconds(0),
+        exchange_seconds(0) {}
+
+  void Add(const GradientCompressionStats& other);
+  /// The exchange time the compression saved, assuming the exchange time is
+  /// proportional to the bytes sent, minus the time spent encoding.
+  double saved_seconds() const;
+
+  // Bytes of the gradients, and bytes each rank sent for them.
+  size_t raw_bytes;
+  size_t sent_bytes;
+  double encode_seconds;
+  double exchange_seconds;
+};
+
+/**
+ * @brief Sums a gradient over the ranks, exchanging it in a compressed form.
+ *
+ * FP16 sends every element as a half float, reduced by MPI_Allreduce with
+ * a half float sum. TOPK sends the topk_ratio fraction of the elements of
+ * largest magnitude as (index, float value) pairs, gathered from every rank
+ * and summed by each.
+ *
+ * With error feedback, what a rank did not send, the rounding of FP16 or the
+ * elements TOPK dropped, is kept in a residual of the size of the gradient
+ * and added to the next gradient of the same blob, so nothing is lost, only
+ * delayed. One compressor is used for one blob.
+ */
+class GradientCompressor {
+ public:
+  virtual ~GradientCompressor() {}
+
+  /// Replaces data with its sum over the ranks of comm. Collective over comm.
+  virtual void Allreduce(void* data, int count, MPI_Comm comm) = 0;
+
+  const GradientCompressionStats& stats() const { return stats_; }
+  void ResetStats() { stats_ = GradientCompressionStats(); }
+
+ protected:
+  GradientCompressionStats stats_;
+};
+
+/// Returns NULL if param does not compress.
+template <typename Dtype>
+shared_ptr<GradientCompressor> CreateGradientCompressor(
+    const GradientCompressionParameter& param);
+
+template <typename Dtype>
+class FP16GradientCompressor : public GradientCompressor {
+ public:
+  explicit FP16GradientCompressor(bool error_feedback);
+  virtual ~FP16GradientCompressor();
+
+  virtual void Allreduce(void* data, int count, MPI_Comm comm);
+
+ protected:
+  bool error_feedback_;
+  vector<Dtype> residual_;
+  vector<uint16_t> halves_;
+  MPI_Op sum_op_;
+
+  DISABLE_COPY_AND_ASSIGN(FP16GradientCompressor);
+};
+
+template <typename Dtype>
+class TopKGradientCompressor : public GradientCompressor {
+ public:
+  TopKGradientCompressor(float ratio, bool error_feedback);
+
+  virtual void Allreduce(void* data, int count, MPI_Comm comm);
+
+  /// The number of elements sent out of count.
+  int NumSent(int count) const;
+
+ protected:
+  struct Element {
+    int32_t index;
+    float value;
+  };
+
+  float ratio_;
+  bool error_feedback_;
+  vector<Dtype> residual_;
+  vector<Dtype> magnitudes_;
+  vector<Element> sent_;
+  vector<Element> received_;
+
+  DISABLE_COPY_AND_ASSIGN(TopKGradientCompressor);
+};
+
+/// Conversions between float and IEEE half floats, rounding to nearest even.
+/// Finite floats beyond the half range saturate at +-65504 with a warning,
+/// infinities and NaN are kept.
+uint16_t caffe_float_to_half(float value);
+float caffe_half_to_float(uint16_t half);
+
+}  // namespace caffe
+
+#endif  // USE_MPI
+
+#endif  // CAFFE_UTIL_GRADIENT_COMPRESSION_HPP_
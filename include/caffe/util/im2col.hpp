@@ -15,6 +15,33 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, Dtype* data_im);
 
+/**
+ * @brief An im2col_cpu or col2im_cpu: from src, the image or the columns, to
+ *    dst, the other.
+ *
+ * GetIm2colKernel and GetCol2imKernel return a kernel specialized at compile
+ * time for the kernel size, stride and pad of a convolution if it is one of
+ * the common shapes, and im2col_cpu or col2im_cpu otherwise, so that a layer
+ * picks its kernels once. The specialized kernels give the same results.
+ */
+template <typename Dtype>
+struct Im2colKernel {
+  typedef void (*Func)(const Dtype* src, const int channels,
+      const int height, const int width, const int kernel_h,
+      const int kernel_w, const int pad_h, const int pad_w,
+      const int stride_h, const int stride_w, Dtype* dst);
+};
+
+template <typename Dtype>
+typename Im2colKernel<Dtype>::Func GetIm2colKernel(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w);
+
+template <typename Dtype>
+typename Im2colKernel<Dtype>::Func GetCol2imKernel(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w);
+
 template <typename Dtype>
 void im2col_gpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -18,6 +18,9 @@ namespace caffe {
 
 using ::google::protobuf::Message;
 
+class FrameCache;
+class FramePack;
+
 inline void MakeTempFilename(string* temp_filename) {
   temp_filename->clear();
   *temp_filename = "/tmp/caffe_test.XXXXXX";
@@ -85,6 +88,12 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+// Writes to filename.tmp, then renames it to filename, so that filename is
+// either the previous file or the complete new one, never a partial write.
+// With compress, the file is gzipped; ReadProtoFromBinaryFile reads both.
+void WriteProtoToBinaryFileAtomically(const Message& proto,
+    const string& filename, bool compress = false);
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -101,12 +110,55 @@ bool ReadSegmentFlowToDatum(const string& filename, const int label,
 bool ReadSegmentRGBToDatum(const string& filename, const int label,
     const vector<int> offsets, const int height, const int width, const int length, Datum* datum, bool is_color);
 
+// Same as above, reading the frames from a frame pack instead of one
+// jpg file per frame. See caffe/util/frame_pack.hpp.
+bool ReadSegmentFlowToDatum(const FramePack& pack, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum);
+
+bool ReadSegmentRGBToDatum(const FramePack& pack, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum, bool is_color);
+
 bool ReadSegmentFlowToDatum_KD(const string& filename, const string& dir_mvs, const string& dir_tvl1, const int label,
     const vector<int> offsets, const int height, const int width, const int length, Datum* datum);
 
 bool ReadSegmentFlowToDatum_KDRF(const string& filename, const string& dir_img, const string& dir_tvl1, const int label,
     const vector<int> offsets, const int height, const int width, const int length, Datum* datum);
 
+// The segment readers above, returning the decoded (and resized) frames
+// instead of a Datum: one single-channel cv::Mat per flow field, one BGR or
+// gray cv::Mat per image, in datum channel order. They are meant to be
+// handed to DataTransformer::TransformFrames without a Datum round trip.
+// With reduced_decode, JPEG frames are decoded at the smallest 1/2, 1/4 or
+// 1/8 scale that is still at least height x width (OpenCV 3 only). With a
+// cache, the decoded and resized frames are looked up and stored there.
+bool ReadSegmentRGBToFrames(const string& filename, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames, bool is_color,
+    bool reduced_decode = false, FrameCache* cache = NULL);
+
+bool ReadSegmentRGBToFrames(const FramePack& pack, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames, bool is_color,
+    bool reduced_decode = false, FrameCache* cache = NULL);
+
+bool ReadSegmentFlowToFrames(const string& filename, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames,
+    bool reduced_decode = false, FrameCache* cache = NULL);
+
+bool ReadSegmentFlowToFrames(const FramePack& pack, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames,
+    bool reduced_decode = false, FrameCache* cache = NULL);
+
+bool ReadSegmentFlowToFrames_KD(const string& filename, const string& dir_mvs, const string& dir_tvl1,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool reduced_decode = false, FrameCache* cache = NULL);
+
+bool ReadSegmentFlowToFrames_KDRF(const string& filename, const string& dir_img, const string& dir_tvl1,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool reduced_decode = false, FrameCache* cache = NULL);
+
+// Stores each plane of each frame as one datum channel, in order. All the
+// frames must be 8-bit and of the same size.
+void FramesToDatum(const vector<cv::Mat>& frames, const int label, Datum* datum);
+
 
 inline bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color, Datum* datum) {
@@ -5,28 +5,86 @@
 #ifndef CAFFE_MPI_FUNCTIONS_HPP
 #define CAFFE_MPI_FUNCTIONS_HPP
 
+#ifdef USE_MPI
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+
+#include "caffe/util/allreduce.hpp"
+
 namespace caffe {
+  class GradientCompressor;
+
+  // The completion of a queued job, shared by the communication thread and
+  // the futures of the job.
+  struct MPIJobState {
+    MPIJobState() : done_(false) {}
+    boost::atomic<bool> done_;
+  };
+
+  // Lets the thread that queued a job wait for that job alone.
+  class MPIJobFuture {
+   public:
+    // The future of no job, which is done.
+    MPIJobFuture() : flush_on_wait_(false) {}
+    MPIJobFuture(const shared_ptr<MPIJobState>& state, bool flush_on_wait)
+        : state_(state), flush_on_wait_(flush_on_wait) {}
+
+    bool done() const { return !state_ || state_->done_.load(); }
+    // Blocks until the job has run. An in-place sum may be waiting in a
+    // bucket, so the first Wait on one queues a flush of the bucket. Every
+    // rank waits on the same jobs in the same order, so they all flush the
+    // same buckets.
+    void Wait();
+
+   private:
+    shared_ptr<MPIJobState> state_;
+    bool flush_on_wait_;
+  };
+
+  // The caffe_i* functions queue a job for the MPI communication thread,
+  // and return its future. Wait on the future before using the result, or
+  // call mpi_force_synchronize to wait for all the jobs.
+  template <typename Dtype>
+  MPIJobFuture caffe_iallreduce(Dtype* data, int count);
+
+  // Sums data in place, exchanging it through compressor, see
+  // GradientCompressor.
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* data, int count);
+  MPIJobFuture caffe_iallreduce_compressed(Dtype* data, int count,
+                                           GradientCompressor* compressor);
 
+#ifndef CPU_ONLY
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* data, int count, cudaStream_t stream);
+  MPIJobFuture caffe_iallreduce(Dtype* data, int count, cudaStream_t stream);
+#endif
 
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* src_data, Dtype* dst_data, int count);
+  MPIJobFuture caffe_iallreduce(Dtype* src_data, Dtype* dst_data, int count);
 
   template <typename Dtype>
-  void caffe_iallgather(Dtype* src_data, Dtype* dst_data, int count);
+  MPIJobFuture caffe_iallgather(Dtype* src_data, Dtype* dst_data, int count);
 
   template <typename Dtype>
-  void caffe_iscatter(Dtype* src_data, Dtype* dst_data, int count);
+  MPIJobFuture caffe_iscatter(Dtype* src_data, Dtype* dst_data, int count);
 
   template <typename Dtype>
-  void caffe_ibcast(Dtype* data, int count);
+  MPIJobFuture caffe_ibcast(Dtype* data, int count);
 
   void mpi_force_synchronize();
 
+  // In-place sums smaller than bytes are packed into buckets of that size,
+  // and each bucket is reduced by one MPI call. 0 disables the packing.
+  void mpi_set_bucket_bytes(size_t bytes);
+
+  // Selects how the sums are computed, see Allreducer. The ring engines
+  // transfer chunks of chunk_bytes.
+  void mpi_set_allreduce(AllreduceAlgorithm algorithm, size_t chunk_bytes);
+
 
 }
 
+#endif //USE_MPI
+
 #endif //CAFFE_MPI_FUNCTIONS_HPP_HPP
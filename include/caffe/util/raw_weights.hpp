@@ -0,0 +1,81 @@
+#ifndef CAFFE_UTIL_RAW_WEIGHTS_H_
+#define CAFFE_UTIL_RAW_WEIGHTS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Every blob in a raw weights file starts at a multiple of this many bytes.
+const int kRawWeightsAlignment = 64;
+
+/**
+ * @brief Read-only view of a raw weights file: the weights of a .caffemodel
+ *    stored as raw floats, so that they can be memory-mapped and used in
+ *    place instead of parsed and copied out of a protobuf.
+ *
+ * The layout is
+ *
+ *   char     magic[4]              "CRW1"
+ *   uint32_t index_size
+ *   uint64_t data_offset
+ *   char     index[index_size]     a serialized NetParameter
+ *   float    blobs, from data_offset
+ *
+ * with all integers and floats in host byte order. The index is the
+ * .caffemodel without the blob data: the blobs keep their shape (or the 4D
+ * dimensions of old models), and their data follow in the order of the
+ * index, each one starting at a multiple of kRawWeightsAlignment bytes from
+ * the start of the file.
+ *
+ * The file is mapped copy-on-write: processes mapping the same file share
+ * its pages in the page cache, and a process writing to the weights only
+ * changes its own copy of the pages it writes.
+ */
+class RawWeights {
+ public:
+  RawWeights();
+  ~RawWeights();
+
+  /// Maps the file; returns false if it is missing or malformed.
+  bool Open(const string& filename);
+  void Close();
+  inline bool is_open() const { return data_ != NULL; }
+  inline const string& filename() const { return filename_; }
+  inline const NetParameter& index() const { return index_; }
+
+  /// The data of blob blob_id of layer layer_id of the index, in the mapping.
+  inline float* blob_data(int layer_id, int blob_id) const {
+    return blob_data_[layer_id][blob_id];
+  }
+
+  /// Fills param with the .caffemodel the file was written from.
+  void ToProto(NetParameter* param) const;
+
+ private:
+  string filename_;
+  uint8_t* data_;
+  size_t size_;
+  NetParameter index_;
+  vector<vector<float*> > blob_data_;
+
+  DISABLE_COPY_AND_ASSIGN(RawWeights);
+};
+
+/// Whether filename starts with the magic of a raw weights file.
+bool IsRawWeightsFile(const string& filename);
+
+/**
+ * @brief Writes the weights of param, as read from a .caffemodel, to a raw
+ *    weights file. Returns false if the file cannot be written.
+ */
+bool WriteRawWeights(const string& filename, const NetParameter& param);
+
+}  // namespace caffe
+
+#endif   // CAFFE_UTIL_RAW_WEIGHTS_H_
@@ -0,0 +1,87 @@
+#ifndef CAFFE_UTIL_SHARED_FRAME_CACHE_HPP_
+#define CAFFE_UTIL_SHARED_FRAME_CACHE_HPP_
+
+#ifdef USE_MPI
+
+#include <boost/atomic.hpp>
+
+#include <string>
+
+#include "caffe/util/frame_cache.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A FrameCache in POSIX shared memory, read and filled by all the
+ *    processes that map it, e.g. the MPI ranks of one host, so that a frame
+ *    is decoded once per node rather than once per rank.
+ *
+ * The segment is a set-associative table of fixed size slots, and a frame
+ * larger than a slot is not cached. Lookups take no lock: every slot has a
+ * sequence number that writers keep odd while they fill the slot, and a
+ * reader that sees it change while copying the frame out counts a miss.
+ * Inserts claim a slot with a compare-and-swap on that number and give up
+ * if another process holds it. Eviction is least recently used within the
+ * kWays slots of a set.
+ */
+class SharedFrameCache : public FrameCache {
+ public:
+  /// Creates the segment name, replacing a stale one left by a dead job.
+  static shared_ptr<SharedFrameCache> Create(const string& name,
+      size_t capacity_bytes, size_t slot_bytes);
+  /// Maps the segment name, created by another process.
+  static shared_ptr<SharedFrameCache> Open(const string& name);
+  /// Removes the name. The processes which mapped the segment keep it.
+  static void Unlink(const string& name);
+  /**
+   * @brief Collective over MPI_COMM_WORLD: gives the ranks of each host one
+   *    cache, created by the first rank of the host and unlinked as soon as
+   *    all the others have mapped it, so no segment outlives the job.
+   */
+  static shared_ptr<SharedFrameCache> CreateNodeShared(size_t capacity_bytes,
+      size_t slot_bytes);
+
+  virtual ~SharedFrameCache();
+
+  virtual bool Lookup(const string& key, cv::Mat* frame);
+  virtual void Insert(const string& key, const cv::Mat& frame);
+
+  virtual size_t capacity_bytes() const;
+  /// The pixels cached by all the processes.
+  virtual size_t size_bytes() const;
+  virtual size_t num_frames() const;
+  /// Hits and misses of this process only.
+  virtual uint64_t hits() const;
+  virtual uint64_t misses() const;
+  virtual uint64_t evictions() const;
+
+  size_t slot_bytes() const;
+  size_t num_slots() const;
+
+  static const int kWays = 8;
+  static const int kMaxKeyLength = 255;
+  /// The slot size used when slot_bytes is 0: a 340 x 256 color frame.
+  static const size_t kDefaultSlotBytes = 340 * 256 * 3;
+
+ protected:
+  struct Header;
+  struct Slot;
+
+  SharedFrameCache(void* base, size_t mapped_bytes);
+  Slot* slot(size_t index) const;
+
+  void* base_;
+  size_t mapped_bytes_;
+  Header* header_;
+  char* slots_;
+  boost::atomic<uint64_t> hits_;
+  boost::atomic<uint64_t> misses_;
+
+  DISABLE_COPY_AND_ASSIGN(SharedFrameCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_MPI
+
+#endif  // CAFFE_UTIL_SHARED_FRAME_CACHE_HPP_
@@ -0,0 +1,39 @@
+#ifndef CAFFE_UTIL_TRANSFORM_ROW_H_
+#define CAFFE_UTIL_TRANSFORM_ROW_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// How the mean is subtracted from the pixels of a row.
+enum TransformMeanMode {
+  TRANSFORM_NO_MEAN,     // dst = x * scale
+  TRANSFORM_MEAN_VALUE,  // dst = (x - mean_value) * scale
+  TRANSFORM_MEAN_ROW     // dst = (x - mean[w]) * scale, mean from a mean file
+};
+
+/**
+ * @brief Transforms one row of uint8 pixels: converts them to Dtype,
+ *    inverts them (255 - x) if invert is set, subtracts the mean and scales
+ *    them, and writes them to dst, mirrored if mirror is set. mean is
+ *    indexed like src, i.e. before mirroring.
+ *
+ * The kernel is picked once per channel by GetTransformRowKernel, so that
+ * none of these options is tested per pixel. The float kernels use SSE2,
+ * or AVX2 when built with -mavx2, and give the same results as the scalar
+ * ones.
+ */
+template <typename Dtype>
+struct TransformRowKernel {
+  typedef void (*Func)(const uint8_t* src, const int width,
+      const Dtype* mean, const Dtype mean_value, const Dtype scale,
+      Dtype* dst);
+};
+
+template <typename Dtype>
+typename TransformRowKernel<Dtype>::Func GetTransformRowKernel(
+    const bool mirror, const bool invert, const TransformMeanMode mean_mode);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRANSFORM_ROW_H_
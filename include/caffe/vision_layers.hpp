@@ -13,6 +13,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/im2col.hpp"
 
 namespace caffe {
 
@@ -36,16 +37,34 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. The CPU
+  // helpers run on the buffers of thread, below threads_, so that threads
+  // can call them on different images at once.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, const int thread = 0);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, const int thread = 0);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, const int thread = 0);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // The same over batch consecutive images, whose columns are laid side by
+  // side so that each group takes one GEMM for all of them. batch is at most
+  // batch_size_. bias, weights_diff and input_diff can be NULL.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      const Dtype* bias, Dtype* output, const int batch,
+      const int thread = 0);
+  void backward_cpu_gemm_batch(const Dtype* input, const Dtype* output_diff,
+      const Dtype* weights, Dtype* weights_diff, Dtype* input_diff,
+      const int batch, const int thread = 0);
+  // The gradient of the weights thread accumulates into: the diff of the
+  // weights for the first thread, and for the others a partial sum, which
+  // zero_thread_weight_diffs clears and reduce_thread_weight_diffs adds to
+  // the diff.
+  Dtype* thread_weight_diff(const int thread);
+  void zero_thread_weight_diffs();
+  void reduce_thread_weight_diffs();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -75,16 +94,24 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int height_out_, width_out_;
   bool bias_term_;
   bool is_1x1_;
+  // The images the batched CPU helpers take at most, from
+  // cpu_batch_workspace_mb; 1 if they are not used.
+  int batch_size_;
+  // The threads the CPU passes split the images among, at most
+  // Caffe::cpu_threads(), each with its own buffers.
+  int threads_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
+  // On CPU, they run the kernels LayerSetUp picked for the shape.
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
-    im2col_cpu(data, conv_in_channels_, conv_in_height_, conv_in_width_,
+    im2col_kernel_(data, conv_in_channels_, conv_in_height_, conv_in_width_,
         kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_, col_buff);
   }
   inline void conv_col2im_cpu(const Dtype* col_buff, Dtype* data) {
-    col2im_cpu(col_buff, conv_in_channels_, conv_in_height_, conv_in_width_,
-        kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_, data);
+    col2im_kernel_(col_buff, conv_in_channels_, conv_in_height_,
+        conv_in_width_, kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_,
+        stride_w_, data);
   }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
@@ -96,7 +123,28 @@ class BaseConvolutionLayer : public Layer<Dtype> {
         kernel_h_, kernel_w_, pad_h_, pad_w_, stride_h_, stride_w_, data);
   }
 #endif
+  // The columns of batch images, side by side, and back.
+  void conv_im2col_cpu_batch(const Dtype* data, const int batch,
+      Dtype* col_batch, const int thread);
+  void conv_col2im_cpu_batch(const Dtype* col_batch, const int batch,
+      Dtype* data, const int thread);
+  // The buffers of thread: the ones below for the first thread, and the
+  // ones in thread_buffers_ for the others.
+  inline Blob<Dtype>* col_buffer(const int thread) {
+    return thread ? thread_buffers_[thread - 1].col_buffer.get() :
+        &col_buffer_;
+  }
+  inline Blob<Dtype>* col_batch_buffer(const int thread) {
+    return thread ? thread_buffers_[thread - 1].col_batch_buffer.get() :
+        &col_batch_buffer_;
+  }
+  inline Blob<Dtype>* output_batch_buffer(const int thread) {
+    return thread ? thread_buffers_[thread - 1].output_batch_buffer.get() :
+        &output_batch_buffer_;
+  }
 
+  typename Im2colKernel<Dtype>::Func im2col_kernel_;
+  typename Im2colKernel<Dtype>::Func col2im_kernel_;
   int conv_out_channels_;
   int conv_in_channels_;
   int conv_out_spatial_dim_;
@@ -109,6 +157,19 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+  // The columns and the outputs of batch_size_ images, each row holding
+  // that row of every image.
+  Blob<Dtype> col_batch_buffer_;
+  Blob<Dtype> output_batch_buffer_;
+  // The buffers of each thread after the first, and the partial sum of the
+  // gradient of the weights it computes.
+  struct ThreadBuffers {
+    shared_ptr<Blob<Dtype> > col_buffer;
+    shared_ptr<Blob<Dtype> > col_batch_buffer;
+    shared_ptr<Blob<Dtype> > output_batch_buffer;
+    shared_ptr<Blob<Dtype> > weight_diff;
+  };
+  vector<ThreadBuffers> thread_buffers_;
 };
 
 /**
@@ -155,8 +216,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism) and WINOGRAD (minimal filtering of 3x3
+   *    kernels on the CPU) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -176,6 +238,45 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
   virtual void compute_output_shape();
 };
 
+/**
+ * @brief Winograd implementation of ConvolutionLayer for 3x3 kernels of
+ *        stride 1. Fallback to ConvolutionLayer for GPU mode.
+ *
+ * The output is computed in 4x4 tiles by the minimal filtering algorithm
+ * F(4x4, 3x3): the filters and 6x6 input tiles are transformed, multiplied
+ * elementwise, which is one GEMM over the channels for each of the 36
+ * elements of a tile, and transformed back. This takes 4 times fewer
+ * multiplications than direct convolution, at the cost of some precision:
+ * the transforms add and subtract values of different scales, so expect
+ * differences of about 1e-5 relative to the CAFFE engine in float.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // The 4x4 output tiles of an image, partial at the bottom and right edges.
+  int tiles_h_, tiles_w_;
+  // Each holds 36 matrices, one per element of a tile: the filters
+  // (num_output x channels / group), with their gradient in the diff; the
+  // tiles of the input of an image (channels x tiles); and of its output
+  // (num_output x tiles), with the gradient of the output in the diff.
+  Blob<Dtype> transformed_weights_;
+  Blob<Dtype> transformed_input_;
+  Blob<Dtype> transformed_output_;
+};
+
 /**
  * @brief Convolve the input with a bank of learned filters, and (optionally)
  *        add biases, treating filters and convolution parameters in the
@@ -89,7 +89,12 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
 
   shared_ptr<Net<Dtype> > net(new Net<Dtype>(param_file,
       static_cast<Phase>(phase)));
-  net->CopyTrainedLayersFrom(pretrained_param_file);
+  // Raw weights are mapped rather than read.
+  if (IsRawWeightsFile(pretrained_param_file)) {
+    net->MapTrainedLayersFrom(pretrained_param_file);
+  } else {
+    net->CopyTrainedLayersFrom(pretrained_param_file);
+  }
   return net;
 }
 
@@ -99,6 +104,19 @@ void Net_Save(const Net<Dtype>& net, string filename) {
   WriteProtoToBinaryFile(net_param, filename.c_str());
 }
 
+void Net_SaveRaw(const Net<Dtype>& net, string filename) {
+  NetParameter net_param;
+  net.ToProto(&net_param, false);
+  if (!WriteRawWeights(filename, net_param)) {
+    throw std::runtime_error("Could not write " + filename);
+  }
+}
+
+void Net_MapFrom(Net<Dtype>* net, string filename) {
+  CheckFile(filename);
+  net->MapTrainedLayersFrom(filename);
+}
+
 void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
     bp::object labels_obj) {
   // check that this network has an input MemoryDataLayer
@@ -199,6 +217,7 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
   bp::def("set_device", &Caffe::SetDevice);
+  bp::def("set_cpu_threads", &Caffe::set_cpu_threads);
 
   bp::class_<Net<Dtype>, shared_ptr<Net<Dtype> >, boost::noncopyable >("Net",
     bp::no_init)
@@ -210,6 +229,7 @@ BOOST_PYTHON_MODULE(_caffe) {
     // The cast is to select a particular overload.
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
         &Net<Dtype>::CopyTrainedLayersFrom))
+    .def("map_from", &Net_MapFrom)
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
     .add_property("_blobs", bp::make_function(&Net<Dtype>::blobs,
         bp::return_internal_reference<>()))
@@ -226,7 +246,8 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::return_value_policy<bp::copy_const_reference>()))
     .def("_set_input_arrays", &Net_SetInputArrays,
         bp::with_custodian_and_ward<1, 2, bp::with_custodian_and_ward<1, 3> >())
-    .def("save", &Net_Save);
+    .def("save", &Net_Save)
+    .def("save_raw", &Net_SaveRaw);
 
   bp::class_<Blob<Dtype>, shared_ptr<Blob<Dtype> >, boost::noncopyable>(
     "Blob", bp::no_init)
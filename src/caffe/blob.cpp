@@ -85,6 +85,24 @@ const Dtype* Blob<Dtype>::gpu_data() const {
   return (const Dtype*)data_->gpu_data();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_gpu_data(Dtype* data) {
+  CHECK(data);
+  data_->set_gpu_data(data);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_cpu_diff(Dtype* diff) {
+  CHECK(diff);
+  diff_->set_cpu_data(diff);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_gpu_diff(Dtype* diff) {
+  CHECK(diff);
+  diff_->set_gpu_data(diff);
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_diff() const {
   CHECK(diff_);
@@ -476,11 +494,13 @@ void Blob<Dtype>::ToProto(BlobProto* proto, bool write_diff) const {
   proto->clear_data();
   proto->clear_diff();
   const Dtype* data_vec = cpu_data();
+  proto->mutable_data()->Reserve(count_);
   for (int i = 0; i < count_; ++i) {
     proto->add_data(data_vec[i]);
   }
   if (write_diff) {
     const Dtype* diff_vec = cpu_diff();
+    proto->mutable_diff()->Reserve(count_);
     for (int i = 0; i < count_; ++i) {
       proto->add_diff(diff_vec[i]);
     }
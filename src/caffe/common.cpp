@@ -1,3 +1,4 @@
+#include <boost/thread/tss.hpp>
 #include <glog/logging.h>
 #include <cstdio>
 #include <ctime>
@@ -8,6 +9,44 @@
 namespace caffe {
 
 shared_ptr<Caffe> Caffe::singleton_;
+// The contexts of the threads that have their own, deleted as they exit.
+static boost::thread_specific_ptr<Caffe> thread_context_;
+
+Caffe& Caffe::Get() {
+  Caffe* context = thread_context_.get();
+  if (context) {
+    return *context;
+  }
+  if (!singleton_.get()) {
+    singleton_.reset(new Caffe());
+  }
+  return *singleton_;
+}
+
+void Caffe::InitThreadContext(const Caffe& parent, const unsigned int seed) {
+  CHECK(!thread_context_.get()) << "The thread already has a context.";
+  Caffe* context = new Caffe();
+  context->mode_ = parent.mode_;
+  context->cpu_threads_ = parent.cpu_threads_;
+#ifdef USE_MPI
+  context->parallel_mode_ = parent.parallel_mode_;
+  context->mpi_my_rank_ = parent.mpi_my_rank_;
+  context->mpi_all_rank_ = parent.mpi_all_rank_;
+  context->device_id_ = parent.device_id_;
+  context->remaining_sub_iter_ = parent.remaining_sub_iter_;
+#endif
+#ifdef USE_CUDNN
+  context->cudnn_mem_richness_ = parent.cudnn_mem_richness_;
+#endif
+  thread_context_.reset(context);
+#if defined(USE_MPI) && !defined(CPU_ONLY)
+  // With MPI the constructor leaves the handles to SetDevice.
+  if (parent.device_id_ >= 0) {
+    SetDevice(parent.device_id_);
+  }
+#endif
+  set_random_seed(seed);
+}
 
 // random seeding
 int64_t cluster_seedgen(bool sync) {
@@ -66,6 +105,17 @@ void GlobalInit(int* pargc, char*** pargv) {
 
 }
 
+void Caffe::set_cpu_threads(const int threads) {
+  CHECK_GE(threads, 1) << "Need at least one CPU thread.";
+#ifndef _OPENMP
+  if (threads > 1) {
+    LOG(WARNING) << "Caffe was built without OpenMP; the CPU convolutions "
+        << "and pooling run on one thread.";
+  }
+#endif
+  Get().cpu_threads_ = threads;
+}
+
 void GlobalFinalize(){
   //Add something here
 
@@ -77,7 +127,15 @@ void GlobalFinalize(){
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU) { }
+    : random_generator_(), mode_(Caffe::CPU), cpu_threads_(1) {
+#ifdef USE_MPI
+  parallel_mode_ = NO;
+  mpi_my_rank_ = 0;
+  mpi_all_rank_ = 1;
+  device_id_ = -1;
+  remaining_sub_iter_ = 0;
+#endif
+}
 
 Caffe::~Caffe() { }
 
@@ -121,7 +179,7 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU) {
+    mode_(Caffe::CPU), cpu_threads_(1) {
   #ifndef USE_MPI
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
@@ -139,6 +197,11 @@ Caffe::Caffe()
   // we are not trying to create the any cuda stuff here
   // because on exclusive mode GPUs it will cause program fail
   // Reason: no device id assigned at this time, all processes will try to access gpu 0.
+  parallel_mode_ = NO;
+  mpi_my_rank_ = 0;
+  mpi_all_rank_ = 1;
+  device_id_ = -1;
+  remaining_sub_iter_ = 0;
   #endif
 
   #ifdef USE_CUDNN
@@ -8,6 +8,7 @@
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/transform_row.hpp"
 
 namespace caffe {
 
@@ -122,7 +123,6 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const bool do_multi_scale = param_.multi_scale();
   vector<pair<int, int> > offset_pairs;
   vector<pair<int, int> > crop_size_pairs;
-  cv::Mat multi_scale_bufferM;
 
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
@@ -195,29 +195,50 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 
   need_imgproc = do_multi_scale && crop_size && ((crop_height != crop_size) || (crop_width != crop_size));
 
+  // image resize etc needed: crop and resize all the channels at once, the
+  // planes of the datum are wrapped without copying them.
+  if (need_imgproc){
+    vector<cv::Mat> planes(datum_channels);
+    for (int c = 0; c < datum_channels; ++c) {
+      if (has_uint8) {
+        planes[c] = cv::Mat(datum_height, datum_width, CV_8UC1,
+            const_cast<char*>(data.data()) + c * datum_height * datum_width);
+      } else {
+        planes[c] = cv::Mat(datum_height, datum_width, CV_32FC1,
+            const_cast<float*>(datum.float_data().data()) +
+            c * datum_height * datum_width);
+      }
+    }
+    ResizeCrop(planes, cv::Rect(w_off, h_off, crop_width, crop_height),
+        crop_size);
+  }
+
+  const TransformMeanMode mean_mode = has_mean_file ? TRANSFORM_MEAN_ROW :
+      (has_mean_values ? TRANSFORM_MEAN_VALUE : TRANSFORM_NO_MEAN);
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
-
-    // image resize etc needed
-    if (need_imgproc){
-      cv::Mat M(datum_height, datum_width, has_uint8?CV_8UC1:CV_32FC1);
-
-      //put the datum content to a cvMat
-      for (int h = 0; h < datum_height; ++h) {
-        for (int w = 0; w < datum_width; ++w) {
-          int data_index = (c * datum_height + h) * datum_width + w;
-          if (has_uint8) {
-            M.at<uchar>(h, w) = static_cast<uint8_t>(data[data_index]);
-          }else{
-            M.at<float>(h, w) = datum.float_data(data_index);
-          }
+    const bool do_invert = do_mirror && ((param_.is_flow() && c % 2 == 0) ||
+        (param_.is_RF() && c % 2 == 1 && c > 2));
+    if (has_uint8) {
+      // Pick the kernel for this channel once, then transform row by row.
+      typename TransformRowKernel<Dtype>::Func transform_row =
+          GetTransformRowKernel<Dtype>(do_mirror, do_invert, mean_mode);
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      const uint8_t* uint8_data = reinterpret_cast<const uint8_t*>(data.data());
+      for (int h = 0; h < height; ++h) {
+        const uint8_t* src = need_imgproc ?
+            multi_scale_planes_[c].ptr<uint8_t>(h) :
+            uint8_data + (c * datum_height + h_off + h) * datum_width + w_off;
+        const Dtype* mean_row = NULL;
+        if (has_mean_file) {
+          mean_row = do_multi_scale ? mean + (c * datum_height + h) * datum_width :
+              mean + (c * datum_height + h_off + h) * datum_width + w_off;
         }
+        transform_row(src, width, mean_row, mean_value, scale,
+            transformed_data + (c * height + h) * width);
       }
-
-      //resize the cropped patch to network input size
-      cv::Mat cropM(M, cv::Rect(w_off, h_off, crop_width, crop_height));
-      cv::resize(cropM, multi_scale_bufferM, cv::Size(crop_size, crop_size));
+      continue;
     }
     for (int h = 0; h < height; ++h) {
       for (int w = 0; w < width; ++w) {
@@ -228,41 +249,14 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
           top_index = (c * height + h) * width + w;
         }
         if (need_imgproc){
-          if (has_uint8){
-        	  if (param_.is_flow() && do_mirror && c%2 == 0)
-        		  datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-        	  else
-              if (param_.is_RF() && do_mirror && c%2 == 1 && c>2)
-                datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-              else
-          		  datum_element = static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-          }else {
-        	  if (param_.is_flow() && do_mirror && c%2 == 0)
-        		  datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-        	  else
-              if (param_.is_RF() && do_mirror && c%2 == 1 && c>2)
-                datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-              else
-        		    datum_element = static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-          }
+          datum_element = static_cast<Dtype>(multi_scale_planes_[c].at<float>(h, w));
+          if (do_invert)
+            datum_element = 255 - datum_element;
         }else {
-          if (has_uint8) {
-        	  if (param_.is_flow() && do_mirror && c%2 == 0)
-        		  datum_element = 255 - static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        	  else
-              if (param_.is_RF() && do_mirror && c%2 == 1 && c>2)
-                datum_element = 255 - static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-              else
-          		  datum_element = static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-          } else {
-        	  if (param_.is_flow() && do_mirror && c%2 == 0)
-        		  datum_element = 255 - datum.float_data(data_index);
-        	  else
-              if (param_.is_RF() && do_mirror && c%2 == 1 && c>2)
-                datum_element = 255 - datum.float_data(data_index);
-              else
-          		  datum_element = datum.float_data(data_index);
-          }
+          if (do_invert)
+            datum_element = 255 - datum.float_data(data_index);
+          else
+            datum_element = datum.float_data(data_index);
         }
         if (has_mean_file) {
           if (do_multi_scale) {
@@ -336,6 +330,160 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   Transform(datum, transformed_data);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::ResizeCrop(const vector<cv::Mat>& images,
+    const cv::Rect& crop, const int crop_size) {
+  // One cv::resize over the merged crops instead of one per channel; the
+  // interpolation does not mix channels, so the result is the same.
+  vector<cv::Mat> crops(images.size());
+  for (int i = 0; i < images.size(); ++i) {
+    crops[i] = images[i](crop);
+  }
+  cv::merge(crops, multi_scale_crop_);
+  cv::resize(multi_scale_crop_, multi_scale_resized_,
+      cv::Size(crop_size, crop_size));
+  cv::split(multi_scale_resized_, multi_scale_planes_);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformFrames(const vector<cv::Mat>& frames,
+                                             Blob<Dtype>* transformed_blob) {
+  CHECK(!frames.empty()) << "There is no frame to transform";
+  const int img_height = frames[0].rows;
+  const int img_width = frames[0].cols;
+  // Output channel c is plane frame_plane[c] of frame frame_id[c], which is
+  // how ReadSegment*ToDatum lays the same frames out in a Datum.
+  vector<int> frame_id, frame_plane;
+  for (int i = 0; i < frames.size(); ++i) {
+    CHECK_EQ(frames[i].depth(), CV_8U) << "Frames must be 8-bit images";
+    CHECK_EQ(frames[i].rows, img_height);
+    CHECK_EQ(frames[i].cols, img_width);
+    for (int p = 0; p < frames[i].channels(); ++p) {
+      frame_id.push_back(i);
+      frame_plane.push_back(p);
+    }
+  }
+  const int img_channels = frame_id.size();
+
+  const int crop_size = param_.crop_size();
+  const Dtype scale = param_.scale();
+  const bool do_mirror = param_.mirror() && Rand(2);
+  const bool has_mean_file = param_.has_mean_file();
+  const bool has_mean_values = mean_values_.size() > 0;
+  const bool do_multi_scale = param_.multi_scale();
+
+  // Check dimensions.
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+  CHECK_EQ(channels, img_channels);
+  CHECK_GE(img_height, crop_size);
+  CHECK_GE(img_width, crop_size);
+  if (crop_size) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+  } else {
+    CHECK_EQ(img_height, height);
+    CHECK_EQ(img_width, width);
+  }
+
+  const Dtype* mean = NULL;
+  if (has_mean_file) {
+    CHECK_EQ(img_channels, data_mean_.channels());
+    CHECK_EQ(img_height, data_mean_.height());
+    CHECK_EQ(img_width, data_mean_.width());
+    mean = data_mean_.cpu_data();
+  }
+  if (has_mean_values) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
+     "Specify either 1 mean_value or as many as channels: " << img_channels;
+  }
+
+  if (!crop_size && do_multi_scale){
+    LOG(ERROR)<< "Multi scale augmentation is only activated with crop_size set.";
+  }
+
+  // Same crop selection, and same Rand() calls, as Transform(Datum).
+  int h_off = 0;
+  int w_off = 0;
+  int crop_height = 0;
+  int crop_width = 0;
+  if (crop_size) {
+    if (phase_ == TRAIN) {
+      if (do_multi_scale){
+        vector<pair<int, int> > crop_size_pairs;
+        fillCropSize(img_height, img_width, crop_size, crop_size, crop_size_pairs,
+                     max_distort_, custom_scale_ratios_);
+        int sel = Rand(crop_size_pairs.size());
+        crop_height = crop_size_pairs[sel].first;
+        crop_width = crop_size_pairs[sel].second;
+      }else{
+        crop_height = crop_size;
+        crop_width = crop_size;
+      }
+      if (param_.fix_crop()){
+        vector<pair<int, int> > offset_pairs;
+        fillFixOffset(img_height, img_width, crop_height, crop_width,
+                      param_.more_fix_crop(), offset_pairs);
+        int sel = Rand(offset_pairs.size());
+        h_off = offset_pairs[sel].first;
+        w_off = offset_pairs[sel].second;
+      }else{
+        h_off = Rand(img_height - crop_height + 1);
+        w_off = Rand(img_width - crop_width + 1);
+      }
+    } else {
+      crop_height = crop_size;
+      crop_width = crop_size;
+      h_off = (img_height - crop_size) / 2;
+      w_off = (img_width - crop_size) / 2;
+    }
+  }
+  const bool need_imgproc = do_multi_scale && crop_size &&
+      ((crop_height != crop_size) || (crop_width != crop_size));
+
+  const TransformMeanMode mean_mode = has_mean_file ? TRANSFORM_MEAN_ROW :
+      (has_mean_values ? TRANSFORM_MEAN_VALUE : TRANSFORM_NO_MEAN);
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  if (need_imgproc) {
+    ResizeCrop(frames, cv::Rect(w_off, h_off, crop_width, crop_height),
+        crop_size);
+  }
+  // Otherwise, the cropped region of the current frame, split into
+  // contiguous planes for the row kernels.
+  vector<cv::Mat> frame_planes;
+  int current_frame = -1;
+  for (int c = 0; c < channels; ++c) {
+    if (!need_imgproc && current_frame != frame_id[c]) {
+      const cv::Mat region =
+          frames[frame_id[c]](cv::Rect(w_off, h_off, width, height));
+      if (region.channels() > 1) {
+        cv::split(region, frame_planes);
+      } else {
+        frame_planes.assign(1, region);
+      }
+      current_frame = frame_id[c];
+    }
+    const cv::Mat& plane = need_imgproc ? multi_scale_planes_[c] :
+        frame_planes[frame_plane[c]];
+    const bool invert = do_mirror && ((param_.is_flow() && c % 2 == 0) ||
+        (param_.is_RF() && c % 2 == 1 && c > 2));
+    typename TransformRowKernel<Dtype>::Func transform_row =
+        GetTransformRowKernel<Dtype>(do_mirror, invert, mean_mode);
+    const Dtype mean_value = has_mean_values ?
+        mean_values_[mean_values_.size() == 1 ? 0 : c] : Dtype(0);
+    for (int h = 0; h < height; ++h) {
+      const Dtype* mean_row = NULL;
+      if (has_mean_file) {
+        mean_row = do_multi_scale ? mean + (c * img_height + h) * img_width :
+            mean + (c * img_height + h_off + h) * img_width + w_off;
+      }
+      transform_row(plane.ptr<uint8_t>(h), width, mean_row, mean_value, scale,
+          transformed_data + (c * height + h) * width);
+    }
+  }
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
@@ -718,6 +866,18 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const cv::Mat& cv_img) {
   return shape;
 }
 
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferFramesBlobShape(
+    const vector<cv::Mat>& frames) {
+  CHECK(!frames.empty()) << "There is no frame in the vector";
+  // The frames are stacked along the channels.
+  vector<int> shape = InferBlobShape(frames[0]);
+  for (int i = 1; i < frames.size(); ++i) {
+    shape[1] += frames[i].channels();
+  }
+  return shape;
+}
+
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(
     const vector<cv::Mat> & mat_vector) {
@@ -735,8 +895,18 @@ void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
       (phase_ == TRAIN && param_.crop_size());
   if (needs_rand) {
-    const unsigned int rng_seed =caffe_rng_rand();
-    rng_.reset(new Caffe::RNG(rng_seed));
+    InitRand(caffe_rng_rand());
+  } else {
+    rng_.reset();
+  }
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::InitRand(unsigned int seed) {
+  const bool needs_rand = param_.mirror() ||
+      (phase_ == TRAIN && param_.crop_size());
+  if (needs_rand) {
+    rng_.reset(new Caffe::RNG(seed));
   } else {
     rng_.reset();
   }
@@ -0,0 +1,108 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "caffe/decode_pool.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+DecodePool<Dtype>::DecodePool(const TransformationParameter& param,
+    Phase phase, int num_threads)
+    : num_threads_(num_threads), batch_(NULL), batch_data_(NULL) {
+  CHECK_GT(num_threads_, 0) << "The decode pool needs at least one thread.";
+  for (int i = 0; i < num_threads_; ++i) {
+    transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(param, phase)));
+    transformed_data_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  seed_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+  if (num_threads_ > 1) {
+    for (int i = 0; i < num_threads_; ++i) {
+      workers_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &DecodePool<Dtype>::WorkerEntry, this, i)));
+    }
+  }
+}
+
+template <typename Dtype>
+DecodePool<Dtype>::~DecodePool() {
+  for (int i = 0; i < workers_.size(); ++i) {
+    pending_items_.push(-1);
+  }
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+template <typename Dtype>
+void DecodePool<Dtype>::Run(const ReadFunc& read, Blob<Dtype>* batch) {
+  CHECK(batch->count());
+  read_ = read;
+  batch_ = batch;
+  // Take the pointer here, mutable_cpu_data() must not race between workers.
+  batch_data_ = batch->mutable_cpu_data();
+  vector<int> item_shape = batch->shape();
+  item_shape[0] = 1;
+  for (int i = 0; i < num_threads_; ++i) {
+    transformed_data_[i]->Reshape(item_shape);
+  }
+  // Draw the seeds in item order, whatever the number of workers.
+  caffe::rng_t* seed_rng = static_cast<caffe::rng_t*>(seed_rng_->generator());
+  item_seeds_.resize(batch->num());
+  for (int item_id = 0; item_id < batch->num(); ++item_id) {
+    item_seeds_[item_id] = (*seed_rng)();
+  }
+
+  if (workers_.empty()) {
+    vector<cv::Mat> frames;
+    for (int item_id = 0; item_id < batch->num(); ++item_id) {
+      ProcessItem(0, item_id, &frames);
+    }
+  } else {
+    // The workers write into batch, so wait for all the items even if the
+    // calling prefetch thread is being stopped.
+    boost::this_thread::disable_interruption no_interruption;
+    for (int item_id = 0; item_id < batch->num(); ++item_id) {
+      pending_items_.push(item_id);
+    }
+    for (int item_id = 0; item_id < batch->num(); ++item_id) {
+      done_items_.pop();
+    }
+  }
+  read_.clear();
+  batch_ = NULL;
+  batch_data_ = NULL;
+}
+
+template <typename Dtype>
+void DecodePool<Dtype>::WorkerEntry(int worker_id) {
+  vector<cv::Mat> frames;
+  // Items go to whichever worker is free, the seeds keep the batch the same.
+  while (true) {
+    const int item_id = pending_items_.pop();
+    if (item_id < 0) {
+      break;
+    }
+    ProcessItem(worker_id, item_id, &frames);
+    done_items_.push(item_id);
+  }
+}
+
+template <typename Dtype>
+void DecodePool<Dtype>::ProcessItem(int worker_id, int item_id,
+    vector<cv::Mat>* frames) {
+  if (!read_(item_id, frames)) {
+    return;
+  }
+  DataTransformer<Dtype>* transformer = transformers_[worker_id].get();
+  Blob<Dtype>* transformed_data = transformed_data_[worker_id].get();
+  transformer->InitRand(item_seeds_[item_id]);
+  transformed_data->set_cpu_data(batch_data_ + batch_->offset(item_id));
+  transformer->TransformFrames(*frames, transformed_data);
+}
+
+INSTANTIATE_CLASS(DecodePool);
+
+}  // namespace caffe
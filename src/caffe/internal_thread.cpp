@@ -4,7 +4,7 @@
 namespace caffe {
 
 InternalThread::~InternalThread() {
-  WaitForInternalThreadToExit();
+  StopInternalThread();
 }
 
 bool InternalThread::is_started() const {
@@ -37,4 +37,15 @@ bool InternalThread::WaitForInternalThreadToExit() {
   return true;
 }
 
+bool InternalThread::StopInternalThread() {
+  if (is_started()) {
+    thread_->interrupt();
+  }
+  return WaitForInternalThreadToExit();
+}
+
+bool InternalThread::must_stop() {
+  return boost::this_thread::interruption_requested();
+}
+
 }  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -53,6 +54,11 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // and no padding, so flag for skipping the buffer and transformation.
   is_1x1_ = kernel_w_ == 1 && kernel_h_ == 1
       && stride_h_ == 1 && stride_w_ == 1 && pad_h_ == 0 && pad_w_ == 0;
+  // Pick the CPU im2col and col2im, specialized for the common shapes.
+  im2col_kernel_ = GetIm2colKernel<Dtype>(kernel_h_, kernel_w_, pad_h_,
+      pad_w_, stride_h_, stride_w_);
+  col2im_kernel_ = GetCol2imKernel<Dtype>(kernel_h_, kernel_w_, pad_h_,
+      pad_w_, stride_h_, stride_w_);
   // Configure output channels and groups.
   channels_ = bottom[0]->channels();
   num_output_ = this->layer_param_.convolution_param().num_output();
@@ -146,9 +152,55 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else {
     col_buffer_.Reshape(1, kernel_dim_, height_out_, width_out_);
   }
-  // Set up the all ones "bias multiplier" for adding biases by BLAS
+  // The batched CPU helpers lower as many images at once as their column
+  // and output buffers fit in the workspace. Like col_buffer_, the buffers
+  // are only allocated once used.
+  batch_size_ = 1;
+  const float workspace_mb =
+      this->layer_param_.convolution_param().cpu_batch_workspace_mb();
+  if (workspace_mb > 0 && !reverse_dimensions()) {
+    const size_t image_bytes = size_t(kernel_dim_ + conv_out_channels_) *
+        conv_out_spatial_dim_ * sizeof(Dtype);
+    const size_t images = workspace_mb * 1024 * 1024 / image_bytes;
+    batch_size_ = std::max<size_t>(1, std::min<size_t>(images, num_));
+  }
+  if (batch_size_ > 1) {
+    col_batch_buffer_.Reshape(1, kernel_dim_, batch_size_,
+        conv_out_spatial_dim_);
+    output_batch_buffer_.Reshape(1, conv_out_channels_, batch_size_,
+        conv_out_spatial_dim_);
+  }
+  // The CPU passes split the batches of images among up to
+  // Caffe::cpu_threads() threads. The threads past the first lower their
+  // images into buffers of their own, also only allocated once used.
+  threads_ = 1;
+#ifdef _OPENMP
+  if (!reverse_dimensions()) {
+    const int batches = (num_ + batch_size_ - 1) / batch_size_;
+    threads_ = std::max(1, std::min(Caffe::cpu_threads(), batches));
+  }
+#endif
+  thread_buffers_.resize(threads_ - 1);
+  for (int t = 0; t < thread_buffers_.size(); ++t) {
+    ThreadBuffers& buffers = thread_buffers_[t];
+    if (!buffers.col_buffer) {
+      buffers.col_buffer.reset(new Blob<Dtype>());
+      buffers.col_batch_buffer.reset(new Blob<Dtype>());
+      buffers.output_batch_buffer.reset(new Blob<Dtype>());
+      buffers.weight_diff.reset(new Blob<Dtype>());
+    }
+    buffers.col_buffer->ReshapeLike(col_buffer_);
+    if (batch_size_ > 1) {
+      buffers.col_batch_buffer->ReshapeLike(col_batch_buffer_);
+      buffers.output_batch_buffer->ReshapeLike(output_batch_buffer_);
+    }
+    buffers.weight_diff->ReshapeLike(*this->blobs_[0]);
+  }
+  // Set up the all ones "bias multiplier" for adding biases by BLAS, long
+  // enough for the outputs of batch_size_ images.
   if (bias_term_) {
-    vector<int> bias_multiplier_shape(1, height_out_ * width_out_);
+    vector<int> bias_multiplier_shape(1,
+        batch_size_ * height_out_ * width_out_);
     bias_multiplier_.Reshape(bias_multiplier_shape);
     caffe_set(bias_multiplier_.count(), Dtype(1),
         bias_multiplier_.mutable_cpu_data());
@@ -157,13 +209,13 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, const int thread) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer(thread)->mutable_cpu_data());
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer(thread)->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -183,8 +235,8 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    const Dtype* weights, Dtype* input, const int thread) {
+  Dtype* col_buff = col_buffer(thread)->mutable_cpu_data();
   if (is_1x1_) {
     col_buff = input;
   }
@@ -201,11 +253,11 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, const int thread) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer(thread)->mutable_cpu_data());
+    col_buff = col_buffer(thread)->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -222,6 +274,146 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::conv_im2col_cpu_batch(const Dtype* data,
+    const int batch, Dtype* col_batch, const int thread) {
+  const int data_dim = conv_in_channels_ * conv_in_height_ * conv_in_width_;
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  for (int b = 0; b < batch; ++b) {
+    const Dtype* col_buff = data + data_dim * b;
+    if (!is_1x1_) {
+      conv_im2col_cpu(col_buff, col_buffer(thread)->mutable_cpu_data());
+      col_buff = col_buffer(thread)->cpu_data();
+    }
+    for (int k = 0; k < kernel_dim_; ++k) {
+      caffe_copy(conv_out_spatial_dim_, col_buff + conv_out_spatial_dim_ * k,
+          col_batch + batch_spatial_dim * k + conv_out_spatial_dim_ * b);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::conv_col2im_cpu_batch(
+    const Dtype* col_batch, const int batch, Dtype* data, const int thread) {
+  const int data_dim = conv_in_channels_ * conv_in_height_ * conv_in_width_;
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  for (int b = 0; b < batch; ++b) {
+    Dtype* col_buff = data + data_dim * b;
+    if (!is_1x1_) {
+      col_buff = col_buffer(thread)->mutable_cpu_data();
+    }
+    for (int k = 0; k < kernel_dim_; ++k) {
+      caffe_copy(conv_out_spatial_dim_,
+          col_batch + batch_spatial_dim * k + conv_out_spatial_dim_ * b,
+          col_buff + conv_out_spatial_dim_ * k);
+    }
+    if (!is_1x1_) {
+      conv_col2im_cpu(col_buff, data + data_dim * b);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, const Dtype* bias, Dtype* output, const int batch,
+    const int thread) {
+  CHECK_LE(batch, batch_size_);
+  const int output_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  Dtype* col_batch = col_batch_buffer(thread)->mutable_cpu_data();
+  Dtype* output_batch = output_batch_buffer(thread)->mutable_cpu_data();
+  conv_im2col_cpu_batch(input, batch, col_batch, thread);
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, batch_spatial_dim, kernel_dim_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_batch + col_offset_ * batch * g,
+        (Dtype)0., output_batch + output_offset_ * batch * g);
+  }
+  if (bias) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
+        batch_spatial_dim, 1, (Dtype)1., bias, bias_multiplier_.cpu_data(),
+        (Dtype)1., output_batch);
+  }
+  for (int b = 0; b < batch; ++b) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          output_batch + batch_spatial_dim * c + conv_out_spatial_dim_ * b,
+          output + output_dim * b + conv_out_spatial_dim_ * c);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output_diff, const Dtype* weights, Dtype* weights_diff,
+    Dtype* input_diff, const int batch, const int thread) {
+  CHECK_LE(batch, batch_size_);
+  const int output_dim = conv_out_channels_ * conv_out_spatial_dim_;
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  Dtype* col_batch = col_batch_buffer(thread)->mutable_cpu_data();
+  Dtype* output_batch = output_batch_buffer(thread)->mutable_cpu_data();
+  for (int b = 0; b < batch; ++b) {
+    for (int c = 0; c < conv_out_channels_; ++c) {
+      caffe_copy(conv_out_spatial_dim_,
+          output_diff + output_dim * b + conv_out_spatial_dim_ * c,
+          output_batch + batch_spatial_dim * c + conv_out_spatial_dim_ * b);
+    }
+  }
+  // Gradient w.r.t. the weights, accumulated.
+  if (weights_diff) {
+    conv_im2col_cpu_batch(input, batch, col_batch, thread);
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
+          conv_out_channels_ / group_, kernel_dim_ / group_,
+          batch_spatial_dim,
+          (Dtype)1., output_batch + output_offset_ * batch * g,
+          col_batch + col_offset_ * batch * g,
+          (Dtype)1., weights_diff + weight_offset_ * g);
+    }
+  }
+  // Gradient w.r.t. the input.
+  if (input_diff) {
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_ / group_,
+          batch_spatial_dim, conv_out_channels_ / group_,
+          (Dtype)1., weights + weight_offset_ * g,
+          output_batch + output_offset_ * batch * g,
+          (Dtype)0., col_batch + col_offset_ * batch * g);
+    }
+    conv_col2im_cpu_batch(col_batch, batch, input_diff, thread);
+  }
+}
+
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::thread_weight_diff(const int thread) {
+  if (thread == 0) {
+    return this->blobs_[0]->mutable_cpu_diff();
+  }
+  return thread_buffers_[thread - 1].weight_diff->mutable_cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::zero_thread_weight_diffs() {
+  for (int t = 0; t < thread_buffers_.size(); ++t) {
+    Blob<Dtype>* weight_diff = thread_buffers_[t].weight_diff.get();
+    caffe_set(weight_diff->count(), Dtype(0),
+        weight_diff->mutable_cpu_data());
+  }
+}
+
+// The partial sums add up in the order of the threads, so that the gradient
+// does not depend on which thread finishes first.
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::reduce_thread_weight_diffs() {
+  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  for (int t = 0; t < thread_buffers_.size(); ++t) {
+    const Blob<Dtype>* thread_diff = thread_buffers_[t].weight_diff.get();
+    caffe_axpy(thread_diff->count(), Dtype(1), thread_diff->cpu_data(),
+        weight_diff);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -27,17 +28,31 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   DataLayerSetUp(bottom, top);
 }
 
+template <typename Dtype>
+BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
+    const LayerParameter& param)
+    : BaseDataLayer<Dtype>(param), prefetch_current_(NULL) {
+  const int prefetch_count = param.data_param().prefetch();
+  CHECK_GT(prefetch_count, 0) << "Need at least one batch to prefetch into.";
+  for (int i = 0; i < prefetch_count; ++i) {
+    prefetch_.push_back(shared_ptr<Batch<Dtype> >(new Batch<Dtype>()));
+    prefetch_free_.push(prefetch_[i].get());
+  }
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
-  // Now, start the prefetch thread. Before calling prefetch, we make two
-  // cpu_data calls so that the prefetch thread does not accidentally make
-  // simultaneous cudaMalloc calls when the main thread is running. In some
-  // GPUs this seems to cause failures if we do not so.
-  this->prefetch_data_.mutable_cpu_data();
-  if (this->output_labels_) {
-    this->prefetch_label_.mutable_cpu_data();
+  // Before starting the prefetch thread, we make cpu_data calls so that the
+  // prefetch thread does not accidentally make simultaneous cudaMalloc calls
+  // when the main thread is running. In some GPUs this seems to cause
+  // failures if we do not so.
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
+    if (this->output_labels_) {
+      prefetch_[i]->label_.mutable_cpu_data();
+    }
   }
 #ifdef USE_MPI
   //advance (my_rank) mini-batches to be ready for first run
@@ -56,37 +71,54 @@ void BasePrefetchingDataLayer<Dtype>::CreatePrefetchThread() {
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::JoinPrefetchThread() {
-  CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+  CHECK(StopInternalThread()) << "Thread joining failed";
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Batch<Dtype>* batch = prefetch_free_.pop();
+      load_batch(batch);
+#ifdef USE_MPI
+      //advance (all_rank - (my_rank+1)) mini-batches to be ready for next run
+      BaseDataLayer<Dtype>::OffsetCursor(
+          batch->data_.num() * (Caffe::MPI_all_rank() - 1));
+#endif
+      prefetch_full_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // First, join the thread
-  JoinPrefetchThread();
-  DLOG(INFO) << "Thread joined";
+  // With a single batch in the pool, the prefetch thread waits for the one
+  // the top blobs point to, so hand it back before waiting for the next.
+  // The top blobs are not read again until they point to the new batch.
+  if (prefetch_current_ && prefetch_.size() == 1) {
+    prefetch_free_.push(prefetch_current_);
+    prefetch_current_ = NULL;
+  }
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
   // Reshape to loaded data.
-  top[0]->ReshapeLike(prefetch_data_);
-  // Copy the data
-  caffe_copy(prefetch_data_.count(), prefetch_data_.cpu_data(),
-             top[0]->mutable_cpu_data());
-  DLOG(INFO) << "Prefetch copied";
+  top[0]->ReshapeLike(batch->data_);
+  // Point the top blobs at the prefetched batch instead of copying it. The
+  // batch is only handed back to the prefetch thread at the next Forward.
+  top[0]->set_cpu_data(batch->data_.mutable_cpu_data());
+  DLOG(INFO) << "Prefetch handed over";
   if (this->output_labels_) {
     // Reshape to loaded labels.
-    top[1]->ReshapeLike(prefetch_label_);
-    // Copy the labels.
-    caffe_copy(prefetch_label_.count(), prefetch_label_.cpu_data(),
-               top[1]->mutable_cpu_data());
+    top[1]->ReshapeLike(batch->label_);
+    top[1]->set_cpu_data(batch->label_.mutable_cpu_data());
   }
 
-#ifdef USE_MPI
-  //advance (all_rank - (my_rank+1)) mini-batches to be ready for next run
-  BaseDataLayer<Dtype>::OffsetCursor(top[0]->num() * (Caffe::MPI_all_rank() - 1));
-#endif
-
-  // Start a new prefetch thread
-  DLOG(INFO) << "CreatePrefetchThread";
-  CreatePrefetchThread();
+  if (prefetch_current_) {
+    prefetch_free_.push(prefetch_current_);
+  }
+  prefetch_current_ = batch;
 }
 
 #ifdef CPU_ONLY
@@ -1,3 +1,8 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -16,19 +21,43 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
       / this->stride_w_ + 1;
 }
 
+// The thread of the team running a loop over the images, below threads_.
+static inline int conv_thread_num() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// The CPU passes take the images in batches of batch_size_, split among
+// threads_ threads, each of which runs the helpers on its own buffers.
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  const int batches = (this->num_ + this->batch_size_ - 1) / this->batch_size_;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + bottom[i]->offset(n), weight,
-          top_data + top[i]->offset(n));
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(this->threads_) \
+    if (this->threads_ > 1)
+#endif
+    for (int b = 0; b < batches; ++b) {
+      const int thread = conv_thread_num();
+      const int n = b * this->batch_size_;
+      if (this->batch_size_ > 1) {
+        const int batch = std::min(this->batch_size_, this->num_ - n);
+        this->forward_cpu_gemm_batch(bottom_data + bottom[i]->offset(n),
+            weight, bias, top_data + top[i]->offset(n), batch, thread);
+      } else {
+        this->forward_cpu_gemm(bottom_data + bottom[i]->offset(n), weight,
+            top_data + top[i]->offset(n), false, thread);
+        if (this->bias_term_) {
+          this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
+        }
       }
     }
   }
@@ -38,7 +67,18 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int batches = (this->num_ + this->batch_size_ - 1) / this->batch_size_;
+  // Each thread accumulates the gradient w.r.t. the weights of its images
+  // apart; the partial sums add up once all the images are done. The static
+  // schedule of one batch per chunk deals the batches out round robin, so
+  // every thread sums the same images whatever the OpenMP runtime.
+  vector<Dtype*> weight_diffs(this->threads_, static_cast<Dtype*>(NULL));
+  if (this->param_propagate_down_[0]) {
+    this->zero_thread_weight_diffs();
+    for (int t = 0; t < this->threads_; ++t) {
+      weight_diffs[t] = this->thread_weight_diff(t);
+    }
+  }
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -50,21 +90,40 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + top[i]->offset(n));
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
+    if (!this->param_propagate_down_[0] && !propagate_down[i]) {
+      continue;
+    }
+    const bool input_diff = propagate_down[i];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(this->threads_) \
+    if (this->threads_ > 1)
+#endif
+    for (int b = 0; b < batches; ++b) {
+      const int thread = conv_thread_num();
+      const int n = b * this->batch_size_;
+      if (this->batch_size_ > 1) {
+        const int batch = std::min(this->batch_size_, this->num_ - n);
+        this->backward_cpu_gemm_batch(bottom_data + bottom[i]->offset(n),
+            top_diff + top[i]->offset(n), weight, weight_diffs[thread],
+            input_diff ? bottom_diff + bottom[i]->offset(n) : NULL, batch,
+            thread);
+      } else {
         // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
+        if (weight_diffs[thread]) {
           this->weight_cpu_gemm(bottom_data + bottom[i]->offset(n),
-              top_diff + top[i]->offset(n), weight_diff);
+              top_diff + top[i]->offset(n), weight_diffs[thread], thread);
         }
         // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
+        if (input_diff) {
           this->backward_cpu_gemm(top_diff + top[i]->offset(n), weight,
-              bottom_diff + bottom[i]->offset(n));
+              bottom_diff + bottom[i]->offset(n), thread);
         }
       }
     }
   }
+  if (this->param_propagate_down_[0]) {
+    this->reduce_thread_weight_diffs();
+  }
 }
 
 #ifdef CPU_ONLY
@@ -46,8 +46,7 @@ void GatherLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   if (Caffe::parallel_mode() == Caffe::MPI){
     for (int i = 0; i < bottom.size(); ++i) {
       //Gather the bottom to the top
-      caffe_iallgather((Dtype*)bottom[i]->cpu_data(),top[i]->mutable_cpu_data(), bottom[i]->count());
-      mpi_force_synchronize();
+      caffe_iallgather((Dtype*)bottom[i]->cpu_data(),top[i]->mutable_cpu_data(), bottom[i]->count()).Wait();
     }
   }
   #endif
@@ -62,8 +61,7 @@ void GatherLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       for (int i = 0; i < bottom.size(); ++i) {
         //Gather the bottom to the top
         if (propagate_down[i]) {
-          caffe_iscatter((Dtype*)top[i]->cpu_diff(),bottom[i]->mutable_cpu_diff(), bottom[i]->count());
-          mpi_force_synchronize();
+          caffe_iscatter((Dtype*)top[i]->cpu_diff(),bottom[i]->mutable_cpu_diff(), bottom[i]->count()).Wait();
           //compensate the scale on diff IMPORTANT
           caffe_scal(bottom[i]->count(), Dtype(Caffe::MPI_all_rank()),
                          bottom[i]->mutable_cpu_diff());
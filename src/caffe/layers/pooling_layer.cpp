@@ -1,3 +1,7 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
@@ -125,101 +129,450 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+// The shape of a pooled plane, one channel of one image.
+struct PoolingShape {
+  int height, width;
+  int pooled_height, pooled_width;
+  int kernel_h, kernel_w;
+  int stride_h, stride_w;
+  int pad_h, pad_w;
+};
+
+static PoolingShape MakePoolingShape(const int height, const int width,
+    const int pooled_height, const int pooled_width, const int kernel_h,
+    const int kernel_w, const int stride_h, const int stride_w,
+    const int pad_h, const int pad_w) {
+  PoolingShape shape;
+  shape.height = height;
+  shape.width = width;
+  shape.pooled_height = pooled_height;
+  shape.pooled_width = pooled_width;
+  shape.kernel_h = kernel_h;
+  shape.kernel_w = kernel_w;
+  shape.stride_h = stride_h;
+  shape.stride_w = stride_w;
+  shape.pad_h = pad_h;
+  shape.pad_w = pad_w;
+  return shape;
+}
+
+// Whether the pooling is square with the given kernel and stride and without
+// padding, the shapes with fixed kernels below.
+static inline bool IsFixedPooling(const PoolingShape& shape, const int kernel,
+    const int stride) {
+  return shape.kernel_h == kernel && shape.kernel_w == kernel &&
+      shape.stride_h == stride && shape.stride_w == stride &&
+      shape.pad_h == 0 && shape.pad_w == 0;
+}
+
+// The number of leading outputs along a side whose windows lie inside the
+// image, for a fixed kernel without padding; 0 for the generic kernels,
+// whose windows are all clipped.
+static inline int FullWindows(const int size, const int kernel,
+    const int stride, const int pooled_size) {
+  if (kernel == 0 || size < kernel) {
+    return 0;
+  }
+  return min(pooled_size, (size - kernel) / stride + 1);
+}
+
+// The window of output (ph, pw) clipped to the image, and for average
+// pooling the size of the window clipped to the padded image only.
+static inline void PoolingWindow(const PoolingShape& shape, const int ph,
+    const int pw, int* hstart, int* hend, int* wstart, int* wend,
+    int* pool_size) {
+  *hstart = ph * shape.stride_h - shape.pad_h;
+  *wstart = pw * shape.stride_w - shape.pad_w;
+  *hend = min(*hstart + shape.kernel_h, shape.height + shape.pad_h);
+  *wend = min(*wstart + shape.kernel_w, shape.width + shape.pad_w);
+  *pool_size = (*hend - *hstart) * (*wend - *wstart);
+  *hstart = max(*hstart, 0);
+  *wstart = max(*wstart, 0);
+  *hend = min(*hend, shape.height);
+  *wend = min(*wend, shape.width);
+}
+
+// Max pools the window [hstart, hend) x [wstart, wend) of a plane. Ties keep
+// the first maximum in row-major order, and a window with nothing above
+// -FLT_MAX gets the index -1.
+template <typename Dtype, typename Mask>
+static inline void MaxPoolWindow(const Dtype* bottom, const int width,
+    const int hstart, const int hend, const int wstart, const int wend,
+    Dtype* top, Mask* mask) {
+  Dtype value = -FLT_MAX;
+  int max_index = -1;
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      const int index = h * width + w;
+      if (bottom[index] > value) {
+        value = bottom[index];
+        max_index = index;
+      }
+    }
+  }
+  *top = value;
+  *mask = static_cast<Mask>(max_index);
+}
+
+// Average pools the window [hstart, hend) x [wstart, wend) of a plane,
+// summing in row-major order.
+template <typename Dtype>
+static inline Dtype AvePoolWindow(const Dtype* bottom, const int width,
+    const int hstart, const int hend, const int wstart, const int wend,
+    const int pool_size) {
+  Dtype sum = 0;
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      sum += bottom[h * width + w];
+    }
+  }
+  return sum / pool_size;
+}
+
+// The row kernels pool the outputs [pw, pooled_width) of output row ph,
+// whose kKernel x kKernel windows at stride kStride all lie inside the
+// image. The compile time kernel and stride unroll the windows.
+template <typename Dtype, typename Mask, int kKernel, int kStride>
+static inline void MaxPoolRowScalar(const Dtype* bottom, const int width,
+    const int ph, int pw, const int pooled_width, Dtype* top, Mask* mask) {
+  for (; pw < pooled_width; ++pw) {
+    MaxPoolWindow(bottom, width, ph * kStride, ph * kStride + kKernel,
+        pw * kStride, pw * kStride + kKernel, top + pw, mask + pw);
+  }
+}
+
+template <typename Dtype, int kKernel, int kStride>
+static inline void AvePoolRowScalar(const Dtype* bottom, const int width,
+    const int ph, int pw, const int pooled_width, Dtype* top) {
+  for (; pw < pooled_width; ++pw) {
+    top[pw] = AvePoolWindow(bottom, width, ph * kStride,
+        ph * kStride + kKernel, pw * kStride, pw * kStride + kKernel,
+        kKernel * kKernel);
+  }
+}
+
+template <typename Dtype, typename Mask, int kKernel, int kStride>
+struct PoolRow {
+  static void Max(const Dtype* bottom, const int width, const int ph,
+      const int pooled_width, Dtype* top, Mask* mask) {
+    MaxPoolRowScalar<Dtype, Mask, kKernel, kStride>(bottom, width, ph, 0,
+        pooled_width, top, mask);
+  }
+  static void Ave(const Dtype* bottom, const int width, const int ph,
+      const int pooled_width, Dtype* top) {
+    AvePoolRowScalar<Dtype, kKernel, kStride>(bottom, width, ph, 0,
+        pooled_width, top);
+  }
+};
+
+#ifdef __SSE2__
+// Loads the columns of the windows of four neighbouring outputs at stride 2,
+// from the input row at the column of the first window: x[kw] holds column
+// kw of each window.
+template <int kKernel>
+static inline void LoadStride2Columns(const float* row, __m128 x[kKernel]);
+
+template <>
+inline void LoadStride2Columns<2>(const float* row, __m128 x[2]) {
+  const __m128 a = _mm_loadu_ps(row);
+  const __m128 b = _mm_loadu_ps(row + 4);
+  x[0] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+  x[1] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// Column 2 of the windows is column 0 shifted by one window; the last one
+// loads a single float so as not to read past the windows.
+template <>
+inline void LoadStride2Columns<3>(const float* row, __m128 x[3]) {
+  const __m128 a = _mm_loadu_ps(row);
+  const __m128 b = _mm_loadu_ps(row + 4);
+  const __m128 c = _mm_load_ss(row + 8);
+  x[0] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+  x[1] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+  const __m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 2, 0));
+  x[2] = _mm_shuffle_ps(x[0], t, _MM_SHUFFLE(2, 1, 2, 1));
+}
+
+static inline void StoreMask(int* mask, const __m128i index) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(mask), index);
+}
+
+static inline void StoreMask(float* mask, const __m128i index) {
+  _mm_storeu_ps(mask, _mm_cvtepi32_ps(index));
+}
+
+// The float kernels at stride 2 pool four outputs at a time, one per lane,
+// with the same comparisons and sums in the same order as the scalar ones,
+// so the results and the mask are identical.
+template <typename Mask, int kKernel>
+struct PoolRow<float, Mask, kKernel, 2> {
+  static void Max(const float* bottom, const int width, const int ph,
+      const int pooled_width, float* top, Mask* mask) {
+    const __m128i lanes = _mm_set_epi32(6, 4, 2, 0);
+    int pw = 0;
+    for (; pw + 4 <= pooled_width; pw += 4) {
+      __m128 value = _mm_set1_ps(-FLT_MAX);
+      __m128i max_index = _mm_set1_epi32(-1);
+      for (int kh = 0; kh < kKernel; ++kh) {
+        const int row_index = (ph * 2 + kh) * width + pw * 2;
+        __m128 x[kKernel];
+        LoadStride2Columns<kKernel>(bottom + row_index, x);
+        for (int kw = 0; kw < kKernel; ++kw) {
+          const __m128 greater = _mm_cmpgt_ps(x[kw], value);
+          const __m128i greater_index = _mm_castps_si128(greater);
+          const __m128i index =
+              _mm_add_epi32(lanes, _mm_set1_epi32(row_index + kw));
+          value = _mm_or_ps(_mm_and_ps(greater, x[kw]),
+              _mm_andnot_ps(greater, value));
+          max_index = _mm_or_si128(_mm_and_si128(greater_index, index),
+              _mm_andnot_si128(greater_index, max_index));
+        }
+      }
+      _mm_storeu_ps(top + pw, value);
+      StoreMask(mask + pw, max_index);
+    }
+    MaxPoolRowScalar<float, Mask, kKernel, 2>(bottom, width, ph, pw,
+        pooled_width, top, mask);
+  }
+  static void Ave(const float* bottom, const int width, const int ph,
+      const int pooled_width, float* top) {
+    const __m128 pool_size = _mm_set1_ps(kKernel * kKernel);
+    int pw = 0;
+    for (; pw + 4 <= pooled_width; pw += 4) {
+      __m128 sum = _mm_setzero_ps();
+      for (int kh = 0; kh < kKernel; ++kh) {
+        __m128 x[kKernel];
+        LoadStride2Columns<kKernel>(
+            bottom + (ph * 2 + kh) * width + pw * 2, x);
+        for (int kw = 0; kw < kKernel; ++kw) {
+          sum = _mm_add_ps(sum, x[kw]);
+        }
+      }
+      _mm_storeu_ps(top + pw, _mm_div_ps(sum, pool_size));
+    }
+    AvePoolRowScalar<float, kKernel, 2>(bottom, width, ph, pw, pooled_width,
+        top);
+  }
+};
+#endif  // __SSE2__
+
+// Pools a plane with a kKernel x kKernel kernel at stride kStride, without
+// padding, or with any shape when kKernel is 0. The outputs whose windows
+// lie inside the image go through the row kernels, and those clipped by the
+// bottom and right edges through the generic loops.
+template <typename Dtype, typename Mask, int kKernel, int kStride>
+static void MaxPoolPlane(const Dtype* bottom, const PoolingShape& shape,
+    Dtype* top, Mask* mask) {
+  const int full_height = FullWindows(shape.height, kKernel, kStride,
+      shape.pooled_height);
+  const int full_width = FullWindows(shape.width, kKernel, kStride,
+      shape.pooled_width);
+  for (int ph = 0; ph < shape.pooled_height; ++ph) {
+    Dtype* top_row = top + ph * shape.pooled_width;
+    Mask* mask_row = mask + ph * shape.pooled_width;
+    int pw = 0;
+    if (ph < full_height) {
+      PoolRow<Dtype, Mask, kKernel, kStride>::Max(bottom, shape.width, ph,
+          full_width, top_row, mask_row);
+      pw = full_width;
+    }
+    for (; pw < shape.pooled_width; ++pw) {
+      int hstart, hend, wstart, wend, pool_size;
+      PoolingWindow(shape, ph, pw, &hstart, &hend, &wstart, &wend,
+          &pool_size);
+      MaxPoolWindow(bottom, shape.width, hstart, hend, wstart, wend,
+          top_row + pw, mask_row + pw);
+    }
+  }
+}
+
+template <typename Dtype, int kKernel, int kStride>
+static void AvePoolPlane(const Dtype* bottom, const PoolingShape& shape,
+    Dtype* top) {
+  const int full_height = FullWindows(shape.height, kKernel, kStride,
+      shape.pooled_height);
+  const int full_width = FullWindows(shape.width, kKernel, kStride,
+      shape.pooled_width);
+  for (int ph = 0; ph < shape.pooled_height; ++ph) {
+    Dtype* top_row = top + ph * shape.pooled_width;
+    int pw = 0;
+    if (ph < full_height) {
+      PoolRow<Dtype, int, kKernel, kStride>::Ave(bottom, shape.width, ph,
+          full_width, top_row);
+      pw = full_width;
+    }
+    for (; pw < shape.pooled_width; ++pw) {
+      int hstart, hend, wstart, wend, pool_size;
+      PoolingWindow(shape, ph, pw, &hstart, &hend, &wstart, &wend,
+          &pool_size);
+      top_row[pw] = AvePoolWindow(bottom, shape.width, hstart, hend, wstart,
+          wend, pool_size);
+    }
+  }
+}
+
+// Scatters the gradient of each output of a plane to its window, in the
+// order of the outputs, so overlapping windows add up as in the forward
+// order.
+template <typename Dtype, int kKernel, int kStride>
+static void AveUnpoolPlane(const Dtype* top_diff, const PoolingShape& shape,
+    Dtype* bottom_diff) {
+  const int full_height = FullWindows(shape.height, kKernel, kStride,
+      shape.pooled_height);
+  const int full_width = FullWindows(shape.width, kKernel, kStride,
+      shape.pooled_width);
+  for (int ph = 0; ph < shape.pooled_height; ++ph) {
+    const Dtype* top_row = top_diff + ph * shape.pooled_width;
+    int pw = 0;
+    if (ph < full_height) {
+      for (; pw < full_width; ++pw) {
+        const Dtype diff = top_row[pw] / (kKernel * kKernel);
+        Dtype* window = bottom_diff + ph * kStride * shape.width +
+            pw * kStride;
+        for (int kh = 0; kh < kKernel; ++kh) {
+          for (int kw = 0; kw < kKernel; ++kw) {
+            window[kh * shape.width + kw] += diff;
+          }
+        }
+      }
+    }
+    for (; pw < shape.pooled_width; ++pw) {
+      int hstart, hend, wstart, wend, pool_size;
+      PoolingWindow(shape, ph, pw, &hstart, &hend, &wstart, &wend,
+          &pool_size);
+      const Dtype diff = top_row[pw] / pool_size;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          bottom_diff[h * shape.width + w] += diff;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype, typename Mask>
+static void MaxUnpoolPlane(const Dtype* top_diff, const Mask* mask,
+    const PoolingShape& shape, Dtype* bottom_diff) {
+  const int pooled_count = shape.pooled_height * shape.pooled_width;
+  for (int i = 0; i < pooled_count; ++i) {
+    bottom_diff[static_cast<int>(mask[i])] += top_diff[i];
+  }
+}
+
+// The planes are independent, so the CPU passes split them among the
+// threads of Caffe::cpu_threads().
+static inline int PoolingThreads(const int planes) {
+#ifdef _OPENMP
+  return min(Caffe::cpu_threads(), planes);
+#else
+  return 1;
+#endif
+}
+
+template <typename Dtype, typename Mask>
+static void MaxPoolForward(const Dtype* bottom_data, const int planes,
+    const PoolingShape& shape, Dtype* top_data, Mask* mask) {
+  void (*pool_plane)(const Dtype*, const PoolingShape&, Dtype*, Mask*) =
+      &MaxPoolPlane<Dtype, Mask, 0, 0>;
+  if (IsFixedPooling(shape, 2, 2)) {
+    pool_plane = &MaxPoolPlane<Dtype, Mask, 2, 2>;
+  } else if (IsFixedPooling(shape, 3, 2)) {
+    pool_plane = &MaxPoolPlane<Dtype, Mask, 3, 2>;
+  }
+  const int dim = shape.height * shape.width;
+  const int pooled_dim = shape.pooled_height * shape.pooled_width;
+  const int threads = PoolingThreads(planes);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if (threads > 1)
+#endif
+  for (int p = 0; p < planes; ++p) {
+    pool_plane(bottom_data + p * dim, shape, top_data + p * pooled_dim,
+        mask + p * pooled_dim);
+  }
+}
+
+template <typename Dtype, typename Mask>
+static void MaxPoolBackward(const Dtype* top_diff, const Mask* mask,
+    const int planes, const PoolingShape& shape, Dtype* bottom_diff) {
+  const int dim = shape.height * shape.width;
+  const int pooled_dim = shape.pooled_height * shape.pooled_width;
+  const int threads = PoolingThreads(planes);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if (threads > 1)
+#endif
+  for (int p = 0; p < planes; ++p) {
+    MaxUnpoolPlane(top_diff + p * pooled_dim, mask + p * pooled_dim, shape,
+        bottom_diff + p * dim);
+  }
+}
+
+template <typename Dtype>
+static void AvePoolForward(const Dtype* bottom_data, const int planes,
+    const PoolingShape& shape, Dtype* top_data) {
+  void (*pool_plane)(const Dtype*, const PoolingShape&, Dtype*) =
+      &AvePoolPlane<Dtype, 0, 0>;
+  if (IsFixedPooling(shape, 2, 2)) {
+    pool_plane = &AvePoolPlane<Dtype, 2, 2>;
+  } else if (IsFixedPooling(shape, 3, 2)) {
+    pool_plane = &AvePoolPlane<Dtype, 3, 2>;
+  }
+  const int dim = shape.height * shape.width;
+  const int pooled_dim = shape.pooled_height * shape.pooled_width;
+  const int threads = PoolingThreads(planes);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if (threads > 1)
+#endif
+  for (int p = 0; p < planes; ++p) {
+    pool_plane(bottom_data + p * dim, shape, top_data + p * pooled_dim);
+  }
+}
+
+template <typename Dtype>
+static void AvePoolBackward(const Dtype* top_diff, const int planes,
+    const PoolingShape& shape, Dtype* bottom_diff) {
+  void (*unpool_plane)(const Dtype*, const PoolingShape&, Dtype*) =
+      &AveUnpoolPlane<Dtype, 0, 0>;
+  if (IsFixedPooling(shape, 2, 2)) {
+    unpool_plane = &AveUnpoolPlane<Dtype, 2, 2>;
+  } else if (IsFixedPooling(shape, 3, 2)) {
+    unpool_plane = &AveUnpoolPlane<Dtype, 3, 2>;
+  }
+  const int dim = shape.height * shape.width;
+  const int pooled_dim = shape.pooled_height * shape.pooled_width;
+  const int threads = PoolingThreads(planes);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) if (threads > 1)
+#endif
+  for (int p = 0; p < planes; ++p) {
+    unpool_plane(top_diff + p * pooled_dim, shape, bottom_diff + p * dim);
+  }
+}
+
+// The CPU passes pool each channel of each image as a plane; the square 2x2
+// and 3x3 kernels at stride 2 without padding take the fixed kernels.
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  const int planes = bottom[0]->num() * channels_;
+  const PoolingShape shape = MakePoolingShape(height_, width_,
+      pooled_height_, pooled_width_, kernel_h_, kernel_w_, stride_h_,
+      stride_w_, pad_h_, pad_w_);
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitalized variables
-  Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
-      top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
+      MaxPoolForward(bottom_data, planes, shape, top_data,
+          top[1]->mutable_cpu_data());
     } else {
-      mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
+      MaxPoolForward(bottom_data, planes, shape, top_data,
+          max_idx_.mutable_cpu_data());
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    AvePoolForward(bottom_data, planes, shape, top_data);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
@@ -237,69 +590,25 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
+  const int planes = bottom[0]->num() * channels_;
+  const PoolingShape shape = MakePoolingShape(height_, width_,
+      pooled_height_, pooled_width_, kernel_h_, kernel_w_, stride_h_,
+      stride_w_, pad_h_, pad_w_);
   caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
-  const int* mask = NULL;  // suppress warnings about uninitialized variables
-  const Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // The main loop
     if (use_top_mask) {
-      top_mask = top[1]->cpu_data();
+      MaxPoolBackward(top_diff, top[1]->cpu_data(), planes, shape,
+          bottom_diff);
     } else {
-      mask = max_idx_.cpu_data();
-    }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
+      MaxPoolBackward(top_diff, max_idx_.cpu_data(), planes, shape,
+          bottom_diff);
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
-            }
-          }
-        }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-      }
-    }
+    AvePoolBackward(top_diff, planes, shape, bottom_diff);
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
     NOT_IMPLEMENTED;
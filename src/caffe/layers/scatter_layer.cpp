@@ -42,32 +42,38 @@ template <typename Dtype>
 void ScatterLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
 #ifdef USE_MPI
-
-  for (int i = 0; i < bottom.size(); ++i) {
-    //Gather the bottom to the top
-    caffe_iscatter((Dtype*)bottom[i]->cpu_data(),top[i]->mutable_cpu_data(), top[i]->count());
-    mpi_force_synchronize();
+  if (Caffe::parallel_mode() == Caffe::MPI){
+    for (int i = 0; i < bottom.size(); ++i) {
+      //Scatter the bottom to the top
+      caffe_iscatter((Dtype*)bottom[i]->cpu_data(),top[i]->mutable_cpu_data(), top[i]->count()).Wait();
+    }
   }
-#else
 #endif
+  //Do nothing if not in MPI mode
 }
 
 template <typename Dtype>
 void ScatterLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
 #ifdef USE_MPI
-
-  for (int i = 0; i < bottom.size(); ++i) {
-    caffe_iallgather((Dtype*)top[i]->cpu_diff(),bottom[i]->mutable_cpu_diff(), top[i]->count());
-    mpi_force_synchronize();
-    //compensate the scale on diff IMPORTANT
-    caffe_scal(bottom[i]->count(), Dtype(1)/Dtype(Caffe::MPI_all_rank()),
-               bottom[i]->mutable_cpu_diff());
+  if (Caffe::parallel_mode() == Caffe::MPI){
+    for (int i = 0; i < bottom.size(); ++i) {
+      //Scatter the top diff to buttom
+      if (propagate_down[i]) {
+        caffe_iallgather((Dtype*)top[i]->cpu_diff(),bottom[i]->mutable_cpu_diff(), top[i]->count()).Wait();
+        //compensate the scale on diff IMPORTANT
+        caffe_scal(bottom[i]->count(), Dtype(1)/Dtype(Caffe::MPI_all_rank()),
+                   bottom[i]->mutable_cpu_diff());
+      }
+    }
   }
-#else
 #endif
 }
 
+#ifdef CPU_ONLY
+STUB_GPU(ScatterLayer);
+#endif
+
 INSTANTIATE_CLASS(ScatterLayer);
 REGISTER_LAYER_CLASS(Scatter);
 
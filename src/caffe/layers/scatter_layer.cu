@@ -16,8 +16,7 @@ const vector<Blob<Dtype>*>& top) {
     CUDA_CHECK(cudaDeviceSynchronize());
     for (int i = 0; i < bottom.size(); ++i) {
       //Gather the bottom to the top
-      caffe_iscatter((Dtype*)bottom[i]->gpu_data(),top[i]->mutable_gpu_data(), top[i]->count());
-      mpi_force_synchronize();
+      caffe_iscatter((Dtype*)bottom[i]->gpu_data(),top[i]->mutable_gpu_data(), top[i]->count()).Wait();
     }
   }
   #endif
@@ -33,8 +32,7 @@ const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
       for (int i = 0; i < bottom.size(); ++i) {
           //Scatter the top diff to buttom
           if (propagate_down[i]) {
-          caffe_iallgather((Dtype*)top[i]->gpu_diff(),bottom[i]->mutable_gpu_diff(), top[i]->count());
-          mpi_force_synchronize();
+          caffe_iallgather((Dtype*)top[i]->gpu_diff(),bottom[i]->mutable_gpu_diff(), top[i]->count()).Wait();
           //compensate the scale on diff IMPORTANT
           caffe_gpu_scal(bottom[i]->count(), Dtype(1)/Dtype(Caffe::MPI_all_rank()),
                          bottom[i]->mutable_gpu_diff());
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -7,6 +9,7 @@
 #include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/frame_pack.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -25,8 +28,6 @@ VideoDataLayer<Dtype>:: ~VideoDataLayer<Dtype>(){
 
 template <typename Dtype>
 void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top){
-	const int new_height  = this->layer_param_.video_data_param().new_height();
-	const int new_width  = this->layer_param_.video_data_param().new_width();
 	const int new_length  = this->layer_param_.video_data_param().new_length();
 	const int num_segments = this->layer_param_.video_data_param().num_segments();
 	const string& source = this->layer_param_.video_data_param().source();
@@ -50,7 +51,17 @@ void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 	LOG(INFO) << "A total of " << lines_.size() << " videos.";
 	lines_id_ = 0;
 
-	Datum datum;
+	const VideoDataParameter& video_data_param = this->layer_param_.video_data_param();
+	if (video_data_param.frame_cache_mb() > 0){
+		// Shared slots have room for a color frame of the output size.
+		frame_cache_ = FrameCache::Global(size_t(video_data_param.frame_cache_mb()) * 1024 * 1024,
+				video_data_param.frame_cache_shared(), size_t(video_data_param.new_height()) * video_data_param.new_width() * 3);
+	}
+
+	if (video_data_param.frame_storage() == VideoDataParameter_FrameStorage_PACK)
+		frame_packs_.reset(new FramePackCache(video_data_param.open_frame_packs()));
+
+	vector<cv::Mat> frames;
 	const unsigned int frame_prefectch_rng_seed = caffe_rng_rand();
 	frame_prefetch_rng_.reset(new Caffe::RNG(frame_prefectch_rng_seed));
 	int average_duration = (int) lines_duration_[lines_id_]/num_segments;
@@ -60,26 +71,23 @@ void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 		int offset = (*frame_rng)() % (average_duration - new_length + 1);
 		offsets.push_back(offset+i*average_duration);
 	}
-	if (this->layer_param_.video_data_param().modality() == VideoDataParameter_Modality_FLOW)
-		CHECK(ReadSegmentFlowToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum));
-	else
-		CHECK(ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true));
-	const int crop_size = this->layer_param_.transform_param().crop_size();
+	CHECK(ReadVideoToFrames(lines_[lines_id_].first, offsets, &frames));
 	const int batch_size = this->layer_param_.video_data_param().batch_size();
-	if (crop_size > 0){
-		top[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
-		this->prefetch_data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
-	} else {
-		top[0]->Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-		this->prefetch_data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-	}
+	vector<int> top_shape = this->data_transformer_->InferFramesBlobShape(frames);
+	this->transformed_data_.Reshape(top_shape);
+	top_shape[0] = batch_size;
+	top[0]->Reshape(top_shape);
+	for (int i = 0; i < this->prefetch_.size(); ++i)
+		this->prefetch_[i]->data_.Reshape(top_shape);
 	LOG(INFO) << "output data size: " << top[0]->num() << "," << top[0]->channels() << "," << top[0]->height() << "," << top[0]->width();
 
 	top[1]->Reshape(batch_size, 1, 1, 1);
-	this->prefetch_label_.Reshape(batch_size, 1, 1, 1);
+	for (int i = 0; i < this->prefetch_.size(); ++i)
+		this->prefetch_[i]->label_.Reshape(batch_size, 1, 1, 1);
 
-	vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-	this->transformed_data_.Reshape(top_shape);
+	decode_pool_.reset(new DecodePool<Dtype>(this->transform_param_, this->phase_,
+			this->layer_param_.video_data_param().num_decode_threads()));
+	LOG(INFO) << "Decoding with " << decode_pool_->num_threads() << " thread(s).";
 }
 
 template <typename Dtype>
@@ -91,23 +99,24 @@ void VideoDataLayer<Dtype>::ShuffleVideos(){
 }
 
 template <typename Dtype>
-void VideoDataLayer<Dtype>::InternalThreadEntry(){
+void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch){
 
-	Datum datum;
-	CHECK(this->prefetch_data_.count());
-	Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
-	Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
+	CHECK(batch->data_.count());
+	Dtype* top_label = batch->label_.mutable_cpu_data();
 	VideoDataParameter video_data_param = this->layer_param_.video_data_param();
 	const int batch_size = video_data_param.batch_size();
-	const int new_height = video_data_param.new_height();
-	const int new_width = video_data_param.new_width();
 	const int new_length = video_data_param.new_length();
 	const int num_segments = video_data_param.num_segments();
 	const int lines_size = lines_.size();
 
+	// Pick the videos and the segment offsets of the whole batch up front, so
+	// the decode workers never touch lines_ or the shared RNGs.
+	batch_lines_.resize(batch_size);
+	batch_offsets_.resize(batch_size);
 	for (int item_id = 0; item_id < batch_size; ++item_id){
 		CHECK_GT(lines_size, lines_id_);
-		vector<int> offsets;
+		vector<int>& offsets = batch_offsets_[item_id];
+		offsets.clear();
 		int average_duration = (int) lines_duration_[lines_id_] / num_segments;
 		for (int i = 0; i < num_segments; ++i){
 			if (this->phase_==TRAIN){
@@ -118,31 +127,58 @@ void VideoDataLayer<Dtype>::InternalThreadEntry(){
 				offsets.push_back(int((average_duration-new_length+1)/2 + i*average_duration));
 			}
 		}
-		if (this->layer_param_.video_data_param().modality() == VideoDataParameter_Modality_FLOW){
-			if(!ReadSegmentFlowToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum)) {
-				continue;
-			}
-		} else{
-			if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true)) {
-				continue;
-			}
-		}
-		int offset1 = this->prefetch_data_.offset(item_id);
-    	this->transformed_data_.set_cpu_data(top_data + offset1);
-		this->data_transformer_->Transform(datum, &(this->transformed_data_));
-		top_label[item_id] = lines_[lines_id_].second;
-		//LOG()
+		batch_lines_[item_id] = lines_[lines_id_];
 
 		//next iteration
 		lines_id_++;
 		if (lines_id_ >= lines_size) {
 			DLOG(INFO) << "Restarting data prefetching from start.";
+			if (frame_cache_)
+				LOG(INFO) << "Frame cache: " << frame_cache_->num_frames() << " frames, "
+					<< frame_cache_->size_bytes() / (1024 * 1024) << " MB, hit rate " << frame_cache_->hit_rate();
 			lines_id_ = 0;
 			if(this->layer_param_.video_data_param().shuffle()){
 				ShuffleVideos();
 			}
 		}
 	}
+
+	decode_pool_->Run(boost::bind(&VideoDataLayer<Dtype>::ReadBatchItem, this, top_label, _1, _2), &(batch->data_));
+}
+
+template <typename Dtype>
+bool VideoDataLayer<Dtype>::ReadBatchItem(Dtype* top_label, int item_id, vector<cv::Mat>* frames){
+	const std::pair<string, int>& line = batch_lines_[item_id];
+	if (!ReadVideoToFrames(line.first, batch_offsets_[item_id], frames)) {
+		return false;
+	}
+	top_label[item_id] = line.second;
+	return true;
+}
+
+template <typename Dtype>
+bool VideoDataLayer<Dtype>::ReadVideoToFrames(const string& filename, const vector<int>& offsets, vector<cv::Mat>* frames){
+	const VideoDataParameter& video_data_param = this->layer_param_.video_data_param();
+	const int new_height = video_data_param.new_height();
+	const int new_width = video_data_param.new_width();
+	const int new_length = video_data_param.new_length();
+	const bool is_flow = video_data_param.modality() == VideoDataParameter_Modality_FLOW;
+	const bool reduced_decode = video_data_param.reduced_decode();
+
+	if (video_data_param.frame_storage() == VideoDataParameter_FrameStorage_PACK){
+		const shared_ptr<const FramePack> pack = frame_packs_->Open(filename);
+		if (!pack) {
+			return false;
+		}
+		if (is_flow)
+			return ReadSegmentFlowToFrames(*pack, offsets, new_height, new_width, new_length, frames, reduced_decode, frame_cache_.get());
+		else
+			return ReadSegmentRGBToFrames(*pack, offsets, new_height, new_width, new_length, frames, true, reduced_decode, frame_cache_.get());
+	}
+	if (is_flow)
+		return ReadSegmentFlowToFrames(filename, offsets, new_height, new_width, new_length, frames, reduced_decode, frame_cache_.get());
+	else
+		return ReadSegmentRGBToFrames(filename, offsets, new_height, new_width, new_length, frames, true, reduced_decode, frame_cache_.get());
 }
 
 INSTANTIATE_CLASS(VideoDataLayer);
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -53,7 +55,14 @@ void VideoDataKDRFLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bott
 	LOG(INFO) << "A total of " << lines_.size() << " videos.";
 	lines_id_ = 0;
 
-	Datum datum;
+	const VideoDataKDRFParameter& video_data_kdrf_param = this->layer_param_.video_data_kdrf_param();
+	if (video_data_kdrf_param.frame_cache_mb() > 0){
+		// Shared slots have room for a color frame of the output size.
+		frame_cache_ = FrameCache::Global(size_t(video_data_kdrf_param.frame_cache_mb()) * 1024 * 1024,
+				video_data_kdrf_param.frame_cache_shared(), size_t(video_data_kdrf_param.new_height()) * video_data_kdrf_param.new_width() * 3);
+	}
+
+	vector<cv::Mat> frames;
 	const unsigned int frame_prefectch_rng_seed = caffe_rng_rand();
 	frame_prefetch_rng_.reset(new Caffe::RNG(frame_prefectch_rng_seed));
 	int average_duration = (int) lines_duration_[lines_id_]/num_segments;
@@ -64,27 +73,27 @@ void VideoDataKDRFLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bott
 		offsets.push_back(offset+i*average_duration);
 	}
 	if (this->layer_param_.video_data_kdrf_param().modality() == VideoDataKDRFParameter_Modality_FLOW)
-		CHECK(ReadSegmentFlowToDatum_KDRF(lines_[lines_id_].first, lines_dir_[lines_id_].first, lines_dir_[lines_id_].second, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum));
+		CHECK(ReadSegmentFlowToFrames_KDRF(lines_[lines_id_].first, lines_dir_[lines_id_].first, lines_dir_[lines_id_].second, offsets, new_height, new_width, new_length, &frames,
+				this->layer_param_.video_data_kdrf_param().reduced_decode(), frame_cache_.get()));
 	else
-		CHECK(ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true));
-	const int crop_size = this->layer_param_.transform_param().crop_size();
+		CHECK(ReadSegmentRGBToFrames(lines_[lines_id_].first, offsets, new_height, new_width, new_length, &frames, true,
+				this->layer_param_.video_data_kdrf_param().reduced_decode(), frame_cache_.get()));
 	const int batch_size = this->layer_param_.video_data_kdrf_param().batch_size();
-	if (crop_size > 0){
-		top[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
-		this->prefetch_data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
-	} else {
-		top[0]->Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-		this->prefetch_data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-	}
+	vector<int> top_shape = this->data_transformer_->InferFramesBlobShape(frames);
+	this->transformed_data_.Reshape(top_shape);
+	top_shape[0] = batch_size;
+	top[0]->Reshape(top_shape);
+	for (int i = 0; i < this->prefetch_.size(); ++i)
+		this->prefetch_[i]->data_.Reshape(top_shape);
 	LOG(INFO) << "output data size: " << top[0]->num() << "," << top[0]->channels() << "," << top[0]->height() << "," << top[0]->width();
 
 	top[1]->Reshape(batch_size, 1, 1, 1);
-	this->prefetch_label_.Reshape(batch_size, 1, 1, 1);
+	for (int i = 0; i < this->prefetch_.size(); ++i)
+		this->prefetch_[i]->label_.Reshape(batch_size, 1, 1, 1);
 
-    LOG(INFO) << "Hi there";
-	vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-    LOG(INFO) << "Hi There two";
-	this->transformed_data_.Reshape(top_shape);
+	decode_pool_.reset(new DecodePool<Dtype>(this->transform_param_, this->phase_,
+			this->layer_param_.video_data_kdrf_param().num_decode_threads()));
+	LOG(INFO) << "Decoding with " << decode_pool_->num_threads() << " thread(s).";
 }
 
 template <typename Dtype>
@@ -96,23 +105,25 @@ void VideoDataKDRFLayer<Dtype>::ShuffleVideos(){
 }
 
 template <typename Dtype>
-void VideoDataKDRFLayer<Dtype>::InternalThreadEntry(){
+void VideoDataKDRFLayer<Dtype>::load_batch(Batch<Dtype>* batch){
 
-	Datum datum;
-	CHECK(this->prefetch_data_.count());
-	Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
-	Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
+	CHECK(batch->data_.count());
+	Dtype* top_label = batch->label_.mutable_cpu_data();
 	VideoDataKDRFParameter video_data_kdrf_param = this->layer_param_.video_data_kdrf_param();
 	const int batch_size = video_data_kdrf_param.batch_size();
-	const int new_height = video_data_kdrf_param.new_height();
-	const int new_width = video_data_kdrf_param.new_width();
 	const int new_length = video_data_kdrf_param.new_length();
 	const int num_segments = video_data_kdrf_param.num_segments();
 	const int lines_size = lines_.size();
 
+	// Pick the videos and the segment offsets of the whole batch up front, so
+	// the decode workers never touch lines_ or the shared RNGs.
+	batch_lines_.resize(batch_size);
+	batch_dirs_.resize(batch_size);
+	batch_offsets_.resize(batch_size);
 	for (int item_id = 0; item_id < batch_size; ++item_id){
 		CHECK_GT(lines_size, lines_id_);
-		vector<int> offsets;
+		vector<int>& offsets = batch_offsets_[item_id];
+		offsets.clear();
 		int average_duration = (int) lines_duration_[lines_id_] / num_segments;
 		for (int i = 0; i < num_segments; ++i){
 			if (this->phase_==TRAIN){
@@ -123,31 +134,45 @@ void VideoDataKDRFLayer<Dtype>::InternalThreadEntry(){
 				offsets.push_back(int((average_duration-new_length+1)/2 + i*average_duration));
 			}
 		}
-		if (this->layer_param_.video_data_kdrf_param().modality() == VideoDataKDRFParameter_Modality_FLOW){
-			if(!ReadSegmentFlowToDatum_KDRF(lines_[lines_id_].first, lines_dir_[lines_id_].first, lines_dir_[lines_id_].second, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum)) {
-				continue;
-			}
-		} else{
-			if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true)) {
-				continue;
-			}
-		}
-		int offset1 = this->prefetch_data_.offset(item_id);
-    	this->transformed_data_.set_cpu_data(top_data + offset1);
-		this->data_transformer_->Transform(datum, &(this->transformed_data_));
-		top_label[item_id] = lines_[lines_id_].second;
-		//LOG()
+		batch_lines_[item_id] = lines_[lines_id_];
+		batch_dirs_[item_id] = lines_dir_[lines_id_];
 
 		//next iteration
 		lines_id_++;
 		if (lines_id_ >= lines_size) {
 			DLOG(INFO) << "Restarting data prefetching from start.";
+			if (frame_cache_)
+				LOG(INFO) << "Frame cache: " << frame_cache_->num_frames() << " frames, "
+					<< frame_cache_->size_bytes() / (1024 * 1024) << " MB, hit rate " << frame_cache_->hit_rate();
 			lines_id_ = 0;
 			if(this->layer_param_.video_data_kdrf_param().shuffle()){
 				ShuffleVideos();
 			}
 		}
 	}
+
+	decode_pool_->Run(boost::bind(&VideoDataKDRFLayer<Dtype>::ReadBatchItem, this, top_label, _1, _2), &(batch->data_));
+}
+
+template <typename Dtype>
+bool VideoDataKDRFLayer<Dtype>::ReadBatchItem(Dtype* top_label, int item_id, vector<cv::Mat>* frames){
+	const VideoDataKDRFParameter& video_data_kdrf_param = this->layer_param_.video_data_kdrf_param();
+	const int new_height = video_data_kdrf_param.new_height();
+	const int new_width = video_data_kdrf_param.new_width();
+	const int new_length = video_data_kdrf_param.new_length();
+	const std::pair<string, int>& line = batch_lines_[item_id];
+
+	if (video_data_kdrf_param.modality() == VideoDataKDRFParameter_Modality_FLOW){
+		if(!ReadSegmentFlowToFrames_KDRF(line.first, batch_dirs_[item_id].first, batch_dirs_[item_id].second, batch_offsets_[item_id], new_height, new_width, new_length, frames, video_data_kdrf_param.reduced_decode(), frame_cache_.get())) {
+			return false;
+		}
+	} else{
+		if(!ReadSegmentRGBToFrames(line.first, batch_offsets_[item_id], new_height, new_width, new_length, frames, true, video_data_kdrf_param.reduced_decode(), frame_cache_.get())) {
+			return false;
+		}
+	}
+	top_label[item_id] = line.second;
+	return true;
 }
 
 INSTANTIATE_CLASS(VideoDataKDRFLayer);
@@ -0,0 +1,462 @@
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+// Winograd's minimal filtering F(4x4, 3x3), as in Lavin and Gray, "Fast
+// Algorithms for Convolutional Neural Networks": the 4x4 output tile Y of the
+// 3x3 filter g over the 6x6 input tile d is
+//
+//   Y = A^T [(G g G^T) .* (B^T d B)] A
+//
+// The one dimensional transforms below apply B^T, A^T and G, and for the
+// gradients their transposes, to a vector of the given stride. A two
+// dimensional transform applies one to the columns, then to the rows.
+static const int kWinogradTile = 6;
+static const int kWinogradOutputTile = 4;
+static const int kWinogradTileSize = kWinogradTile * kWinogradTile;
+
+// B^T, 6 to 6.
+template <typename Dtype>
+static inline void WinogradInput1D(const Dtype* d, const int d_stride,
+    Dtype* v, const int v_stride) {
+  const Dtype d0 = d[0], d1 = d[d_stride], d2 = d[2 * d_stride],
+      d3 = d[3 * d_stride], d4 = d[4 * d_stride], d5 = d[5 * d_stride];
+  v[0] = 4 * d0 - 5 * d2 + d4;
+  v[v_stride] = -4 * (d1 + d2) + d3 + d4;
+  v[2 * v_stride] = 4 * (d1 - d2) - d3 + d4;
+  v[3 * v_stride] = 2 * (d3 - d1) - d2 + d4;
+  v[4 * v_stride] = 2 * (d1 - d3) - d2 + d4;
+  v[5 * v_stride] = 4 * d1 - 5 * d3 + d5;
+}
+
+// A^T, 6 to 4.
+template <typename Dtype>
+static inline void WinogradOutput1D(const Dtype* m, const int m_stride,
+    Dtype* y, const int y_stride) {
+  const Dtype m0 = m[0], m1 = m[m_stride], m2 = m[2 * m_stride],
+      m3 = m[3 * m_stride], m4 = m[4 * m_stride], m5 = m[5 * m_stride];
+  y[0] = m0 + m1 + m2 + m3 + m4;
+  y[y_stride] = m1 - m2 + 2 * (m3 - m4);
+  y[2 * y_stride] = m1 + m2 + 4 * (m3 + m4);
+  y[3 * y_stride] = m1 - m2 + 8 * (m3 - m4) + m5;
+}
+
+// G, 3 to 6.
+template <typename Dtype>
+static inline void WinogradWeight1D(const Dtype* g, const int g_stride,
+    Dtype* u, const int u_stride) {
+  const Dtype g0 = g[0], g1 = g[g_stride], g2 = g[2 * g_stride];
+  u[0] = g0 / 4;
+  u[u_stride] = -(g0 + g1 + g2) / 6;
+  u[2 * u_stride] = -(g0 - g1 + g2) / 6;
+  u[3 * u_stride] = g0 / 24 + g1 / 12 + g2 / 6;
+  u[4 * u_stride] = g0 / 24 - g1 / 12 + g2 / 6;
+  u[5 * u_stride] = g2;
+}
+
+// A, 4 to 6.
+template <typename Dtype>
+static inline void WinogradOutputDiff1D(const Dtype* y, const int y_stride,
+    Dtype* m, const int m_stride) {
+  const Dtype y0 = y[0], y1 = y[y_stride], y2 = y[2 * y_stride],
+      y3 = y[3 * y_stride];
+  m[0] = y0;
+  m[m_stride] = y0 + y1 + y2 + y3;
+  m[2 * m_stride] = y0 - y1 + y2 - y3;
+  m[3 * m_stride] = y0 + 2 * y1 + 4 * y2 + 8 * y3;
+  m[4 * m_stride] = y0 - 2 * y1 + 4 * y2 - 8 * y3;
+  m[5 * m_stride] = y3;
+}
+
+// B, 6 to 6.
+template <typename Dtype>
+static inline void WinogradInputDiff1D(const Dtype* v, const int v_stride,
+    Dtype* d, const int d_stride) {
+  const Dtype v0 = v[0], v1 = v[v_stride], v2 = v[2 * v_stride],
+      v3 = v[3 * v_stride], v4 = v[4 * v_stride], v5 = v[5 * v_stride];
+  d[0] = 4 * v0;
+  d[d_stride] = 4 * (v2 - v1) + 2 * (v4 - v3) + 4 * v5;
+  d[2 * d_stride] = -5 * v0 - 4 * (v1 + v2) - v3 - v4;
+  d[3 * d_stride] = v1 - v2 + 2 * (v3 - v4) - 5 * v5;
+  d[4 * d_stride] = v0 + v1 + v2 + v3 + v4;
+  d[5 * d_stride] = v5;
+}
+
+// G^T, 6 to 3.
+template <typename Dtype>
+static inline void WinogradWeightDiff1D(const Dtype* u, const int u_stride,
+    Dtype* g, const int g_stride) {
+  const Dtype u0 = u[0], u1 = u[u_stride], u2 = u[2 * u_stride],
+      u3 = u[3 * u_stride], u4 = u[4 * u_stride], u5 = u[5 * u_stride];
+  g[0] = u0 / 4 - (u1 + u2) / 6 + (u3 + u4) / 24;
+  g[g_stride] = (u2 - u1) / 6 + (u3 - u4) / 12;
+  g[2 * g_stride] = (u3 + u4 - u1 - u2) / 6 + u5;
+}
+
+// The transformed tiles are stored as kWinogradTileSize matrices, one per
+// element of the tile, so that the products over the channels are one GEMM
+// per element: the filters as [num_output][channels / group], the inputs as
+// [channels][tiles] and the outputs as [num_output][tiles], with the tiles of
+// an image in row major order.
+
+// U = G g G^T for each of the count filters.
+template <typename Dtype>
+static void WinogradTransformWeights(const Dtype* weights, const int count,
+    Dtype* transformed) {
+  Dtype tmp[kWinogradTile * 3], u[kWinogradTileSize];
+  for (int i = 0; i < count; ++i) {
+    const Dtype* g = weights + 9 * i;
+    for (int j = 0; j < 3; ++j) {
+      WinogradWeight1D(g + j, 3, tmp + j, 3);
+    }
+    for (int j = 0; j < kWinogradTile; ++j) {
+      WinogradWeight1D(tmp + 3 * j, 1, u + kWinogradTile * j, 1);
+    }
+    for (int e = 0; e < kWinogradTileSize; ++e) {
+      transformed[e * count + i] = u[e];
+    }
+  }
+}
+
+// Adds G^T dU G to the gradients of the count filters.
+template <typename Dtype>
+static void WinogradTransformWeightDiff(const Dtype* transformed,
+    const int count, Dtype* weight_diff) {
+  Dtype u[kWinogradTileSize], tmp[3 * kWinogradTile], g[9];
+  for (int i = 0; i < count; ++i) {
+    for (int e = 0; e < kWinogradTileSize; ++e) {
+      u[e] = transformed[e * count + i];
+    }
+    for (int j = 0; j < kWinogradTile; ++j) {
+      WinogradWeightDiff1D(u + j, kWinogradTile, tmp + j, kWinogradTile);
+    }
+    for (int j = 0; j < 3; ++j) {
+      WinogradWeightDiff1D(tmp + kWinogradTile * j, 1, g + 3 * j, 1);
+    }
+    for (int j = 0; j < 9; ++j) {
+      weight_diff[9 * i + j] += g[j];
+    }
+  }
+}
+
+// V = B^T d B for each tile of each channel of an image, zero outside it.
+template <typename Dtype>
+static void WinogradTransformInput(const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, Dtype* transformed) {
+  const int num_tiles = tiles_h * tiles_w;
+  const int count = channels * num_tiles;
+  Dtype d[kWinogradTileSize], tmp[kWinogradTileSize], v[kWinogradTileSize];
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* channel = data + c * height * width;
+    for (int th = 0; th < tiles_h; ++th) {
+      for (int tw = 0; tw < tiles_w; ++tw) {
+        const int h_start = th * kWinogradOutputTile - pad_h;
+        const int w_start = tw * kWinogradOutputTile - pad_w;
+        for (int i = 0; i < kWinogradTile; ++i) {
+          const int h = h_start + i;
+          for (int j = 0; j < kWinogradTile; ++j) {
+            const int w = w_start + j;
+            d[kWinogradTile * i + j] = (h >= 0 && h < height && w >= 0 &&
+                w < width) ? channel[h * width + w] : Dtype(0);
+          }
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradInput1D(d + j, kWinogradTile, tmp + j, kWinogradTile);
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradInput1D(tmp + kWinogradTile * j, 1, v + kWinogradTile * j,
+              1);
+        }
+        const int index = c * num_tiles + th * tiles_w + tw;
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          transformed[e * count + index] = v[e];
+        }
+      }
+    }
+  }
+}
+
+// Writes the part of B dV B^T in the image for each tile of each channel to
+// its gradient, adding up where the tiles overlap.
+template <typename Dtype>
+static void WinogradTransformInputDiff(const Dtype* transformed,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const int tiles_h, const int tiles_w, Dtype* data_diff) {
+  const int num_tiles = tiles_h * tiles_w;
+  const int count = channels * num_tiles;
+  Dtype v[kWinogradTileSize], tmp[kWinogradTileSize], d[kWinogradTileSize];
+  caffe_set(channels * height * width, Dtype(0), data_diff);
+  for (int c = 0; c < channels; ++c) {
+    Dtype* channel = data_diff + c * height * width;
+    for (int th = 0; th < tiles_h; ++th) {
+      for (int tw = 0; tw < tiles_w; ++tw) {
+        const int index = c * num_tiles + th * tiles_w + tw;
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          v[e] = transformed[e * count + index];
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradInputDiff1D(v + j, kWinogradTile, tmp + j, kWinogradTile);
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradInputDiff1D(tmp + kWinogradTile * j, 1,
+              d + kWinogradTile * j, 1);
+        }
+        const int h_start = th * kWinogradOutputTile - pad_h;
+        const int w_start = tw * kWinogradOutputTile - pad_w;
+        for (int i = 0; i < kWinogradTile; ++i) {
+          const int h = h_start + i;
+          if (h < 0 || h >= height) {
+            continue;
+          }
+          for (int j = 0; j < kWinogradTile; ++j) {
+            const int w = w_start + j;
+            if (w >= 0 && w < width) {
+              channel[h * width + w] += d[kWinogradTile * i + j];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Writes the part of A^T M A in the output for each tile of each channel.
+template <typename Dtype>
+static void WinogradTransformOutput(const Dtype* transformed,
+    const int channels, const int height, const int width, const int tiles_h,
+    const int tiles_w, Dtype* output) {
+  const int num_tiles = tiles_h * tiles_w;
+  const int count = channels * num_tiles;
+  Dtype m[kWinogradTileSize], tmp[kWinogradOutputTile * kWinogradTile];
+  Dtype y[kWinogradOutputTile * kWinogradOutputTile];
+  for (int c = 0; c < channels; ++c) {
+    Dtype* channel = output + c * height * width;
+    for (int th = 0; th < tiles_h; ++th) {
+      for (int tw = 0; tw < tiles_w; ++tw) {
+        const int index = c * num_tiles + th * tiles_w + tw;
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          m[e] = transformed[e * count + index];
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradOutput1D(m + j, kWinogradTile, tmp + j, kWinogradTile);
+        }
+        for (int j = 0; j < kWinogradOutputTile; ++j) {
+          WinogradOutput1D(tmp + kWinogradTile * j, 1,
+              y + kWinogradOutputTile * j, 1);
+        }
+        const int h_start = th * kWinogradOutputTile;
+        const int w_start = tw * kWinogradOutputTile;
+        for (int i = 0; i < kWinogradOutputTile && h_start + i < height;
+            ++i) {
+          for (int j = 0; j < kWinogradOutputTile && w_start + j < width;
+              ++j) {
+            channel[(h_start + i) * width + w_start + j] =
+                y[kWinogradOutputTile * i + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+// dM = A dY A^T for each tile of each channel of the output gradient, zero
+// outside it.
+template <typename Dtype>
+static void WinogradTransformOutputDiff(const Dtype* output_diff,
+    const int channels, const int height, const int width, const int tiles_h,
+    const int tiles_w, Dtype* transformed) {
+  const int num_tiles = tiles_h * tiles_w;
+  const int count = channels * num_tiles;
+  Dtype y[kWinogradOutputTile * kWinogradOutputTile];
+  Dtype tmp[kWinogradTile * kWinogradOutputTile], m[kWinogradTileSize];
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* channel = output_diff + c * height * width;
+    for (int th = 0; th < tiles_h; ++th) {
+      for (int tw = 0; tw < tiles_w; ++tw) {
+        const int h_start = th * kWinogradOutputTile;
+        const int w_start = tw * kWinogradOutputTile;
+        for (int i = 0; i < kWinogradOutputTile; ++i) {
+          const int h = h_start + i;
+          for (int j = 0; j < kWinogradOutputTile; ++j) {
+            const int w = w_start + j;
+            y[kWinogradOutputTile * i + j] = (h < height && w < width) ?
+                channel[h * width + w] : Dtype(0);
+          }
+        }
+        for (int j = 0; j < kWinogradOutputTile; ++j) {
+          WinogradOutputDiff1D(y + j, kWinogradOutputTile, tmp + j,
+              kWinogradOutputTile);
+        }
+        for (int j = 0; j < kWinogradTile; ++j) {
+          WinogradOutputDiff1D(tmp + kWinogradOutputTile * j, 1,
+              m + kWinogradTile * j, 1);
+        }
+        const int index = c * num_tiles + th * tiles_w + tw;
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          transformed[e * count + index] = m[e];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK(this->kernel_h_ == 3 && this->kernel_w_ == 3)
+      << "The WINOGRAD engine only takes 3x3 kernels.";
+  CHECK(this->stride_h_ == 1 && this->stride_w_ == 1)
+      << "The WINOGRAD engine only takes a stride of 1.";
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  tiles_h_ = (this->height_out_ + kWinogradOutputTile - 1) /
+      kWinogradOutputTile;
+  tiles_w_ = (this->width_out_ + kWinogradOutputTile - 1) /
+      kWinogradOutputTile;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int channels_per_group = this->channels_ / this->group_;
+  transformed_weights_.Reshape(1, kWinogradTileSize, this->num_output_,
+      channels_per_group);
+  transformed_input_.Reshape(1, kWinogradTileSize, this->channels_,
+      num_tiles);
+  transformed_output_.Reshape(1, kWinogradTileSize, this->num_output_,
+      num_tiles);
+}
+
+// The products of the transformed filters and inputs, as one GEMM per
+// element of the tile and group.
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int output_per_group = this->num_output_ / this->group_;
+  const int channels_per_group = this->channels_ / this->group_;
+  Dtype* transformed_weights = transformed_weights_.mutable_cpu_data();
+  Dtype* transformed_input = transformed_input_.mutable_cpu_data();
+  Dtype* transformed_output = transformed_output_.mutable_cpu_data();
+  WinogradTransformWeights(this->blobs_[0]->cpu_data(),
+      this->num_output_ * channels_per_group, transformed_weights);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      WinogradTransformInput(bottom_data + bottom[i]->offset(n),
+          this->channels_, this->height_, this->width_, this->pad_h_,
+          this->pad_w_, tiles_h_, tiles_w_, transformed_input);
+      for (int e = 0; e < kWinogradTileSize; ++e) {
+        for (int g = 0; g < this->group_; ++g) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, output_per_group,
+              num_tiles, channels_per_group, (Dtype)1.,
+              transformed_weights + transformed_weights_.offset(0, e,
+                  output_per_group * g),
+              transformed_input + transformed_input_.offset(0, e,
+                  channels_per_group * g),
+              (Dtype)0., transformed_output + transformed_output_.offset(0, e,
+                  output_per_group * g));
+        }
+      }
+      WinogradTransformOutput(transformed_output, this->num_output_,
+          this->height_out_, this->width_out_, tiles_h_, tiles_w_,
+          top_data + top[i]->offset(n));
+      if (this->bias_term_) {
+        const Dtype* bias = this->blobs_[1]->cpu_data();
+        this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int output_per_group = this->num_output_ / this->group_;
+  const int channels_per_group = this->channels_ / this->group_;
+  Dtype* transformed_weights = transformed_weights_.mutable_cpu_data();
+  // The gradient of the transformed filters goes to their diff.
+  Dtype* transformed_weight_diff = transformed_weights_.mutable_cpu_diff();
+  Dtype* transformed_input = transformed_input_.mutable_cpu_data();
+  Dtype* transformed_output_diff = transformed_output_.mutable_cpu_diff();
+  WinogradTransformWeights(this->blobs_[0]->cpu_data(),
+      this->num_output_ * channels_per_group, transformed_weights);
+  if (this->param_propagate_down_[0]) {
+    caffe_set(transformed_weights_.count(), Dtype(0),
+        transformed_weight_diff);
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    // Bias gradient, if necessary.
+    if (this->bias_term_ && this->param_propagate_down_[1]) {
+      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_bias(bias_diff, top_diff + top[i]->offset(n));
+      }
+    }
+    if (!this->param_propagate_down_[0] && !propagate_down[i]) {
+      continue;
+    }
+    for (int n = 0; n < this->num_; ++n) {
+      WinogradTransformOutputDiff(top_diff + top[i]->offset(n),
+          this->num_output_, this->height_out_, this->width_out_, tiles_h_,
+          tiles_w_, transformed_output_diff);
+      // Gradient w.r.t. the transformed filters, accumulated.
+      if (this->param_propagate_down_[0]) {
+        WinogradTransformInput(bottom_data + bottom[i]->offset(n),
+            this->channels_, this->height_, this->width_, this->pad_h_,
+            this->pad_w_, tiles_h_, tiles_w_, transformed_input);
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          for (int g = 0; g < this->group_; ++g) {
+            caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, output_per_group,
+                channels_per_group, num_tiles, (Dtype)1.,
+                transformed_output_diff + transformed_output_.offset(0, e,
+                    output_per_group * g),
+                transformed_input + transformed_input_.offset(0, e,
+                    channels_per_group * g),
+                (Dtype)1., transformed_weight_diff +
+                    transformed_weights_.offset(0, e, output_per_group * g));
+          }
+        }
+      }
+      // Gradient w.r.t. bottom data, through the transformed input.
+      if (propagate_down[i]) {
+        for (int e = 0; e < kWinogradTileSize; ++e) {
+          for (int g = 0; g < this->group_; ++g) {
+            caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans,
+                channels_per_group, num_tiles, output_per_group, (Dtype)1.,
+                transformed_weights + transformed_weights_.offset(0, e,
+                    output_per_group * g),
+                transformed_output_diff + transformed_output_.offset(0, e,
+                    output_per_group * g),
+                (Dtype)0., transformed_input + transformed_input_.offset(0, e,
+                    channels_per_group * g));
+          }
+        }
+        WinogradTransformInputDiff(transformed_input, this->channels_,
+            this->height_, this->width_, this->pad_h_, this->pad_w_,
+            tiles_h_, tiles_w_, bottom_diff + bottom[i]->offset(n));
+      }
+    }
+  }
+  if (this->param_propagate_down_[0]) {
+    WinogradTransformWeightDiff(transformed_weight_diff,
+        this->num_output_ * channels_per_group,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
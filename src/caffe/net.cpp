@@ -38,6 +38,9 @@ template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  cpu_param_data_ = gpu_param_data_ = NULL;
+  cpu_param_diff_ = gpu_param_diff_ = NULL;
+  param_arena_owned_count_ = param_arena_count_ = 0;
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
@@ -289,6 +292,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   GetLearningRateAndWeightDecay();
+  if (param.contiguous_params() && params_.size()) {
+    AllocateParamArena();
+  }
   debug_info_ = param.debug_info();
   LOG(INFO) << "Network initialization done.";
   LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
@@ -487,6 +493,10 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   params_.push_back(layers_[layer_id]->blobs()[param_id]);
   param_id_vecs_[layer_id].push_back(net_param_id);
   param_layer_indices_.push_back(make_pair(layer_id, param_id));
+#ifdef USE_MPI
+  param_compressors_.push_back(CreateGradientCompressor<Dtype>(
+      layer_param.gradient_compression_param()));
+#endif
   if (!param_size || !param_name.size() || (param_name.size() &&
       param_names_index_.find(param_name) == param_names_index_.end())) {
     // This layer "owns" this parameter blob -- it is either anonymous
@@ -541,6 +551,107 @@ void Net<Dtype>::GetLearningRateAndWeightDecay() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::AllocateParamArena() {
+  // The owned parameters first, then the diffs of the shared ones, each at a
+  // multiple of 64 bytes into the arena.
+  const int align = std::max<int>(1, 64 / sizeof(Dtype));
+  param_arena_offsets_.resize(params_.size());
+  int offset = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    const bool owned = (pass == 0);
+    for (int i = 0; i < params_.size(); ++i) {
+      if ((param_owners_[i] < 0) != owned) { continue; }
+      param_arena_offsets_[i] = offset;
+      offset += (params_[i]->count() + align - 1) / align * align;
+    }
+    if (owned) {
+      param_arena_owned_count_ = offset;
+    }
+  }
+  param_arena_count_ = offset;
+  LOG(INFO) << "Allocating " << params_.size() << " parameters in an arena of "
+      << param_arena_count_ * sizeof(Dtype) << " bytes";
+
+  // The arenas start zeroed on the CPU, and on the GPU if we run there.
+  param_data_arena_.reset(new SyncedMemory(
+      std::max(param_arena_owned_count_, 1) * sizeof(Dtype)));
+  param_diff_arena_.reset(new SyncedMemory(param_arena_count_ * sizeof(Dtype)));
+  cpu_param_data_ = static_cast<Dtype*>(param_data_arena_->mutable_cpu_data());
+  cpu_param_diff_ = static_cast<Dtype*>(param_diff_arena_->mutable_cpu_data());
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    gpu_param_data_ =
+        static_cast<Dtype*>(param_data_arena_->mutable_gpu_data());
+    gpu_param_diff_ =
+        static_cast<Dtype*>(param_diff_arena_->mutable_gpu_data());
+  }
+#endif
+
+  // Copy the values in, and make each blob a view of its part. The values
+  // are on the CPU; a view copies them to its part of the GPU arena when it
+  // is first used there.
+  for (int i = 0; i < params_.size(); ++i) {
+    Blob<Dtype>* param = params_[i].get();
+    const int count = param->count();
+    // A shared parameter already uses the data of its owner.
+    if (param_owners_[i] < 0) {
+      Dtype* data = cpu_param_data_ + param_arena_offsets_[i];
+      caffe_copy(count, param->cpu_data(), data);
+      if (gpu_param_data_) {
+        param->set_gpu_data(gpu_param_data_ + param_arena_offsets_[i]);
+      }
+      param->set_cpu_data(data);
+    }
+    Dtype* diff = cpu_param_diff_ + param_arena_offsets_[i];
+    caffe_copy(count, param->cpu_diff(), diff);
+    if (gpu_param_diff_) {
+      param->set_gpu_diff(gpu_param_diff_ + param_arena_offsets_[i]);
+    }
+    param->set_cpu_diff(diff);
+  }
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_cpu_param_data() {
+  CHECK(has_param_arena());
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] < 0) {
+      params_[i]->mutable_cpu_data();
+    }
+  }
+  return cpu_param_data_;
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_gpu_param_data() {
+  CHECK(gpu_param_data_) << "The parameter arena was allocated in CPU mode.";
+  for (int i = 0; i < params_.size(); ++i) {
+    if (param_owners_[i] < 0) {
+      params_[i]->mutable_gpu_data();
+    }
+  }
+  return gpu_param_data_;
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_cpu_param_diff() {
+  CHECK(has_param_arena());
+  for (int i = 0; i < params_.size(); ++i) {
+    params_[i]->mutable_cpu_diff();
+  }
+  return cpu_param_diff_;
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_gpu_param_diff() {
+  CHECK(gpu_param_diff_) << "The parameter arena was allocated in CPU mode.";
+  for (int i = 0; i < params_.size(); ++i) {
+    params_[i]->mutable_gpu_diff();
+  }
+  return gpu_param_diff_;
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
@@ -647,11 +758,19 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
             }
           }
           //sync gradient
-          if (ready_for_sync && layers_[i]->need_sync())
-            caffe_iallreduce(
-                this->params_[n]->mutable_cpu_diff(),
-                this->params_[n]->count()
-            );
+          if (ready_for_sync && layers_[i]->need_sync()) {
+            if (param_compressors_[n]) {
+              caffe_iallreduce_compressed(
+                  this->params_[n]->mutable_cpu_diff(),
+                  this->params_[n]->count(),
+                  param_compressors_[n].get());
+            } else {
+              caffe_iallreduce(
+                  this->params_[n]->mutable_cpu_diff(),
+                  this->params_[n]->count()
+              );
+            }
+          }
         }
       }
 #endif //USE_MPI
@@ -765,6 +884,34 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  int num_source_layers = other->layers().size();
+  for (int i = 0; i < num_source_layers; ++i) {
+    Layer<Dtype>* source_layer = other->layers()[i].get();
+    const string& source_layer_name = other->layer_names()[i];
+    int target_layer_id = 0;
+    while (target_layer_id != layer_names_.size() &&
+        layer_names_[target_layer_id] != source_layer_name) {
+      ++target_layer_id;
+    }
+    if (target_layer_id == layer_names_.size()) {
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
+      CHECK(target_blobs[j]->shape() == source_blob->shape());
+      target_blobs[j]->CopyFrom(*source_blob);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
@@ -831,11 +978,82 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  if (IsRawWeightsFile(trained_filename)) {
+    RawWeights weights;
+    CHECK(weights.Open(trained_filename))
+        << "Could not read " << trained_filename;
+    CopyTrainedLayersFrom(weights, false);
+    return;
+  }
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
   CopyTrainedLayersFrom(param);
 }
 
+// Points a blob at its values in raw weights, which are floats. Returns
+// false if the blob is not of floats.
+static bool MapRawBlob(float* data, Blob<float>* blob) {
+  blob->set_cpu_data(data);
+  return true;
+}
+
+static bool MapRawBlob(float* data, Blob<double>* blob) {
+  return false;
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const RawWeights& weights,
+    const bool map) {
+  const NetParameter& index = weights.index();
+  int num_source_layers = index.layer_size();
+  for (int i = 0; i < num_source_layers; ++i) {
+    const LayerParameter& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    int target_layer_id = 0;
+    while (target_layer_id != layer_names_.size() &&
+        layer_names_[target_layer_id] != source_layer_name) {
+      ++target_layer_id;
+    }
+    if (target_layer_id == layer_names_.size()) {
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << (map ? "Mapping" : "Copying") << " source layer "
+               << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      CHECK(target_blobs[j]->ShapeEquals(source_layer.blobs(j)))
+          << "Incompatible shape of blob " << j << " of layer "
+          << source_layer_name;
+      float* data = weights.blob_data(i, j);
+      if (map && MapRawBlob(data, target_blobs[j].get())) {
+        continue;
+      }
+      Dtype* target_data = target_blobs[j]->mutable_cpu_data();
+      for (int k = 0; k < target_blobs[j]->count(); ++k) {
+        target_data[k] = data[k];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::MapTrainedLayersFrom(const string& trained_filename) {
+  shared_ptr<RawWeights> weights(new RawWeights());
+  CHECK(weights->Open(trained_filename))
+      << "Could not map " << trained_filename;
+  if (has_param_arena()) {
+    // Mapped parameters would leave the arena.
+    LOG(WARNING) << "Copying " << trained_filename << " rather than mapping"
+                 << " it into the contiguous parameters";
+  }
+  CopyTrainedLayersFrom(*weights, !has_param_arena());
+  mapped_weights_.push_back(weights);
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -891,7 +1109,68 @@ void Net<Dtype>::Update() {
   for (int i = 0; i < params_.size(); ++i) {
     if (param_owners_[i] >= 0) { continue; }
     if (debug_info_) { UpdateDebugInfo(i); }
-    params_[i]->Update();
+    if (!use_param_arena()) {
+      params_[i]->Update();
+    }
+  }
+  if (use_param_arena()) {
+    // All of them at once: data -= diff over the owned part of the arenas.
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_axpy<Dtype>(param_arena_owned_count_, Dtype(-1),
+          mutable_cpu_param_diff(), mutable_cpu_param_data());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_axpy<Dtype>(param_arena_owned_count_, Dtype(-1),
+          mutable_gpu_param_diff(), mutable_gpu_param_data());
+#else
+      NO_GPU;
+#endif
+      break;
+    default:
+      LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ClearParamDiffs() {
+  if (use_param_arena()) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(param_arena_count_, static_cast<Dtype>(0),
+          mutable_cpu_param_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(param_arena_count_, static_cast<Dtype>(0),
+          mutable_gpu_param_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    default:
+      LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+    }
+    return;
+  }
+  for (int i = 0; i < params_.size(); ++i) {
+    Blob<Dtype>* blob = params_[i].get();
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      caffe_set(blob->count(), static_cast<Dtype>(0),
+          blob->mutable_cpu_diff());
+      break;
+    case Caffe::GPU:
+#ifndef CPU_ONLY
+      caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
+          blob->mutable_gpu_diff());
+#else
+      NO_GPU;
+#endif
+      break;
+    }
   }
 }
 
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include <boost/thread.hpp>
+
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
@@ -29,6 +31,20 @@ Solver<Dtype>::Solver(const string& param_file)
   Init(param);
 }
 
+template <typename Dtype>
+Solver<Dtype>::~Solver() {
+  // Reports a test still running. With MPI its results are dropped instead,
+  // the other ranks may not be there to average them.
+#ifdef USE_MPI
+  if (test_thread_ && Caffe::parallel_mode() == Caffe::MPI) {
+    test_thread_->join();
+    test_thread_.reset();
+  }
+#endif
+  FinishBackgroundTest();
+  FinishSnapshot();
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Init(const SolverParameter& param) {
   LOG(INFO) << "Initializing solver from parameters: " << std::endl
@@ -40,6 +56,16 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   }
 #ifdef USE_CUDNN
   Caffe::set_cudnn_mem_richness(param_.richness());
+#endif
+#ifdef USE_MPI
+  if (Caffe::parallel_mode() == Caffe::MPI) {
+    CHECK_GE(param_.mpi_bucket_mb(), 0);
+    mpi_set_bucket_bytes(size_t(param_.mpi_bucket_mb() * 1024 * 1024));
+    CHECK_GT(param_.mpi_allreduce_chunk_mb(), 0);
+    mpi_set_allreduce(
+        static_cast<AllreduceAlgorithm>(param_.mpi_allreduce()),
+        size_t(param_.mpi_allreduce_chunk_mb() * 1024 * 1024));
+  }
 #endif
   // Scaffolding code
   InitTrainNet();
@@ -47,6 +73,7 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   LOG(INFO) << "Solver scaffolding done.";
   iter_ = 0;
   current_step_ = 0;
+  background_test_iter_ = 0;
 }
 
 template <typename Dtype>
@@ -174,32 +201,20 @@ void Solver<Dtype>::Step(int iters) {
 
   while (iter_ < stop_iter) {
     // zero-init the params
-    for (int i = 0; i < net_->params().size(); ++i) {
-      shared_ptr<Blob<Dtype> > blob = net_->params()[i];
-      switch (Caffe::mode()) {
-      case Caffe::CPU:
-        caffe_set(blob->count(), static_cast<Dtype>(0),
-            blob->mutable_cpu_diff());
-        break;
-      case Caffe::GPU:
-#ifndef CPU_ONLY
-        caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
-            blob->mutable_gpu_diff());
-#else
-        NO_GPU;
-#endif
-        break;
-      }
-    }
+    net_->ClearParamDiffs();
 
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())) {
+      if (param_.test_in_background()) {
+        TestAllInBackground();
+      } else {
 #ifdef USE_MPI
-      if (Caffe::parallel_mode()==Caffe::MPI){
-          SyncData();
-      }
+        if (Caffe::parallel_mode()==Caffe::MPI){
+            SyncData();
+        }
 #endif
-      TestAll();
+        TestAll();
+      }
     }
 
     const bool display = param_.display() && iter_ % param_.display() == 0;
@@ -257,6 +272,11 @@ void Solver<Dtype>::Step(int iters) {
               << result_vec[k] << loss_msg_stream.str();
         }
       }
+#ifdef USE_MPI
+      if (Caffe::parallel_mode() == Caffe::MPI) {
+        DisplayGradientCompression();
+      }
+#endif
     }
     ApplyUpdate();
 
@@ -283,6 +303,15 @@ void Solver<Dtype>::SyncGradient(){
   t1 = MPI_Wtime();
 
   mpi_force_synchronize();
+  const vector<shared_ptr<GradientCompressor> >& compressors =
+      this->net_->param_compressors();
+  compression_stats_ = GradientCompressionStats();
+  for (int param_id = 0; param_id < compressors.size(); ++param_id) {
+    if (compressors[param_id]) {
+      compression_stats_.Add(compressors[param_id]->stats());
+      compressors[param_id]->ResetStats();
+    }
+  }
   for (int param_id = 0; param_id < net_params.size(); ++param_id) {
     int param_ownner = param_owners[param_id];
 
@@ -298,16 +327,45 @@ void Solver<Dtype>::SyncGradient(){
 
     // conduct gradient synchronization here
     if (is_self && need_sync){
-
-      caffe_gpu_scal(net_params[param_id]->count(),
-                     Dtype(1.)/Dtype(Caffe::MPI_all_rank()),
-                     net_params[param_id]->mutable_gpu_diff());
+      switch (Caffe::mode()) {
+      case Caffe::CPU:
+        caffe_scal(net_params[param_id]->count(),
+                   Dtype(1.)/Dtype(Caffe::MPI_all_rank()),
+                   net_params[param_id]->mutable_cpu_diff());
+        break;
+      case Caffe::GPU:
+#ifndef CPU_ONLY
+        caffe_gpu_scal(net_params[param_id]->count(),
+                       Dtype(1.)/Dtype(Caffe::MPI_all_rank()),
+                       net_params[param_id]->mutable_gpu_diff());
+#else
+        NO_GPU;
+#endif
+        break;
+      default:
+        LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+      }
     }
   }
   t2 = MPI_Wtime();
   DLOG(INFO)<<"Communication time "<<t2-t1<<" second";
 }
 
+template <typename Dtype>
+void Solver<Dtype>::DisplayGradientCompression() {
+  const GradientCompressionStats& stats = compression_stats_;
+  if (stats.raw_bytes == 0) {
+    return;
+  }
+  LOG(INFO) << "    Gradient compression: "
+      << stats.raw_bytes / 1048576. << " MB sent as "
+      << stats.sent_bytes / 1048576. << " MB ("
+      << 100. * stats.sent_bytes / stats.raw_bytes << "%), encoding "
+      << stats.encode_seconds * 1000 << " ms, exchange "
+      << stats.exchange_seconds * 1000 << " ms, about "
+      << stats.saved_seconds() * 1000 << " ms saved";
+}
+
 template <typename Dtype>
 void Solver<Dtype>::SyncData(){
 
@@ -335,12 +393,13 @@ void Solver<Dtype>::SyncData(){
 template <typename Dtype>
 void Solver<Dtype>::SyncOutput(shared_ptr<Net<Dtype> > net){
   const vector<Blob<Dtype>*>& result = net->output_blobs();
+  vector<MPIJobFuture> sums;
   for (int j = 0; j < result.size(); ++j) {
-    caffe_iallreduce<Dtype>(result[j]->mutable_cpu_data(),
-                            result[j]->count());
+    sums.push_back(caffe_iallreduce<Dtype>(result[j]->mutable_cpu_data(),
+                                           result[j]->count()));
   }
-  mpi_force_synchronize();
   for( int j = 0; j < result.size(); ++j){
+    sums[j].Wait();
     caffe_scal(result[j]->count(),
                    Dtype(1.)/Dtype(Caffe::MPI_all_rank()),
                    result[j]->mutable_cpu_data());
@@ -350,8 +409,7 @@ void Solver<Dtype>::SyncOutput(shared_ptr<Net<Dtype> > net){
 template <typename Dtype>
 Dtype Solver<Dtype>::SyncLoss(Dtype loss){
   Dtype sum_loss;
-  caffe_iallreduce<Dtype>(&loss, &sum_loss, 1);
-  mpi_force_synchronize();
+  caffe_iallreduce<Dtype>(&loss, &sum_loss, 1).Wait();
   return sum_loss / Caffe::MPI_all_rank();
 }
 #endif
@@ -385,6 +443,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     #else
     if (Caffe::MPI_my_rank() == 0){
       Snapshot();
+      FinishSnapshot();
     }
     if (Caffe::parallel_mode() == Caffe::MPI){
       //Stop the world to wait for the master process to finish snapshot
@@ -408,8 +467,14 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     LOG(INFO) << "Iteration " << iter_ << ", loss = " << loss;
   }
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
-    TestAll();
+    if (param_.test_in_background()) {
+      TestAllInBackground();
+    } else {
+      TestAll();
+    }
   }
+  FinishBackgroundTest();
+  FinishSnapshot();
   LOG(INFO) << "Optimization Done.";
 }
 
@@ -427,8 +492,18 @@ void Solver<Dtype>::Test(const int test_net_id) {
             << ", Testing net (#" << test_net_id << ")";
   CHECK_NOTNULL(test_nets_[test_net_id].get())->
       ShareTrainedLayersWith(net_.get());
-  vector<Dtype> test_score;
-  vector<int> test_score_output_id;
+  TestResult result;
+  RunTest(test_net_id, true, &result);
+  DisplayTestResult(test_net_id, result);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::RunTest(const int test_net_id, const bool sync_output,
+    TestResult* test_result) {
+  vector<Dtype>& test_score = test_result->score;
+  vector<int>& test_score_output_id = test_result->score_output_id;
+  test_score.clear();
+  test_score_output_id.clear();
   vector<Blob<Dtype>*> bottom_vec;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
@@ -437,7 +512,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
     const vector<Blob<Dtype>*>& result =
         test_net->Forward(bottom_vec, &iter_loss);
 #ifdef USE_MPI
-    if (Caffe::parallel_mode() == Caffe::MPI) {
+    if (sync_output && Caffe::parallel_mode() == Caffe::MPI) {
       SyncOutput(test_net);
     }
 #endif
@@ -462,8 +537,17 @@ void Solver<Dtype>::Test(const int test_net_id) {
       }
     }
   }
+  test_result->loss = loss;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::DisplayTestResult(const int test_net_id,
+    const TestResult& result) {
+  const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
+  const vector<Dtype>& test_score = result.score;
+  const vector<int>& test_score_output_id = result.score_output_id;
   if (param_.test_compute_loss()) {
-    loss /= param_.test_iter(test_net_id);
+    const Dtype loss = result.loss / param_.test_iter(test_net_id);
     LOG(INFO) << "Test loss: " << loss;
   }
 
@@ -484,12 +568,101 @@ void Solver<Dtype>::Test(const int test_net_id) {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::TestAllInBackground() {
+  FinishBackgroundTest();
+#ifdef USE_MPI
+  // The test nets run no collectives of their own in the background, they
+  // would race with the ones of training.
+  if (Caffe::parallel_mode() == Caffe::MPI) {
+    for (int i = 0; i < test_nets_.size(); ++i) {
+      const vector<shared_ptr<Layer<Dtype> > >& layers =
+          test_nets_[i]->layers();
+      for (int j = 0; j < layers.size(); ++j) {
+        const string type = layers[j]->type();
+        CHECK(type != "Gather" && type != "Scatter")
+            << "Test net #" << i << " cannot be tested in the background "
+            << "with MPI, its layer " << test_nets_[i]->layer_names()[j]
+            << " communicates between the ranks.";
+      }
+    }
+  }
+#endif
+  // The test nets keep weights of their own, the train net goes on
+  // updating its.
+  for (int i = 0; i < test_nets_.size(); ++i) {
+    test_nets_[i]->CopyTrainedLayersFrom(net_.get());
+  }
+  background_test_iter_ = iter_;
+  background_test_results_.resize(test_nets_.size());
+  LOG(INFO) << "Iteration " << iter_ << ", Testing "
+      << test_nets_.size() << " net(s) in the background";
+  int device = -1;
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device));
+  }
+#endif
+  // The test thread draws from an RNG of its own, seeded from the one of
+  // training so that runs stay reproducible.
+  const unsigned int seed = caffe_rng_rand();
+  test_thread_.reset(new boost::thread(&Solver<Dtype>::BackgroundTestEntry,
+      this, device, &Caffe::Get(), seed));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::BackgroundTestEntry(const int device,
+    const Caffe* parent, const unsigned int seed) {
+#ifndef CPU_ONLY
+  // Before the context, whose handles are created on the current device.
+  if (device >= 0) {
+    CUDA_CHECK(cudaSetDevice(device));
+  }
+#endif
+  // The fillers, cuBLAS and cuRAND of the test nets must not share the
+  // state of the training, which goes on meanwhile.
+  Caffe::InitThreadContext(*parent, seed);
+  for (int i = 0; i < test_nets_.size(); ++i) {
+    RunTest(i, false, &background_test_results_[i]);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::FinishBackgroundTest() {
+  if (!test_thread_) {
+    return;
+  }
+  test_thread_->join();
+  test_thread_.reset();
+  for (int i = 0; i < test_nets_.size(); ++i) {
+    TestResult& result = background_test_results_[i];
+#ifdef USE_MPI
+    // The mean over the ranks of the sums over the batches, which is the
+    // sum of the means that Test takes at every batch.
+    if (Caffe::parallel_mode() == Caffe::MPI) {
+      if (result.score.size()) {
+        caffe_iallreduce<Dtype>(&result.score[0], result.score.size()).Wait();
+        caffe_scal<Dtype>(result.score.size(),
+            Dtype(1.) / Dtype(Caffe::MPI_all_rank()), &result.score[0]);
+      }
+      result.loss = SyncLoss(result.loss);
+    }
+#endif
+    LOG(INFO) << "Iteration " << background_test_iter_
+              << ", Testing net (#" << i << ")";
+    DisplayTestResult(i, result);
+  }
+}
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
-  NetParameter net_param;
+  // At most one snapshot is staged or written at a time.
+  FinishSnapshot();
+  // Copying the weights and history into the protos is all the training has
+  // to wait for with snapshot_in_background.
+  shared_ptr<NetParameter> net_param(new NetParameter());
   // For intermediate results, we will also dump the gradient values.
-  net_->ToProto(&net_param, param_.snapshot_diff());
+  net_->ToProto(net_param.get(), param_.snapshot_diff());
   string filename(param_.snapshot_prefix());
   string model_filename, snapshot_filename;
   const int kBufferSize = 20;
@@ -497,20 +670,43 @@ void Solver<Dtype>::Snapshot() {
   snprintf(iter_str_buffer, kBufferSize, "_iter_%d", iter_);
   filename += iter_str_buffer;
   model_filename = filename + ".caffemodel";
-  LOG(INFO) << "Snapshotting to " << model_filename;
-  WriteProtoToBinaryFile(net_param, model_filename.c_str());
-  SolverState state;
-  SnapshotSolverState(&state);
-  state.set_iter(iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(current_step_);
+  shared_ptr<SolverState> state(new SolverState());
+  SnapshotSolverState(state.get());
+  state->set_iter(iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(current_step_);
   snapshot_filename = filename + ".solverstate";
-  LOG(INFO) << "Snapshotting solver state to " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
+  if (param_.snapshot_in_background()) {
+    snapshot_thread_.reset(new boost::thread(&Solver<Dtype>::WriteSnapshot,
+        this, net_param, model_filename, state, snapshot_filename));
+  } else {
+    WriteSnapshot(net_param, model_filename, state, snapshot_filename);
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(const shared_ptr<NetParameter> net_param,
+    const string model_filename, const shared_ptr<SolverState> state,
+    const string state_filename) {
+  LOG(INFO) << "Snapshotting to " << model_filename;
+  WriteProtoToBinaryFileAtomically(*net_param, model_filename,
+      param_.snapshot_compress());
+  LOG(INFO) << "Snapshotting solver state to " << state_filename;
+  WriteProtoToBinaryFileAtomically(*state, state_filename,
+      param_.snapshot_compress());
+}
+
+template <typename Dtype>
+void Solver<Dtype>::FinishSnapshot() {
+  if (snapshot_thread_) {
+    snapshot_thread_->join();
+    snapshot_thread_.reset();
+  }
 }
 
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
+  FinishSnapshot();
   SolverState state;
   NetParameter net_param;
   ReadProtoFromBinaryFile(state_file, &state);
@@ -629,6 +825,10 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
   ClipGradients();
+  if (this->param_.fused_update() && Caffe::mode() == Caffe::CPU) {
+    FusedApplyUpdate(rate);
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->params().size(); ++param_id) {
     Normalize(param_id);
     Regularize(param_id);
@@ -637,6 +837,49 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedApplyUpdate(Dtype rate) {
+  Net<Dtype>& net = *this->net_;
+  const vector<shared_ptr<Blob<Dtype> > >& net_params = net.params();
+  const vector<float>& net_params_lr = net.params_lr();
+  const vector<float>& net_params_weight_decay = net.params_weight_decay();
+  FusedUpdateParameter<Dtype> param;
+  param.rule = fused_update_rule();
+  param.normalization = Dtype(1.) / this->param_.iter_size();
+  param.momentum = this->param_.momentum();
+  param.delta = this->param_.delta();
+  // The update values of shared parameters are summed into their owner's
+  // before the update, and the debug info is printed before it too, so then
+  // the update is left to Net::Update.
+  param.apply = !net.debug_info();
+  for (int i = 0; i < net_params.size(); ++i) {
+    if (net.param_owners()[i] >= 0) {
+      param.apply = false;
+    }
+  }
+  Dtype weight_decay = this->param_.weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  FusedUpdateDecay decay_type;
+  if (regularization_type == "L2") {
+    decay_type = FUSED_DECAY_L2;
+  } else if (regularization_type == "L1") {
+    decay_type = FUSED_DECAY_L1;
+  } else {
+    LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  }
+  for (int param_id = 0; param_id < net_params.size(); ++param_id) {
+    param.decay = weight_decay * net_params_weight_decay[param_id];
+    param.decay_type = param.decay ? decay_type : FUSED_DECAY_NONE;
+    param.rate = rate * net_params_lr[param_id];
+    Blob<Dtype>* blob = net_params[param_id].get();
+    caffe_cpu_fused_update(blob->count(), param, blob->mutable_cpu_data(),
+        blob->mutable_cpu_diff(), history_[param_id]->mutable_cpu_data());
+  }
+  if (!param.apply) {
+    net.Update();
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -1,3 +1,6 @@
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
 #include <string>
 #include <vector>
 
@@ -72,6 +75,41 @@ class DataTransformTest : public ::testing::Test {
     return num_sequence_matches;
   }
 
+  // Transforms the same video frames with TransformFrames and with
+  // Transform on the Datum FramesToDatum builds, with the same seed, and
+  // checks that the outputs match.
+  void ExpectFramesMatchDatum(const TransformationParameter& transform_param,
+      Phase phase) {
+    const int height = 20;
+    const int width = 24;
+    vector<cv::Mat> frames;
+    frames.push_back(cv::Mat(height, width, CV_8UC3));
+    frames.push_back(cv::Mat(height, width, CV_8UC1));
+    frames.push_back(cv::Mat(height, width, CV_8UC1));
+    for (int i = 0; i < frames.size(); ++i) {
+      cv::randu(frames[i], cv::Scalar::all(0), cv::Scalar::all(256));
+    }
+    Datum datum;
+    FramesToDatum(frames, 0, &datum);
+    ASSERT_EQ(5, datum.channels());
+
+    DataTransformer<Dtype> frames_transformer(transform_param, phase);
+    DataTransformer<Dtype> datum_transformer(transform_param, phase);
+    frames_transformer.InitRand(seed_);
+    datum_transformer.InitRand(seed_);
+    vector<int> shape = frames_transformer.InferFramesBlobShape(frames);
+    EXPECT_TRUE(shape == datum_transformer.InferBlobShape(datum));
+    Blob<Dtype> frames_blob(shape);
+    Blob<Dtype> datum_blob(shape);
+    for (int iter = 0; iter < num_iter_; ++iter) {
+      frames_transformer.TransformFrames(frames, &frames_blob);
+      datum_transformer.Transform(datum, &datum_blob);
+      for (int j = 0; j < datum_blob.count(); ++j) {
+        EXPECT_EQ(datum_blob.cpu_data()[j], frames_blob.cpu_data()[j]);
+      }
+    }
+  }
+
   virtual ~DataTransformTest() { }
 
   int seed_;
@@ -352,4 +390,69 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestFramesMatchDatum) {
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(16);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.5);
+  this->ExpectFramesMatchDatum(transform_param, TRAIN);
+  this->ExpectFramesMatchDatum(transform_param, TEST);
+}
+
+TYPED_TEST(DataTransformTest, TestFramesMatchDatumMultiScale) {
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(16);
+  transform_param.set_mirror(true);
+  transform_param.set_multi_scale(true);
+  transform_param.set_is_flow(true);
+  for (int c = 0; c < 5; ++c) {
+    transform_param.add_mean_value(100 + c);
+  }
+  this->ExpectFramesMatchDatum(transform_param, TRAIN);
+  transform_param.set_fix_crop(true);
+  transform_param.set_more_fix_crop(true);
+  this->ExpectFramesMatchDatum(transform_param, TRAIN);
+}
+
+TYPED_TEST(DataTransformTest, TestFramesMatchDatumRF) {
+  TransformationParameter transform_param;
+  transform_param.set_mirror(true);
+  transform_param.set_is_RF(true);
+  transform_param.add_mean_value(128);
+  this->ExpectFramesMatchDatum(transform_param, TRAIN);
+}
+
+TYPED_TEST(DataTransformTest, TestMultiScaleMatchesPerChannelResize) {
+  // A single 1.0 scale ratio on a square datum crops the whole of it, so the
+  // output is every channel resized on its own to crop_size.
+  TransformationParameter transform_param;
+  const int channels = 10;
+  const int size = 20;
+  const int crop_size = 12;
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_multi_scale(true);
+  transform_param.add_scale_ratios(1.0);
+  Datum datum;
+  FillDatum(0, channels, size, size, true, &datum);
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  transformer.Transform(datum, &blob);
+  for (int c = 0; c < channels; ++c) {
+    cv::Mat plane(size, size, CV_8UC1);
+    for (int h = 0; h < size; ++h) {
+      for (int w = 0; w < size; ++w) {
+        plane.at<uchar>(h, w) = datum.data()[(c * size + h) * size + w];
+      }
+    }
+    cv::Mat resized;
+    cv::resize(plane, resized, cv::Size(crop_size, crop_size));
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        EXPECT_EQ(resized.at<uchar>(h, w), blob.data_at(0, c, h, w));
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,128 @@
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/decode_pool.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Builds frames whose pixels depend on the item, so that every slot of the
+// batch is different.
+struct FakeItemReader {
+  FakeItemReader(int channels, int height, int width, int failing_item)
+      : channels_(channels), height_(height), width_(width),
+        failing_item_(failing_item) {}
+
+  bool operator()(int item_id, vector<cv::Mat>* frames) const {
+    if (item_id == failing_item_) {
+      return false;
+    }
+    frames->clear();
+    for (int c = 0; c < channels_; ++c) {
+      cv::Mat frame(height_, width_, CV_8UC1);
+      for (int h = 0; h < height_; ++h) {
+        for (int w = 0; w < width_; ++w) {
+          const int j = (c * height_ + h) * width_ + w;
+          frame.at<uchar>(h, w) = static_cast<uchar>((item_id * 7 + j) % 256);
+        }
+      }
+      frames->push_back(frame);
+    }
+    return true;
+  }
+
+  int channels_, height_, width_;
+  int failing_item_;
+};
+
+template <typename Dtype>
+class DecodePoolTest : public ::testing::Test {
+ protected:
+  DecodePoolTest()
+      : seed_(1701), num_(8), channels_(3), height_(10), width_(12),
+        crop_size_(6) {}
+
+  // Fills num_batches batches in turn with one pool of num_threads workers,
+  // seeded with seed_, and keeps the last one.
+  void FillBatches(int num_threads, int num_batches, int failing_item,
+      Blob<Dtype>* batch) {
+    TransformationParameter transform_param;
+    transform_param.set_mirror(true);
+    transform_param.set_crop_size(crop_size_);
+    Caffe::set_random_seed(seed_);
+    DecodePool<Dtype> pool(transform_param, TRAIN, num_threads);
+    EXPECT_EQ(num_threads, pool.num_threads());
+    for (int i = 0; i < num_batches; ++i) {
+      batch->Reshape(num_, channels_, crop_size_, crop_size_);
+      caffe_set(batch->count(), Dtype(-1), batch->mutable_cpu_data());
+      pool.Run(FakeItemReader(channels_, height_, width_, failing_item),
+          batch);
+    }
+  }
+
+  void FillBatch(int num_threads, int failing_item, Blob<Dtype>* batch) {
+    FillBatches(num_threads, 1, failing_item, batch);
+  }
+
+  int seed_;
+  int num_, channels_, height_, width_;
+  int crop_size_;
+};
+
+TYPED_TEST_CASE(DecodePoolTest, TestDtypes);
+
+TYPED_TEST(DecodePoolTest, TestFillsEverySlot) {
+  Blob<TypeParam> batch;
+  this->FillBatch(1, -1, &batch);
+  for (int i = 0; i < batch.count(); ++i) {
+    EXPECT_GE(batch.cpu_data()[i], 0);
+  }
+}
+
+TYPED_TEST(DecodePoolTest, TestDeterministicAcrossThreads) {
+  Blob<TypeParam> batch_serial;
+  Blob<TypeParam> batch_parallel;
+  this->FillBatch(1, -1, &batch_serial);
+  this->FillBatch(4, -1, &batch_parallel);
+  ASSERT_EQ(batch_serial.count(), batch_parallel.count());
+  for (int i = 0; i < batch_serial.count(); ++i) {
+    EXPECT_EQ(batch_serial.cpu_data()[i], batch_parallel.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(DecodePoolTest, TestWorkersKeptAcrossBatches) {
+  Blob<TypeParam> batch_serial;
+  Blob<TypeParam> batch_parallel;
+  this->FillBatches(1, 3, -1, &batch_serial);
+  this->FillBatches(4, 3, -1, &batch_parallel);
+  ASSERT_EQ(batch_serial.count(), batch_parallel.count());
+  for (int i = 0; i < batch_serial.count(); ++i) {
+    EXPECT_EQ(batch_serial.cpu_data()[i], batch_parallel.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(DecodePoolTest, TestFailedItemIsSkipped) {
+  const int failing_item = 3;
+  Blob<TypeParam> batch;
+  this->FillBatch(3, failing_item, &batch);
+  for (int n = 0; n < batch.num(); ++n) {
+    for (int i = 0; i < batch.count(1); ++i) {
+      const TypeParam value = batch.cpu_data()[batch.offset(n) + i];
+      if (n == failing_item) {
+        EXPECT_EQ(value, -1);
+      } else {
+        EXPECT_GE(value, 0);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
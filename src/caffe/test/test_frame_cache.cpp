@@ -0,0 +1,88 @@
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/frame_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FrameCacheTest : public ::testing::Test {
+ protected:
+  // A 10 x 10 single channel frame, 100 bytes.
+  cv::Mat MakeFrame(int value) {
+    return cv::Mat(10, 10, CV_8UC1, cv::Scalar(value));
+  }
+};
+
+TEST_F(FrameCacheTest, TestLookup) {
+  LocalFrameCache cache(1000);
+  cv::Mat frame;
+  EXPECT_FALSE(cache.Lookup("a", &frame));
+  cache.Insert("a", MakeFrame(1));
+  ASSERT_TRUE(cache.Lookup("a", &frame));
+  EXPECT_EQ(1, frame.at<uint8_t>(5, 5));
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  EXPECT_FLOAT_EQ(0.5, cache.hit_rate());
+  EXPECT_EQ(1, cache.num_frames());
+  EXPECT_EQ(100, cache.size_bytes());
+}
+
+TEST_F(FrameCacheTest, TestEvictLeastRecentlyUsed) {
+  LocalFrameCache cache(300);
+  cache.Insert("a", MakeFrame(1));
+  cache.Insert("b", MakeFrame(2));
+  cache.Insert("c", MakeFrame(3));
+  cv::Mat frame;
+  // "a" becomes the most recently used, so "b" goes first.
+  ASSERT_TRUE(cache.Lookup("a", &frame));
+  cache.Insert("d", MakeFrame(4));
+  EXPECT_EQ(3, cache.num_frames());
+  EXPECT_EQ(300, cache.size_bytes());
+  EXPECT_EQ(1, cache.evictions());
+  EXPECT_FALSE(cache.Lookup("b", &frame));
+  EXPECT_TRUE(cache.Lookup("a", &frame));
+  EXPECT_TRUE(cache.Lookup("c", &frame));
+  EXPECT_TRUE(cache.Lookup("d", &frame));
+  // Shrinking evicts down to the new budget.
+  cache.set_capacity_bytes(100);
+  EXPECT_EQ(1, cache.num_frames());
+  EXPECT_TRUE(cache.Lookup("d", &frame));
+}
+
+TEST_F(FrameCacheTest, TestSkipTooLarge) {
+  LocalFrameCache cache(150);
+  cache.Insert("a", MakeFrame(1));
+  cache.Insert("big", cv::Mat(20, 10, CV_8UC1, cv::Scalar(0)));
+  cv::Mat frame;
+  EXPECT_FALSE(cache.Lookup("big", &frame));
+  // The frames already cached are kept.
+  EXPECT_TRUE(cache.Lookup("a", &frame));
+  EXPECT_EQ(0, cache.evictions());
+}
+
+TEST_F(FrameCacheTest, TestInsertTwice) {
+  LocalFrameCache cache(1000);
+  cache.Insert("a", MakeFrame(1));
+  cache.Insert("a", MakeFrame(2));
+  cv::Mat frame;
+  ASSERT_TRUE(cache.Lookup("a", &frame));
+  EXPECT_EQ(1, frame.at<uint8_t>(0, 0));
+  EXPECT_EQ(100, cache.size_bytes());
+}
+
+TEST_F(FrameCacheTest, TestGlobal) {
+  shared_ptr<FrameCache> cache = FrameCache::Global(100);
+  EXPECT_EQ(cache, FrameCache::Global(50));
+  EXPECT_GE(cache->capacity_bytes(), 100);
+  const size_t grown = cache->capacity_bytes() + 100;
+  EXPECT_EQ(cache, FrameCache::Global(grown));
+  EXPECT_EQ(grown, cache->capacity_bytes());
+}
+
+}  // namespace caffe
@@ -0,0 +1,239 @@
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/highgui/highgui_c.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/frame_cache.hpp"
+#include "caffe/util/frame_pack.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FramePackTest : public ::testing::Test {
+ protected:
+  FramePackTest()
+      : cat_(EXAMPLES_SOURCE_DIR "images/cat.jpg"),
+        fish_bike_(EXAMPLES_SOURCE_DIR "images/fish-bike.jpg") {}
+
+  virtual void SetUp() {
+    MakeTempDir(&folder_);
+    pack_ = folder_ + "/video.fpk";
+    // Frame 2 of the image stream is missing.
+    vector<string> streams;
+    vector<vector<string> > frame_files(2);
+    streams.push_back("image");
+    frame_files[0].push_back(cat_);
+    frame_files[0].push_back("");
+    frame_files[0].push_back(fish_bike_);
+    streams.push_back("flow_x");
+    frame_files[1].push_back(fish_bike_);
+    frame_files[1].push_back(cat_);
+    frame_files[1].push_back(cat_);
+    ASSERT_TRUE(WriteFramePack(pack_, streams, frame_files));
+  }
+
+  void CopyFile(const string& from, const string& to) {
+    std::ifstream input(from.c_str(), std::ios::binary);
+    std::ofstream output(to.c_str(), std::ios::binary);
+    output << input.rdbuf();
+  }
+
+  // Writes a copy of the pack with the 8 bytes at position replaced by
+  // value, and returns its path.
+  string CorruptPack(const size_t position, const uint64_t value) {
+    std::ifstream input(pack_.c_str(), std::ios::binary);
+    string bytes((std::istreambuf_iterator<char>(input)),
+        std::istreambuf_iterator<char>());
+    CHECK_LE(position + sizeof(value), bytes.size());
+    memcpy(&bytes[position], &value, sizeof(value));
+    const string corrupted = folder_ + "/corrupted.fpk";
+    std::ofstream output(corrupted.c_str(),
+        std::ios::binary | std::ios::trunc);
+    output.write(bytes.data(), bytes.size());
+    return corrupted;
+  }
+
+  void ExpectSameMat(const cv::Mat& expected, const cv::Mat& actual) {
+    ASSERT_EQ(expected.rows, actual.rows);
+    ASSERT_EQ(expected.cols, actual.cols);
+    ASSERT_EQ(expected.type(), actual.type());
+    EXPECT_EQ(0, cv::countNonZero(expected.reshape(1) != actual.reshape(1)));
+  }
+
+  string cat_, fish_bike_;
+  string folder_, pack_;
+};
+
+TEST_F(FramePackTest, TestOpen) {
+  FramePack pack;
+  EXPECT_FALSE(pack.is_open());
+  ASSERT_TRUE(pack.Open(pack_));
+  EXPECT_TRUE(pack.is_open());
+  EXPECT_EQ(pack_, pack.filename());
+  EXPECT_EQ(3, pack.num_frames());
+  ASSERT_EQ(2, pack.streams().size());
+  EXPECT_EQ("image", pack.streams()[0]);
+  EXPECT_EQ("flow_x", pack.streams()[1]);
+  pack.Close();
+  EXPECT_FALSE(pack.is_open());
+}
+
+TEST_F(FramePackTest, TestOpenNotAPack) {
+  FramePack pack;
+  EXPECT_FALSE(pack.Open(cat_));
+  EXPECT_FALSE(pack.is_open());
+  EXPECT_FALSE(pack.Open(folder_ + "/missing.fpk"));
+}
+
+TEST_F(FramePackTest, TestOpenCorruptedHeader) {
+  // The number of frames and the reserved word, as one word.
+  const size_t num_frames_position = 8;
+  FramePack pack;
+  EXPECT_FALSE(pack.Open(CorruptPack(num_frames_position, 0xffffffffu)));
+  EXPECT_FALSE(pack.is_open());
+}
+
+TEST_F(FramePackTest, TestOpenCorruptedIndex) {
+  // The index follows the header and the names of the two streams.
+  const size_t index_position = 16 + 2 * kFramePackNameSize;
+  const uint64_t max_value = ~static_cast<uint64_t>(0);
+  FramePack pack;
+  // An offset + size that wraps around.
+  EXPECT_FALSE(pack.Open(CorruptPack(index_position, max_value - 1)));
+  // A size that runs past the end of the file.
+  EXPECT_FALSE(pack.Open(CorruptPack(index_position + 8, max_value / 2)));
+  // A frame inside the index.
+  EXPECT_FALSE(pack.Open(CorruptPack(index_position, 0)));
+  EXPECT_FALSE(pack.is_open());
+}
+
+TEST_F(FramePackTest, TestPackCache) {
+  const string other_pack = folder_ + "/other.fpk";
+  CopyFile(pack_, other_pack);
+  FramePackCache cache(1);
+  shared_ptr<const FramePack> pack = cache.Open(pack_);
+  ASSERT_TRUE(pack);
+  EXPECT_EQ(pack.get(), cache.Open(pack_).get());
+  EXPECT_EQ(1, cache.size());
+  // Evicts the first pack, which stays mapped while it is held.
+  shared_ptr<const FramePack> other = cache.Open(other_pack);
+  ASSERT_TRUE(other);
+  EXPECT_EQ(1, cache.size());
+  EXPECT_TRUE(pack->is_open());
+  ExpectSameMat(cv::imread(cat_, CV_LOAD_IMAGE_COLOR),
+      pack->DecodeFrame("image", 1, CV_LOAD_IMAGE_COLOR));
+  EXPECT_NE(pack.get(), cache.Open(pack_).get());
+  EXPECT_FALSE(cache.Open(folder_ + "/missing.fpk"));
+}
+
+TEST_F(FramePackTest, TestDecodeFrame) {
+  FramePack pack;
+  ASSERT_TRUE(pack.Open(pack_));
+  ExpectSameMat(cv::imread(cat_, CV_LOAD_IMAGE_COLOR),
+      pack.DecodeFrame("image", 1, CV_LOAD_IMAGE_COLOR));
+  ExpectSameMat(cv::imread(fish_bike_, CV_LOAD_IMAGE_COLOR),
+      pack.DecodeFrame("image", 3, CV_LOAD_IMAGE_COLOR));
+  ExpectSameMat(cv::imread(cat_, CV_LOAD_IMAGE_GRAYSCALE),
+      pack.DecodeFrame("flow_x", 2, CV_LOAD_IMAGE_GRAYSCALE));
+}
+
+TEST_F(FramePackTest, TestDecodeMissingFrame) {
+  FramePack pack;
+  ASSERT_TRUE(pack.Open(pack_));
+  EXPECT_FALSE(pack.DecodeFrame("image", 2, CV_LOAD_IMAGE_COLOR).data);
+  EXPECT_FALSE(pack.DecodeFrame("image", 0, CV_LOAD_IMAGE_COLOR).data);
+  EXPECT_FALSE(pack.DecodeFrame("image", 4, CV_LOAD_IMAGE_COLOR).data);
+  EXPECT_FALSE(pack.DecodeFrame("flow_y", 1, CV_LOAD_IMAGE_COLOR).data);
+}
+
+TEST_F(FramePackTest, TestReadSegmentMatchesFrames) {
+  // The same frames, one file each.
+  CopyFile(cat_, folder_ + "/image_0001.jpg");
+  CopyFile(fish_bike_, folder_ + "/image_0003.jpg");
+  FramePack pack;
+  ASSERT_TRUE(pack.Open(pack_));
+  vector<int> offsets;
+  offsets.push_back(0);
+  offsets.push_back(2);
+  Datum datum_pack, datum_frames;
+  ASSERT_TRUE(ReadSegmentRGBToDatum(pack, 5, offsets, 64, 48, 1,
+      &datum_pack, true));
+  ASSERT_TRUE(ReadSegmentRGBToDatum(folder_, 5, offsets, 64, 48, 1,
+      &datum_frames, true));
+  EXPECT_EQ(datum_frames.channels(), datum_pack.channels());
+  EXPECT_EQ(datum_frames.height(), datum_pack.height());
+  EXPECT_EQ(datum_frames.width(), datum_pack.width());
+  EXPECT_EQ(datum_frames.label(), datum_pack.label());
+  EXPECT_TRUE(datum_frames.data() == datum_pack.data());
+  // Frame 2 is not in the pack.
+  offsets[1] = 1;
+  EXPECT_FALSE(ReadSegmentRGBToDatum(pack, 5, offsets, 64, 48, 1,
+      &datum_pack, true));
+}
+
+TEST_F(FramePackTest, TestReducedDecode) {
+  CopyFile(cat_, folder_ + "/image_0001.jpg");
+  FramePack pack;
+  ASSERT_TRUE(pack.Open(pack_));
+  vector<int> offsets(1, 0);
+  vector<cv::Mat> full, reduced_frames, reduced_pack;
+  ASSERT_TRUE(ReadSegmentRGBToFrames(folder_, offsets, 64, 48, 1, &full,
+      true));
+  ASSERT_TRUE(ReadSegmentRGBToFrames(folder_, offsets, 64, 48, 1,
+      &reduced_frames, true, true));
+  ASSERT_TRUE(ReadSegmentRGBToFrames(pack, offsets, 64, 48, 1,
+      &reduced_pack, true, true));
+  ASSERT_EQ(1, full.size());
+  ASSERT_EQ(1, reduced_frames.size());
+  ASSERT_EQ(1, reduced_pack.size());
+  // Same size, and the same pixels up to the DCT scaling error.
+  ExpectSameMat(reduced_frames[0], reduced_pack[0]);
+  ASSERT_EQ(full[0].rows, reduced_frames[0].rows);
+  ASSERT_EQ(full[0].cols, reduced_frames[0].cols);
+  ASSERT_EQ(full[0].type(), reduced_frames[0].type());
+  const double mean_error = cv::norm(full[0], reduced_frames[0], cv::NORM_L1)
+      / full[0].total() / full[0].channels();
+  EXPECT_LT(mean_error, 8);
+}
+
+
+TEST_F(FramePackTest, TestReadSegmentFrameCache) {
+  FramePack pack;
+  ASSERT_TRUE(pack.Open(pack_));
+  vector<int> offsets(1, 0);
+  LocalFrameCache cache(1 << 20);
+  vector<cv::Mat> uncached, first, second;
+  ASSERT_TRUE(ReadSegmentRGBToFrames(pack, offsets, 64, 48, 1, &uncached,
+      true));
+  ASSERT_TRUE(ReadSegmentRGBToFrames(pack, offsets, 64, 48, 1, &first,
+      true, false, &cache));
+  EXPECT_EQ(0, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  EXPECT_EQ(1, cache.num_frames());
+  ASSERT_TRUE(ReadSegmentRGBToFrames(pack, offsets, 64, 48, 1, &second,
+      true, false, &cache));
+  EXPECT_EQ(1, cache.hits());
+  ASSERT_EQ(1, second.size());
+  ExpectSameMat(uncached[0], first[0]);
+  ExpectSameMat(uncached[0], second[0]);
+  // Another size is another entry.
+  ASSERT_TRUE(ReadSegmentRGBToFrames(pack, offsets, 32, 24, 1, &second,
+      true, false, &cache));
+  EXPECT_EQ(2, cache.misses());
+  EXPECT_EQ(2, cache.num_frames());
+  EXPECT_EQ(32, second[0].rows);
+}
+
+}  // namespace caffe
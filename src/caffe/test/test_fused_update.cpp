@@ -0,0 +1,181 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/fused_update.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class FusedUpdateTest : public ::testing::Test {
+ protected:
+  // Enough to be split over the threads, and not a multiple of the vector
+  // width.
+  FusedUpdateTest() : count_(40009) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    data_.resize(count_);
+    diff_.resize(count_);
+    history_.resize(count_);
+    caffe_rng_gaussian<Dtype>(count_, Dtype(0), Dtype(1), &data_[0]);
+    caffe_rng_gaussian<Dtype>(count_, Dtype(0), Dtype(1), &diff_[0]);
+    caffe_rng_gaussian<Dtype>(count_, Dtype(0), Dtype(1), &history_[0]);
+    // Some exact zeros for the sign of L1.
+    for (int i = 0; i < count_; i += 97) {
+      data_[i] = 0;
+    }
+  }
+
+  // The separate passes of SGDSolver, one step at a time over all the
+  // elements, then Blob::Update.
+  void ReferenceUpdate(const FusedUpdateParameter<Dtype>& param,
+      vector<Dtype>* data, vector<Dtype>* diff, vector<Dtype>* history) {
+    Dtype* w = &(*data)[0];
+    Dtype* g = &(*diff)[0];
+    Dtype* h = &(*history)[0];
+    vector<Dtype> update(count_);
+    Dtype* u = &update[0];
+    for (int i = 0; i < count_; ++i) {
+      g[i] = param.normalization * g[i];
+    }
+    for (int i = 0; i < count_; ++i) {
+      if (param.decay_type == FUSED_DECAY_L2) {
+        g[i] = param.decay * w[i] + g[i];
+      } else if (param.decay_type == FUSED_DECAY_L1) {
+        g[i] = param.decay * Dtype(caffe_sign(w[i])) + g[i];
+      }
+    }
+    switch (param.rule) {
+    case FUSED_UPDATE_SGD:
+      for (int i = 0; i < count_; ++i) {
+        h[i] = param.momentum * h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        h[i] = param.rate * g[i] + h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        g[i] = h[i];
+      }
+      break;
+    case FUSED_UPDATE_NESTEROV:
+      for (int i = 0; i < count_; ++i) {
+        u[i] = h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        h[i] = param.momentum * h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        h[i] = param.rate * g[i] + h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        u[i] = -param.momentum * u[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        u[i] = (Dtype(1) + param.momentum) * h[i] + u[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        g[i] = u[i];
+      }
+      break;
+    case FUSED_UPDATE_ADAGRAD:
+      for (int i = 0; i < count_; ++i) {
+        u[i] = std::pow(g[i], Dtype(2));
+      }
+      for (int i = 0; i < count_; ++i) {
+        h[i] = u[i] + h[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        u[i] = std::pow(h[i], Dtype(0.5));
+      }
+      for (int i = 0; i < count_; ++i) {
+        u[i] += param.delta;
+      }
+      for (int i = 0; i < count_; ++i) {
+        u[i] = g[i] / u[i];
+      }
+      for (int i = 0; i < count_; ++i) {
+        g[i] = param.rate * u[i];
+      }
+      break;
+    }
+    if (param.apply) {
+      for (int i = 0; i < count_; ++i) {
+        w[i] = Dtype(-1) * g[i] + w[i];
+      }
+    }
+  }
+
+  void CheckUpdate(const FusedUpdateRule rule,
+      const FusedUpdateDecay decay_type, const bool apply) {
+    FusedUpdateParameter<Dtype> param;
+    param.rule = rule;
+    param.decay_type = decay_type;
+    param.normalization = Dtype(1) / 3;
+    param.decay = 0.0005;
+    param.rate = 0.01;
+    param.momentum = (rule == FUSED_UPDATE_ADAGRAD) ? 0 : 0.9;
+    param.delta = 1e-8;
+    param.apply = apply;
+    if (rule == FUSED_UPDATE_ADAGRAD) {
+      for (int i = 0; i < count_; ++i) {
+        history_[i] = std::fabs(history_[i]);
+      }
+    }
+    vector<Dtype> data(data_), diff(diff_), history(history_);
+    ReferenceUpdate(param, &data, &diff, &history);
+    caffe_cpu_fused_update(count_, param, &data_[0], &diff_[0],
+        &history_[0]);
+    for (int i = 0; i < count_; ++i) {
+      EXPECT_EQ(data[i], data_[i]);
+      EXPECT_EQ(diff[i], diff_[i]);
+      EXPECT_EQ(history[i], history_[i]);
+    }
+  }
+
+  const int count_;
+  vector<Dtype> data_;
+  vector<Dtype> diff_;
+  vector<Dtype> history_;
+};
+
+TYPED_TEST_CASE(FusedUpdateTest, TestDtypes);
+
+TYPED_TEST(FusedUpdateTest, TestSGD) {
+  this->CheckUpdate(FUSED_UPDATE_SGD, FUSED_DECAY_NONE, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestSGDL2) {
+  this->CheckUpdate(FUSED_UPDATE_SGD, FUSED_DECAY_L2, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestSGDL1) {
+  this->CheckUpdate(FUSED_UPDATE_SGD, FUSED_DECAY_L1, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestSGDNoApply) {
+  this->CheckUpdate(FUSED_UPDATE_SGD, FUSED_DECAY_L2, false);
+}
+
+TYPED_TEST(FusedUpdateTest, TestNesterovL2) {
+  this->CheckUpdate(FUSED_UPDATE_NESTEROV, FUSED_DECAY_L2, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestNesterovL1) {
+  this->CheckUpdate(FUSED_UPDATE_NESTEROV, FUSED_DECAY_L1, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestAdaGradL2) {
+  this->CheckUpdate(FUSED_UPDATE_ADAGRAD, FUSED_DECAY_L2, true);
+}
+
+TYPED_TEST(FusedUpdateTest, TestAdaGradL1) {
+  this->CheckUpdate(FUSED_UPDATE_ADAGRAD, FUSED_DECAY_L1, true);
+}
+
+}  // namespace caffe
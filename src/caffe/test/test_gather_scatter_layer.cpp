@@ -0,0 +1,108 @@
+#ifdef USE_MPI
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mpi_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// These run the MPI path of the layers in CPU mode, with any number of
+// ranks, e.g. mpirun -np 4 test.testbin --gtest_filter='GatherScatter*'.
+template <typename Dtype>
+class GatherScatterLayerTest : public ::testing::Test {
+ protected:
+  GatherScatterLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 1, 1)),
+        blob_gathered_(new Blob<Dtype>()),
+        blob_scattered_(new Blob<Dtype>()) {
+    Caffe::set_mode(Caffe::CPU);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+    MPI_Comm_size(MPI_COMM_WORLD, &size_);
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      blob_bottom_->mutable_cpu_data()[i] = Value(rank_, i);
+    }
+  }
+
+  virtual void SetUp() {
+    parallel_mode_ = Caffe::parallel_mode();
+    Caffe::set_parallel_mode(Caffe::MPI);
+  }
+
+  virtual void TearDown() {
+    Caffe::set_parallel_mode(parallel_mode_);
+  }
+
+  virtual ~GatherScatterLayerTest() {
+    delete blob_bottom_;
+    delete blob_gathered_;
+    delete blob_scattered_;
+  }
+
+  static Dtype Value(int rank, int i) {
+    return Dtype(rank * 100 + i);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_gathered_;
+  Blob<Dtype>* const blob_scattered_;
+  int rank_;
+  int size_;
+  Caffe::PARALLEL_MODE parallel_mode_;
+};
+
+TYPED_TEST_CASE(GatherScatterLayerTest, TestDtypes);
+
+TYPED_TEST(GatherScatterLayerTest, TestAllreduce) {
+  vector<TypeParam> data(5);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = this->Value(this->rank_, i);
+  }
+  caffe_iallreduce(&data[0], static_cast<int>(data.size()));
+  mpi_force_synchronize();
+  for (int i = 0; i < data.size(); ++i) {
+    TypeParam expected = 0;
+    for (int r = 0; r < this->size_; ++r) {
+      expected += this->Value(r, i);
+    }
+    EXPECT_EQ(expected, data[i]);
+  }
+}
+
+TYPED_TEST(GatherScatterLayerTest, TestGatherScatter) {
+  LayerParameter layer_param;
+  GatherLayer<TypeParam> gather(layer_param);
+  vector<Blob<TypeParam>*> bottom(1, this->blob_bottom_);
+  vector<Blob<TypeParam>*> gathered(1, this->blob_gathered_);
+  gather.SetUp(bottom, gathered);
+  EXPECT_EQ(2 * this->size_, this->blob_gathered_->num());
+  gather.Forward(bottom, gathered);
+  const int count = this->blob_bottom_->count();
+  for (int r = 0; r < this->size_; ++r) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(this->Value(r, i),
+          this->blob_gathered_->cpu_data()[r * count + i]);
+    }
+  }
+
+  // Scattering the gathered blob gives every rank its part back.
+  ScatterLayer<TypeParam> scatter(layer_param);
+  vector<Blob<TypeParam>*> scattered(1, this->blob_scattered_);
+  scatter.SetUp(gathered, scattered);
+  EXPECT_EQ(2, this->blob_scattered_->num());
+  scatter.Forward(gathered, scattered);
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(this->Value(this->rank_, i), this->blob_scattered_->cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
+
+#endif  // USE_MPI
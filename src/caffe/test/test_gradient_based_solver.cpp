@@ -23,11 +23,13 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
 
  protected:
   GradientBasedSolverTest() :
-      seed_(1701), num_(4), channels_(3), height_(10), width_(10) {}
+      seed_(1701), num_(4), channels_(3), height_(10), width_(10),
+      fused_update_(false) {}
 
   shared_ptr<SGDSolver<Dtype> > solver_;
   int seed_;
   int num_, channels_, height_, width_;
+  bool fused_update_;
   Dtype delta_;  // Stability constant for AdaGrad.
 
   virtual SolverParameter_SolverType solver_type() = 0;
@@ -119,6 +121,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    if (fused_update_) {
+      proto << "fused_update: true ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     this->solver_->Solve();
@@ -315,6 +320,57 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     EXPECT_NEAR(expected_bias, accum_bias, error_margin);
   }
 
+  void CheckFusedUpdate(const Dtype kLearningRate, const Dtype kWeightDecay,
+      const Dtype kMomentum, const int kNumIters, const int kIterSize) {
+    // Solve with the separate passes and save the parameters and history.
+    this->fused_update_ = false;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    const vector<shared_ptr<Blob<Dtype> > >& params =
+        this->solver_->net()->params();
+    const vector<shared_ptr<Blob<Dtype> > >& history =
+        this->solver_->history();
+    vector<shared_ptr<Blob<Dtype> > > expected_params(params.size());
+    vector<shared_ptr<Blob<Dtype> > > expected_history(history.size());
+    for (int i = 0; i < params.size(); ++i) {
+      expected_params[i].reset(new Blob<Dtype>());
+      expected_params[i]->CopyFrom(*params[i], false, true);
+      expected_history[i].reset(new Blob<Dtype>());
+      expected_history[i]->CopyFrom(*history[i], false, true);
+    }
+    // Solve with the fused update. It does the same operations in the same
+    // order, so in double it must match bit for bit. In float the BLAS may
+    // contract its axpy into fused multiply-adds, so allow for the last bits.
+    this->fused_update_ = true;
+    this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum,
+        kNumIters, kIterSize);
+    this->fused_update_ = false;
+    const vector<shared_ptr<Blob<Dtype> > >& fused_params =
+        this->solver_->net()->params();
+    const vector<shared_ptr<Blob<Dtype> > >& fused_history =
+        this->solver_->history();
+    ASSERT_EQ(expected_params.size(), fused_params.size());
+    for (int i = 0; i < fused_params.size(); ++i) {
+      for (int j = 0; j < fused_params[i]->count(); ++j) {
+        ExpectFusedValue(expected_params[i]->cpu_data()[j],
+            fused_params[i]->cpu_data()[j]);
+        ExpectFusedValue(expected_history[i]->cpu_data()[j],
+            fused_history[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  void ExpectFusedValue(const Dtype expected, const Dtype fused) {
+    if (sizeof(Dtype) == sizeof(double)) {
+      EXPECT_EQ(expected, fused);
+    } else {
+      const double kPrecision = 1e-5;
+      const double kMinPrecision = 1e-7;
+      EXPECT_NEAR(expected, fused,
+          std::max(kMinPrecision, kPrecision * std::fabs(expected)));
+    }
+  }
+
   // Test that the correct update is computed for a regularized least squares
   // problem:
   //
@@ -428,6 +484,17 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(SGDSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -482,6 +549,17 @@ TYPED_TEST(AdaGradSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(AdaGradSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 template <typename TypeParam>
 class NesterovSolverTest : public GradientBasedSolverTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -558,4 +636,15 @@ TYPED_TEST(NesterovSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
       kIterSize);
 }
 
+TYPED_TEST(NesterovSolverTest, TestFusedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckFusedUpdate(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
 }  // namespace caffe
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/im2col.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// The shapes with specialized kernels, as kernel size, stride and pad.
+static const int kIm2colShapes[][3] = {
+  {3, 1, 1}, {1, 2, 0}, {5, 1, 2}, {7, 2, 3}, {11, 4, 0}
+};
+
+template <typename Dtype>
+class Im2colCPUKernelTest : public ::testing::Test {
+ protected:
+  // Checks the kernels of the shape against im2col_cpu and col2im_cpu on a
+  // height x width image, which must be exactly the same.
+  void CheckKernels(const int kernel, const int stride, const int pad,
+      const int height, const int width) {
+    const int channels = 3;
+    const int height_col = (height + 2 * pad - kernel) / stride + 1;
+    const int width_col = (width + 2 * pad - kernel) / stride + 1;
+    Blob<Dtype> image(1, channels, height, width);
+    Blob<Dtype> expected(1, channels * kernel * kernel, height_col,
+        width_col);
+    Blob<Dtype> actual;
+    actual.ReshapeLike(expected);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&image);
+    // Garbage in the outputs, which the kernels must overwrite.
+    filler.Fill(&expected);
+    filler.Fill(&actual);
+
+    typename Im2colKernel<Dtype>::Func im2col = GetIm2colKernel<Dtype>(
+        kernel, kernel, pad, pad, stride, stride);
+    EXPECT_NE(&im2col_cpu<Dtype>, im2col);
+    im2col_cpu(image.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride, stride, expected.mutable_cpu_data());
+    im2col(image.cpu_data(), channels, height, width, kernel, kernel, pad,
+        pad, stride, stride, actual.mutable_cpu_data());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], actual.cpu_data()[i]);
+    }
+
+    typename Im2colKernel<Dtype>::Func col2im = GetCol2imKernel<Dtype>(
+        kernel, kernel, pad, pad, stride, stride);
+    EXPECT_NE(&col2im_cpu<Dtype>, col2im);
+    Blob<Dtype> expected_image, actual_image;
+    expected_image.ReshapeLike(image);
+    actual_image.ReshapeLike(image);
+    filler.Fill(&expected_image);
+    filler.Fill(&actual_image);
+    col2im_cpu(expected.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride, stride, expected_image.mutable_cpu_data());
+    col2im(expected.cpu_data(), channels, height, width, kernel, kernel, pad,
+        pad, stride, stride, actual_image.mutable_cpu_data());
+    for (int i = 0; i < image.count(); ++i) {
+      EXPECT_EQ(expected_image.cpu_data()[i], actual_image.cpu_data()[i]);
+    }
+  }
+};
+
+TYPED_TEST_CASE(Im2colCPUKernelTest, TestDtypes);
+
+TYPED_TEST(Im2colCPUKernelTest, TestShapes) {
+  for (int i = 0; i < sizeof(kIm2colShapes) / sizeof(kIm2colShapes[0]);
+      ++i) {
+    const int kernel = kIm2colShapes[i][0];
+    const int stride = kIm2colShapes[i][1];
+    const int pad = kIm2colShapes[i][2];
+    // Odd sizes, which the stride does not divide.
+    this->CheckKernels(kernel, stride, pad, 23, 26);
+  }
+}
+
+TYPED_TEST(Im2colCPUKernelTest, TestSmallImages) {
+  // Images no larger than the kernel, where the padding covers whole rows
+  // of the columns.
+  for (int i = 0; i < sizeof(kIm2colShapes) / sizeof(kIm2colShapes[0]);
+      ++i) {
+    const int kernel = kIm2colShapes[i][0];
+    const int stride = kIm2colShapes[i][1];
+    const int pad = kIm2colShapes[i][2];
+    const int size = std::max(1, kernel - 2 * pad);
+    this->CheckKernels(kernel, stride, pad, size, size + 1);
+  }
+}
+
+TYPED_TEST(Im2colCPUKernelTest, TestGenericShape) {
+  typedef TypeParam Dtype;
+  EXPECT_EQ(&im2col_cpu<Dtype>, GetIm2colKernel<Dtype>(3, 3, 0, 0, 2, 2));
+  EXPECT_EQ(&col2im_cpu<Dtype>, GetCol2imKernel<Dtype>(3, 3, 0, 0, 2, 2));
+  // Both dimensions must match the shape.
+  EXPECT_EQ(&im2col_cpu<Dtype>, GetIm2colKernel<Dtype>(3, 1, 1, 0, 1, 1));
+}
+
+}  // namespace caffe
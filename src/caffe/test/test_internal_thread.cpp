@@ -19,5 +19,22 @@ TEST_F(InternalThreadTest, TestStartAndExit) {
   EXPECT_FALSE(thread.is_started());
 }
 
+// Spins until it is asked to stop.
+class StoppableThread : public InternalThread {
+ protected:
+  virtual void InternalThreadEntry() {
+    while (!must_stop()) {}
+  }
+};
+
+TEST_F(InternalThreadTest, TestStartAndStop) {
+  StoppableThread thread;
+  EXPECT_FALSE(thread.is_started());
+  EXPECT_TRUE(thread.StartInternalThread());
+  EXPECT_TRUE(thread.is_started());
+  EXPECT_TRUE(thread.StopInternalThread());
+  EXPECT_FALSE(thread.is_started());
+}
+
 }  // namespace caffe
 
@@ -0,0 +1,272 @@
+#ifdef USE_MPI
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/channel.hpp"
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/mpi_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class MPIFunctionsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank_);
+    MPI_Comm_size(MPI_COMM_WORLD, &size_);
+    bucket_bytes_ = MPIComm::BucketBytes();
+  }
+
+  virtual void TearDown() {
+    mpi_set_bucket_bytes(bucket_bytes_);
+  }
+
+  static Dtype Value(int rank, int job, int i) {
+    return Dtype(rank * 1000 + job * 100 + i);
+  }
+
+  // Sums one job per count, and checks the sums and the number of MPI calls.
+  void CheckSums(const vector<int>& counts, int expected_calls) {
+    vector<vector<Dtype> > data(counts.size());
+    for (int j = 0; j < counts.size(); ++j) {
+      for (int i = 0; i < counts[j]; ++i) {
+        data[j].push_back(Value(rank_, j, i));
+      }
+    }
+    const int calls = MPIComm::NumAllreduce();
+    for (int j = 0; j < counts.size(); ++j) {
+      caffe_iallreduce(&data[j][0], counts[j]);
+    }
+    mpi_force_synchronize();
+    EXPECT_EQ(expected_calls, MPIComm::NumAllreduce() - calls);
+    for (int j = 0; j < counts.size(); ++j) {
+      for (int i = 0; i < counts[j]; ++i) {
+        Dtype expected = 0;
+        for (int r = 0; r < size_; ++r) {
+          expected += Value(r, j, i);
+        }
+        EXPECT_EQ(expected, data[j][i]) << "job " << j << " element " << i;
+      }
+    }
+  }
+
+  // Sums buffers of several sizes, also empty and smaller than the number
+  // of ranks, with chunks of 3 elements.
+  void CheckAllreducer(AllreduceAlgorithm algorithm) {
+    Allreducer allreducer(MPI_COMM_WORLD, 3 * sizeof(Dtype));
+    const int counts[] = {0, 1, 7, 1000};
+    for (int j = 0; j < sizeof(counts) / sizeof(counts[0]); ++j) {
+      vector<Dtype> data(counts[j] + 1);
+      for (int i = 0; i < counts[j]; ++i) {
+        data[i] = Value(rank_, j, i);
+      }
+      allreducer.Allreduce(&data[0], counts[j], algorithm);
+      for (int i = 0; i < counts[j]; ++i) {
+        Dtype expected = 0;
+        for (int r = 0; r < size_; ++r) {
+          expected += Value(r, j, i);
+        }
+        EXPECT_EQ(expected, data[i]) << "count " << counts[j]
+            << " element " << i;
+      }
+    }
+  }
+
+  int rank_;
+  int size_;
+  size_t bucket_bytes_;
+};
+
+TYPED_TEST_CASE(MPIFunctionsTest, TestDtypes);
+
+TYPED_TEST(MPIFunctionsTest, TestAllreduceUnbucketed) {
+  mpi_set_bucket_bytes(0);
+  vector<int> counts;
+  counts.push_back(3);
+  counts.push_back(5);
+  counts.push_back(40);
+  this->CheckSums(counts, 3);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestAllreduceBucketed) {
+  mpi_set_bucket_bytes(16 * sizeof(TypeParam));
+  vector<int> counts;
+  counts.push_back(3);
+  counts.push_back(5);
+  // Does not fit with the first two: they are reduced together.
+  counts.push_back(10);
+  counts.push_back(1);
+  // Larger than a bucket: reduced alone, after the bucket before it.
+  counts.push_back(40);
+  // Reduced by the final synchronization.
+  counts.push_back(7);
+  this->CheckSums(counts, 4);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestWaitForOwnJob) {
+  mpi_set_bucket_bytes(16 * sizeof(TypeParam));
+  vector<vector<TypeParam> > data(3, vector<TypeParam>(4));
+  for (int j = 0; j < data.size(); ++j) {
+    for (int i = 0; i < data[j].size(); ++i) {
+      data[j][i] = this->Value(this->rank_, j, i);
+    }
+  }
+  // The three sums are packed into one bucket, which waiting on any of them
+  // reduces.
+  vector<MPIJobFuture> sums;
+  for (int j = 0; j < data.size(); ++j) {
+    sums.push_back(caffe_iallreduce(&data[j][0], 4));
+  }
+  sums[1].Wait();
+  EXPECT_TRUE(sums[1].done());
+  for (int j = 0; j < data.size(); ++j) {
+    sums[j].Wait();
+    for (int i = 0; i < data[j].size(); ++i) {
+      TypeParam expected = 0;
+      for (int r = 0; r < this->size_; ++r) {
+        expected += this->Value(r, j, i);
+      }
+      EXPECT_EQ(expected, data[j][i]);
+    }
+  }
+  EXPECT_TRUE(MPIJobFuture().done());
+}
+
+TYPED_TEST(MPIFunctionsTest, TestRingAllreduce) {
+  this->CheckAllreducer(ALLREDUCE_RING);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestHierarchicalAllreduce) {
+  this->CheckAllreducer(ALLREDUCE_HIERARCHICAL);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestAllreduceRingEngine) {
+  mpi_set_allreduce(ALLREDUCE_RING, 4 * sizeof(TypeParam));
+  mpi_set_bucket_bytes(16 * sizeof(TypeParam));
+  vector<int> counts;
+  counts.push_back(3);
+  counts.push_back(5);
+  counts.push_back(40);
+  this->CheckSums(counts, 2);
+  mpi_set_allreduce(ALLREDUCE_MPI, 4 << 20);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestHalfConversion) {
+  const float exact[] = {0.f, 1.f, -2.f, 0.5f, 65504.f, 1.f / (1 << 24)};
+  for (int i = 0; i < sizeof(exact) / sizeof(exact[0]); ++i) {
+    EXPECT_EQ(exact[i], caffe_half_to_float(caffe_float_to_half(exact[i])));
+  }
+  // Ties go to the even mantissa.
+  EXPECT_EQ(1.f, caffe_half_to_float(caffe_float_to_half(1.f + 1.f / 2048)));
+  EXPECT_EQ(1.f + 1.f / 512,
+      caffe_half_to_float(caffe_float_to_half(1.f + 3.f / 2048)));
+  // Too small values flush to zero, too large ones saturate.
+  EXPECT_EQ(0.f, caffe_half_to_float(caffe_float_to_half(1e-8f)));
+  EXPECT_EQ(-65504.f, caffe_half_to_float(caffe_float_to_half(-1e6f)));
+  // Infinities stay infinite, and NaN stays NaN.
+  const float inf = std::numeric_limits<float>::infinity();
+  EXPECT_EQ(inf, caffe_half_to_float(caffe_float_to_half(inf)));
+  EXPECT_EQ(-inf, caffe_half_to_float(caffe_float_to_half(-inf)));
+  const float nan = caffe_half_to_float(
+      caffe_float_to_half(std::numeric_limits<float>::quiet_NaN()));
+  EXPECT_NE(nan, nan);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestFP16Compression) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_FP16);
+  shared_ptr<GradientCompressor> compressor =
+      CreateGradientCompressor<TypeParam>(param);
+  const int count = 100;
+  vector<TypeParam> data(count);
+  for (int i = 0; i < count; ++i) {
+    // Small integers are exact in half floats.
+    data[i] = TypeParam(this->rank_ + i % 13);
+  }
+  caffe_iallreduce_compressed(&data[0], count, compressor.get());
+  mpi_force_synchronize();
+  for (int i = 0; i < count; ++i) {
+    TypeParam expected = 0;
+    for (int r = 0; r < this->size_; ++r) {
+      expected += TypeParam(r + i % 13);
+    }
+    EXPECT_EQ(expected, data[i]);
+  }
+  EXPECT_EQ(count * sizeof(TypeParam), compressor->stats().raw_bytes);
+  EXPECT_EQ(count * sizeof(uint16_t), compressor->stats().sent_bytes);
+}
+
+TYPED_TEST(MPIFunctionsTest, TestTopKErrorFeedback) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_TOPK);
+  param.set_topk_ratio(0.25);
+  shared_ptr<GradientCompressor> compressor =
+      CreateGradientCompressor<TypeParam>(param);
+  // 2 of the 8 elements are sent per sum. The residual sends the rest over
+  // the next 3 sums of zero gradients, so all of the gradient arrives.
+  const int count = 8;
+  vector<TypeParam> total(count, TypeParam(0));
+  for (int call = 0; call < 4; ++call) {
+    vector<TypeParam> data(count, TypeParam(0));
+    for (int i = 0; call == 0 && i < count; ++i) {
+      data[i] = this->Value(this->rank_, 0, i);
+    }
+    compressor->Allreduce(&data[0], count, MPI_COMM_WORLD);
+    int nonzero = 0;
+    for (int i = 0; i < count; ++i) {
+      nonzero += (data[i] != 0);
+      total[i] += data[i];
+    }
+    EXPECT_LE(nonzero, 2 * this->size_);
+  }
+  for (int i = 0; i < count; ++i) {
+    TypeParam expected = 0;
+    for (int r = 0; r < this->size_; ++r) {
+      expected += this->Value(r, 0, i);
+    }
+    EXPECT_EQ(expected, total[i]) << "element " << i;
+  }
+}
+
+TYPED_TEST(MPIFunctionsTest, TestTopKNaN) {
+  GradientCompressionParameter param;
+  param.set_method(GradientCompressionParameter_Method_TOPK);
+  param.set_topk_ratio(0.25);
+  shared_ptr<GradientCompressor> compressor =
+      CreateGradientCompressor<TypeParam>(param);
+  // A diverging rank 0 sends its NaN, which every rank sums like a plain
+  // allreduce would, and the other elements stay finite.
+  const int count = 8;
+  const int nan_index = 3;
+  vector<TypeParam> data(count);
+  for (int i = 0; i < count; ++i) {
+    data[i] = this->Value(this->rank_, 0, i);
+  }
+  if (this->rank_ == 0) {
+    data[nan_index] = std::numeric_limits<TypeParam>::quiet_NaN();
+  }
+  compressor->Allreduce(&data[0], count, MPI_COMM_WORLD);
+  for (int i = 0; i < count; ++i) {
+    if (i == nan_index) {
+      EXPECT_NE(data[i], data[i]);
+    } else {
+      EXPECT_EQ(data[i], data[i]) << "element " << i;
+      EXPECT_LE(std::fabs(data[i]), std::numeric_limits<TypeParam>::max())
+          << "element " << i;
+    }
+  }
+  EXPECT_EQ(2 * (sizeof(int32_t) + sizeof(float)),
+      compressor->stats().sent_bytes);
+}
+
+}  // namespace caffe
+
+#endif  // USE_MPI
@@ -490,8 +490,10 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitDiffDataSharedWeightsNet() {
-    const string& proto =
+  virtual void InitDiffDataSharedWeightsNet(
+      const bool contiguous_params = false) {
+    string proto = contiguous_params ? "contiguous_params: true " : "";
+    proto +=
         "name: 'DiffDataSharedWeightsNetwork' "
         "layer { "
         "  name: 'data' "
@@ -1233,6 +1235,74 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   EXPECT_NE(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
 }
 
+TYPED_TEST(NetTest, TestContiguousParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<Blob<Dtype>*> bottom;
+  // The update of the net with its parameters in separate blobs.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  EXPECT_FALSE(this->net_->has_param_arena());
+  this->net_->ForwardBackward(bottom);
+  vector<shared_ptr<Blob<Dtype> > > expected_diffs;
+  const bool kCopyDiff = true;
+  this->CopyNetParams(kCopyDiff, &expected_diffs);
+  this->net_->Update();
+  vector<shared_ptr<Blob<Dtype> > > expected_params;
+  this->CopyNetParams(!kCopyDiff, &expected_params);
+
+  Caffe::set_random_seed(this->seed_);
+  const bool kContiguousParams = true;
+  this->InitDiffDataSharedWeightsNet(kContiguousParams);
+  ASSERT_TRUE(this->net_->has_param_arena());
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(2, params.size());
+  // The owner comes first, then the diff of the shared parameter.
+  const vector<int>& offsets = this->net_->param_arena_offsets();
+  const int count = params[0]->count();
+  const int padded_count = this->net_->param_arena_owned_count();
+  EXPECT_EQ(0, offsets[0]);
+  EXPECT_EQ(padded_count, offsets[1]);
+  EXPECT_GE(padded_count, count);
+  EXPECT_EQ(0, padded_count * sizeof(Dtype) % 64);
+  EXPECT_EQ(2 * padded_count, this->net_->param_arena_count());
+  Dtype* data = this->net_->mutable_cpu_param_data();
+  Dtype* diff = this->net_->mutable_cpu_param_diff();
+  EXPECT_EQ(data, params[0]->cpu_data());
+  EXPECT_EQ(data, params[1]->cpu_data());
+  EXPECT_EQ(diff, params[0]->cpu_diff());
+  EXPECT_EQ(diff + padded_count, params[1]->cpu_diff());
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(Dtype(0.5), data[i]);
+  }
+
+  // Same diffs and same update through the views.
+  this->net_->ForwardBackward(bottom);
+  for (int p = 0; p < params.size(); ++p) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(expected_diffs[p]->cpu_diff()[i], params[p]->cpu_diff()[i]);
+    }
+  }
+  this->net_->Update();
+  for (int i = 0; i < count; ++i) {
+    EXPECT_EQ(expected_params[0]->cpu_data()[i], params[0]->cpu_data()[i]);
+    EXPECT_EQ(expected_params[1]->cpu_data()[i], params[1]->cpu_data()[i]);
+  }
+  // The padding is never written.
+  data = this->net_->mutable_cpu_param_data();
+  diff = this->net_->mutable_cpu_param_diff();
+  for (int i = count; i < padded_count; ++i) {
+    EXPECT_EQ(0, data[i]);
+    EXPECT_EQ(0, diff[i]);
+  }
+
+  this->net_->ClearParamDiffs();
+  for (int p = 0; p < params.size(); ++p) {
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(0, params[p]->cpu_diff()[i]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
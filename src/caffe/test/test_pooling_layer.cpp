@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <cstring>
 #include <vector>
 
@@ -6,6 +8,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -606,6 +609,204 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+// The square 2x2 and 3x3 kernels at stride 2 have fixed CPU kernels, which
+// must match the generic loops exactly, ties and clipped windows included.
+static const int kFixedPoolingShapes[][2] = {{2, 2}, {3, 2}};
+
+template <typename Dtype>
+class PoolingLayerCPUTest : public CPUDeviceTest<Dtype> {
+ protected:
+  PoolingLayerCPUTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 9, 13)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_mask_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    // Few distinct values, so that most windows have ties.
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      blob_bottom_->mutable_cpu_data()[i] = (i * 7) % 5 - Dtype(2);
+    }
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~PoolingLayerCPUTest() {
+    Caffe::set_cpu_threads(1);
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_mask_;
+  }
+
+  // Runs a kernel x kernel pooling at the stride forward and backward, with
+  // the top mask for max pooling, and checks the outputs against a direct
+  // computation.
+  void CheckPooling(const PoolingParameter_PoolMethod pool, const int kernel,
+      const int stride) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kernel);
+    pooling_param->set_stride(stride);
+    pooling_param->set_pool(pool);
+    const bool max_pool = pool == PoolingParameter_PoolMethod_MAX;
+    if (max_pool) {
+      blob_top_vec_.push_back(blob_top_mask_);
+    }
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      blob_top_->mutable_cpu_diff()[i] = i % 11 - Dtype(5);
+    }
+    vector<bool> propagate_down(1, true);
+    layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+
+    const int height = blob_bottom_->height();
+    const int width = blob_bottom_->width();
+    Blob<Dtype> bottom_diff;
+    bottom_diff.ReshapeLike(*blob_bottom_);
+    caffe_set(bottom_diff.count(), Dtype(0), bottom_diff.mutable_cpu_diff());
+    for (int n = 0; n < blob_top_->num(); ++n) {
+      for (int c = 0; c < blob_top_->channels(); ++c) {
+        const Dtype* bottom_data = blob_bottom_->cpu_data() +
+            blob_bottom_->offset(n, c);
+        Dtype* expected_diff = bottom_diff.mutable_cpu_diff() +
+            blob_bottom_->offset(n, c);
+        for (int ph = 0; ph < blob_top_->height(); ++ph) {
+          for (int pw = 0; pw < blob_top_->width(); ++pw) {
+            const int hstart = ph * stride;
+            const int wstart = pw * stride;
+            const int hend = std::min(hstart + kernel, height);
+            const int wend = std::min(wstart + kernel, width);
+            Dtype max_value = -FLT_MAX;
+            int max_index = -1;
+            Dtype sum = 0;
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                const Dtype value = bottom_data[h * width + w];
+                sum += value;
+                if (value > max_value) {
+                  max_value = value;
+                  max_index = h * width + w;
+                }
+              }
+            }
+            const int pool_size = (hend - hstart) * (wend - wstart);
+            const int top_index = blob_top_->offset(n, c, ph, pw);
+            const Dtype top_diff = blob_top_->cpu_diff()[top_index];
+            if (max_pool) {
+              EXPECT_EQ(max_value, blob_top_->cpu_data()[top_index]);
+              EXPECT_EQ(max_index, blob_top_mask_->cpu_data()[top_index]);
+              expected_diff[max_index] += top_diff;
+            } else {
+              EXPECT_EQ(sum / pool_size, blob_top_->cpu_data()[top_index]);
+              for (int h = hstart; h < hend; ++h) {
+                for (int w = wstart; w < wend; ++w) {
+                  expected_diff[h * width + w] += top_diff / pool_size;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      EXPECT_EQ(bottom_diff.cpu_diff()[i], blob_bottom_->cpu_diff()[i]);
+    }
+    if (max_pool) {
+      blob_top_vec_.pop_back();
+    }
+  }
+
+  // Checks that pooling on threads gives exactly the outputs and gradients
+  // of pooling on one thread.
+  void CheckThreadedPooling(const PoolingParameter_PoolMethod pool,
+      const int kernel, const int stride) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kernel);
+    pooling_param->set_stride(stride);
+    pooling_param->set_pool(pool);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<bool> propagate_down(1, true);
+    Blob<Dtype> expected_top, expected_bottom;
+    for (int threads = 1; threads <= 4; threads += 3) {
+      Caffe::set_cpu_threads(threads);
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      caffe_copy(blob_top_->count(), blob_top_->cpu_data(),
+          blob_top_->mutable_cpu_diff());
+      layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+      if (threads == 1) {
+        expected_top.CopyFrom(*blob_top_, false, true);
+        expected_bottom.CopyFrom(*blob_bottom_, true, true);
+        continue;
+      }
+      for (int i = 0; i < blob_top_->count(); ++i) {
+        EXPECT_EQ(expected_top.cpu_data()[i], blob_top_->cpu_data()[i]);
+      }
+      for (int i = 0; i < blob_bottom_->count(); ++i) {
+        EXPECT_EQ(expected_bottom.cpu_diff()[i], blob_bottom_->cpu_diff()[i]);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_mask_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(PoolingLayerCPUTest, TestDtypes);
+
+TYPED_TEST(PoolingLayerCPUTest, TestFixedShapes) {
+  for (int i = 0; i < 2; ++i) {
+    const int kernel = kFixedPoolingShapes[i][0];
+    const int stride = kFixedPoolingShapes[i][1];
+    this->CheckPooling(PoolingParameter_PoolMethod_MAX, kernel, stride);
+    this->CheckPooling(PoolingParameter_PoolMethod_AVE, kernel, stride);
+  }
+}
+
+TYPED_TEST(PoolingLayerCPUTest, TestGenericShape) {
+  this->CheckPooling(PoolingParameter_PoolMethod_MAX, 3, 1);
+  this->CheckPooling(PoolingParameter_PoolMethod_AVE, 3, 1);
+}
+
+TYPED_TEST(PoolingLayerCPUTest, TestThreaded) {
+  for (int i = 0; i < 2; ++i) {
+    const int kernel = kFixedPoolingShapes[i][0];
+    const int stride = kFixedPoolingShapes[i][1];
+    this->CheckThreadedPooling(PoolingParameter_PoolMethod_MAX, kernel,
+        stride);
+    this->CheckThreadedPooling(PoolingParameter_PoolMethod_AVE, kernel,
+        stride);
+  }
+  this->CheckThreadedPooling(PoolingParameter_PoolMethod_AVE, 3, 1);
+}
+
+TYPED_TEST(PoolingLayerCPUTest, TestGradientFixedShapes) {
+  typedef TypeParam Dtype;
+  this->blob_bottom_->Reshape(1, 2, 7, 11);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int i = 0; i < 2; ++i) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kFixedPoolingShapes[i][0]);
+    pooling_param->set_stride(kFixedPoolingShapes[i][1]);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> max_layer(layer_param);
+    GradientChecker<Dtype> max_checker(1e-4, 1e-2);
+    max_checker.CheckGradientExhaustive(&max_layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+    PoolingLayer<Dtype> ave_layer(layer_param);
+    GradientChecker<Dtype> ave_checker(1e-2, 1e-2);
+    ave_checker.CheckGradientExhaustive(&ave_layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -0,0 +1,184 @@
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/raw_weights.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class RawWeightsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    const string& proto =
+        "name: 'TestNetwork' "
+        "input: 'data' "
+        "input_shape { dim: 2 dim: 3 dim: 4 dim: 5 } "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 7 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'innerprod' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'innerprod' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &net_param_));
+    net_.reset(new Net<Dtype>(net_param_));
+    net_->ToProto(&trained_param_);
+    MakeTempDir(&folder_);
+    filename_ = folder_ + "/weights.raw";
+    ASSERT_TRUE(WriteRawWeights(filename_, trained_param_));
+  }
+
+  void ExpectSameParams(const Net<Dtype>& expected, const Net<Dtype>& actual) {
+    ASSERT_EQ(expected.params().size(), actual.params().size());
+    for (int i = 0; i < expected.params().size(); ++i) {
+      const Blob<Dtype>& expected_blob = *expected.params()[i];
+      const Blob<Dtype>& actual_blob = *actual.params()[i];
+      ASSERT_EQ(expected_blob.shape(), actual_blob.shape());
+      for (int j = 0; j < expected_blob.count(); ++j) {
+        EXPECT_EQ(static_cast<float>(expected_blob.cpu_data()[j]),
+            actual_blob.cpu_data()[j]);
+      }
+    }
+  }
+
+  NetParameter net_param_;
+  NetParameter trained_param_;
+  shared_ptr<Net<Dtype> > net_;
+  string folder_, filename_;
+};
+
+TYPED_TEST_CASE(RawWeightsTest, TestDtypes);
+
+TYPED_TEST(RawWeightsTest, TestRoundTrip) {
+  EXPECT_TRUE(IsRawWeightsFile(this->filename_));
+  const string caffemodel = this->folder_ + "/weights.caffemodel";
+  WriteProtoToBinaryFile(this->trained_param_, caffemodel);
+  EXPECT_FALSE(IsRawWeightsFile(caffemodel));
+
+  RawWeights weights;
+  ASSERT_TRUE(weights.Open(this->filename_));
+  ASSERT_EQ(2, weights.index().layer(0).blobs_size());
+  EXPECT_EQ(0, weights.index().layer(0).blobs(0).data_size());
+  EXPECT_EQ(0, weights.index().layer(1).blobs_size());
+  for (int i = 0; i < weights.index().layer_size(); ++i) {
+    for (int j = 0; j < weights.index().layer(i).blobs_size(); ++j) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(weights.blob_data(i, j)) %
+          kRawWeightsAlignment);
+    }
+  }
+  NetParameter param;
+  weights.ToProto(&param);
+  string expected, actual;
+  ASSERT_TRUE(this->trained_param_.SerializeToString(&expected));
+  ASSERT_TRUE(param.SerializeToString(&actual));
+  EXPECT_EQ(expected, actual);
+}
+
+TYPED_TEST(RawWeightsTest, TestLegacyShape) {
+  NetParameter param;
+  LayerParameter* layer = param.add_layer();
+  layer->set_name("innerprod");
+  BlobProto* blob = layer->add_blobs();
+  blob->set_num(1);
+  blob->set_channels(1);
+  blob->set_height(2);
+  blob->set_width(3);
+  for (int i = 0; i < 6; ++i) {
+    blob->add_data(i);
+  }
+  const string filename = this->folder_ + "/legacy.raw";
+  ASSERT_TRUE(WriteRawWeights(filename, param));
+  RawWeights weights;
+  ASSERT_TRUE(weights.Open(filename));
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(i, weights.blob_data(0, 0)[i]);
+  }
+  // The data must match the shape.
+  blob->add_data(6);
+  EXPECT_FALSE(WriteRawWeights(filename, param));
+}
+
+TYPED_TEST(RawWeightsTest, TestCopy) {
+  typedef TypeParam Dtype;
+  Net<Dtype> net(this->net_param_);
+  net.CopyTrainedLayersFrom(this->filename_);
+  this->ExpectSameParams(*this->net_, net);
+}
+
+TYPED_TEST(RawWeightsTest, TestMap) {
+  typedef TypeParam Dtype;
+  Net<Dtype> net(this->net_param_);
+  net.MapTrainedLayersFrom(this->filename_);
+  this->ExpectSameParams(*this->net_, net);
+}
+
+TYPED_TEST(RawWeightsTest, TestMapInPlace) {
+  typedef TypeParam Dtype;
+  RawWeights weights;
+  ASSERT_TRUE(weights.Open(this->filename_));
+  Net<Dtype> net(this->net_param_);
+  net.CopyTrainedLayersFrom(weights, true);
+  this->ExpectSameParams(*this->net_, net);
+  const int innerprod_id = 2;
+  Blob<Dtype>* blob = net.layer_by_name("innerprod")->blobs()[0].get();
+  const void* mapped_data = weights.blob_data(innerprod_id, 0);
+  if (sizeof(Dtype) == sizeof(float)) {
+    EXPECT_EQ(mapped_data, static_cast<const void*>(blob->cpu_data()));
+  } else {
+    // Doubles are copied.
+    EXPECT_NE(mapped_data, static_cast<const void*>(blob->cpu_data()));
+  }
+  // Writing to the weights does not change the file.
+  const float value = weights.blob_data(innerprod_id, 0)[0];
+  blob->mutable_cpu_data()[0] = value + 1;
+  EXPECT_EQ(Dtype(value + 1), blob->cpu_data()[0]);
+  RawWeights reopened;
+  ASSERT_TRUE(reopened.Open(this->filename_));
+  EXPECT_EQ(value, reopened.blob_data(innerprod_id, 0)[0]);
+}
+
+TYPED_TEST(RawWeightsTest, TestOpenInvalid) {
+  RawWeights weights;
+  const string caffemodel = this->folder_ + "/weights.caffemodel";
+  WriteProtoToBinaryFile(this->trained_param_, caffemodel);
+  EXPECT_FALSE(weights.Open(caffemodel));
+  EXPECT_FALSE(weights.is_open());
+  EXPECT_FALSE(weights.Open(this->folder_ + "/missing.raw"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,150 @@
+#ifdef USE_MPI
+
+#include <mpi.h>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/shared_frame_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SharedFrameCacheTest : public ::testing::Test {
+ protected:
+  SharedFrameCacheTest() {
+    std::ostringstream name;
+    name << "/caffe_test_frame_cache_" << getpid();
+    name_ = name.str();
+  }
+
+  virtual void TearDown() {
+    SharedFrameCache::Unlink(name_);
+  }
+
+  // A 10 x 10 single channel frame, 100 bytes.
+  static cv::Mat MakeFrame(int value) {
+    return cv::Mat(10, 10, CV_8UC1, cv::Scalar(value));
+  }
+
+  static string Key(int i) {
+    std::ostringstream key;
+    key << "video_" << i;
+    return key.str();
+  }
+
+  // Inserts and looks up frames whose pixels all equal their key, and
+  // checks that no lookup ever returns a torn frame.
+  static void Hammer(SharedFrameCache* cache, int seed, int* errors) {
+    for (int i = 0; i < 2000; ++i) {
+      const int value = (i * 7 + seed) % 64;
+      cv::Mat frame;
+      if (cache->Lookup(Key(value), &frame)) {
+        if (cv::countNonZero(frame != value) != 0) {
+          ++*errors;
+        }
+      } else {
+        cache->Insert(Key(value), MakeFrame(value));
+      }
+    }
+  }
+
+  string name_;
+};
+
+TEST_F(SharedFrameCacheTest, TestSharedBetweenMappings) {
+  shared_ptr<SharedFrameCache> writer =
+      SharedFrameCache::Create(name_, 1 << 20, 100);
+  shared_ptr<SharedFrameCache> reader = SharedFrameCache::Open(name_);
+  EXPECT_EQ(writer->num_slots(), reader->num_slots());
+  EXPECT_EQ(100, reader->slot_bytes());
+  cv::Mat frame;
+  EXPECT_FALSE(reader->Lookup(Key(1), &frame));
+  writer->Insert(Key(1), MakeFrame(1));
+  ASSERT_TRUE(reader->Lookup(Key(1), &frame));
+  EXPECT_EQ(10, frame.rows);
+  EXPECT_EQ(10, frame.cols);
+  EXPECT_EQ(CV_8UC1, frame.type());
+  EXPECT_EQ(0, cv::countNonZero(frame != 1));
+  EXPECT_EQ(1, reader->hits());
+  EXPECT_EQ(1, reader->misses());
+  EXPECT_EQ(0, writer->hits());
+  EXPECT_EQ(1, reader->num_frames());
+  EXPECT_EQ(100, reader->size_bytes());
+}
+
+TEST_F(SharedFrameCacheTest, TestEvictLeastRecentlyUsed) {
+  // A single set.
+  shared_ptr<SharedFrameCache> cache = SharedFrameCache::Create(name_, 0, 100);
+  ASSERT_EQ(SharedFrameCache::kWays, cache->num_slots());
+  for (int i = 0; i < SharedFrameCache::kWays; ++i) {
+    cache->Insert(Key(i), MakeFrame(i));
+  }
+  cv::Mat frame;
+  ASSERT_TRUE(cache->Lookup(Key(0), &frame));
+  cache->Insert(Key(100), MakeFrame(100));
+  EXPECT_EQ(1, cache->evictions());
+  EXPECT_EQ(SharedFrameCache::kWays, cache->num_frames());
+  EXPECT_TRUE(cache->Lookup(Key(0), &frame));
+  EXPECT_FALSE(cache->Lookup(Key(1), &frame));
+  EXPECT_TRUE(cache->Lookup(Key(100), &frame));
+}
+
+TEST_F(SharedFrameCacheTest, TestSkipTooLarge) {
+  shared_ptr<SharedFrameCache> cache =
+      SharedFrameCache::Create(name_, 1 << 20, 100);
+  cache->Insert("big", cv::Mat(20, 10, CV_8UC1, cv::Scalar(0)));
+  cache->Insert(string(SharedFrameCache::kMaxKeyLength + 1, 'k'),
+      MakeFrame(1));
+  EXPECT_EQ(0, cache->num_frames());
+}
+
+TEST_F(SharedFrameCacheTest, TestConcurrentAccess) {
+  // Few slots for many keys, so that readers race with the evictions.
+  shared_ptr<SharedFrameCache> cache = SharedFrameCache::Create(name_, 0, 100);
+  shared_ptr<SharedFrameCache> other = SharedFrameCache::Open(name_);
+  const int num_threads = 4;
+  vector<int> errors(num_threads, 0);
+  boost::thread_group threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.create_thread(boost::bind(&SharedFrameCacheTest::Hammer,
+        i % 2 ? cache.get() : other.get(), i, &errors[i]));
+  }
+  threads.join_all();
+  for (int i = 0; i < num_threads; ++i) {
+    EXPECT_EQ(0, errors[i]);
+  }
+  EXPECT_GT(cache->hits() + other->hits(), 0);
+}
+
+// Run with mpirun -np N to check the sharing between ranks of one host.
+TEST_F(SharedFrameCacheTest, TestNodeShared) {
+  shared_ptr<SharedFrameCache> cache =
+      SharedFrameCache::CreateNodeShared(1 << 20, 100);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  cache->Insert(Key(rank), MakeFrame(rank % 256));
+  MPI_Barrier(MPI_COMM_WORLD);
+  cv::Mat frame;
+  for (int i = 0; i < size; ++i) {
+    ASSERT_TRUE(cache->Lookup(Key(i), &frame)) << "frame of rank " << i;
+    EXPECT_EQ(0, cv::countNonZero(frame != i % 256));
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+}  // namespace caffe
+
+#endif  // USE_MPI
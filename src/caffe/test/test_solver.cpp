@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include <string>
 #include <utility>
 #include <vector>
@@ -8,6 +10,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
+#include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -15,12 +18,29 @@ using std::ostringstream;
 
 namespace caffe {
 
+// Exposes the results of the last background test.
+template <typename Dtype>
+class BackgroundTestSolver : public SGDSolver<Dtype> {
+ public:
+  explicit BackgroundTestSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) {}
+
+  int background_test_iter() const { return this->background_test_iter_; }
+  const vector<Dtype>& background_test_score(const int test_net_id) const {
+    return this->background_test_results_[test_net_id].score;
+  }
+};
+
 template <typename TypeParam>
 class SolverTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
 
  protected:
   virtual void InitSolverFromProtoString(const string& proto) {
+    solver_.reset(new SGDSolver<Dtype>(ParseSolverParameter(proto)));
+  }
+
+  SolverParameter ParseSolverParameter(const string& proto) {
     SolverParameter param;
     CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
     // Set the solver_mode according to current Caffe::mode.
@@ -34,7 +54,7 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
       default:
         LOG(FATAL) << "Unknown Caffe mode: " << Caffe::mode();
     }
-    solver_.reset(new SGDSolver<Dtype>(param));
+    return param;
   }
 
   shared_ptr<Solver<Dtype> > solver_;
@@ -105,4 +125,214 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestBackgroundTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The test net sees constant data, so that its scores only depend on the
+  // weights, but fills a random blob beside the training all the same.
+  const string& proto =
+     "max_iter: 10 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "test_interval: 5 "
+     "test_iter: 2 "
+     "test_in_background: true "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "    include { phase: TRAIN } "
+     "  } "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'constant' "
+     "        value: 1 "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "    include { phase: TEST } "
+     "  } "
+     "  layer { "
+     "    name: 'noise' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 24 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    top: 'noise' "
+     "    include { phase: TEST } "
+     "  } "
+     "  layer { "
+     "    name: 'silence' "
+     "    type: 'Silence' "
+     "    bottom: 'noise' "
+     "    include { phase: TEST } "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  BackgroundTestSolver<Dtype>* solver =
+      new BackgroundTestSolver<Dtype>(this->ParseSolverParameter(proto));
+  this->solver_.reset(solver);
+  solver->Solve();
+  // The last test ran on a copy of the final weights.
+  ASSERT_EQ(1, solver->test_nets().size());
+  Net<Dtype>& test_net = *solver->test_nets()[0];
+  const Blob<Dtype>& weights =
+      *solver->net()->layer_by_name("innerprod")->blobs()[0];
+  const Blob<Dtype>& test_weights =
+      *test_net.layer_by_name("innerprod")->blobs()[0];
+  EXPECT_NE(weights.cpu_data(), test_weights.cpu_data());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], test_weights.cpu_data()[i]);
+  }
+  // It logged the loss of those weights, summed over the test_iter batches.
+  EXPECT_EQ(10, solver->background_test_iter());
+  const vector<Dtype>& score = solver->background_test_score(0);
+  ASSERT_EQ(1, score.size());
+  Dtype loss;
+  test_net.ForwardPrefilled(&loss);
+  EXPECT_GT(loss, 0);
+  EXPECT_NEAR(2 * loss, score[0], 1e-5 * 2 * loss);
+}
+
+TYPED_TEST(SolverTest, TestBackgroundSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  string snapshot_dir;
+  MakeTempDir(&snapshot_dir);
+  const string snapshot_prefix = snapshot_dir + "/test";
+  const string& proto =
+     "max_iter: 10 "
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "snapshot: 5 "
+     "snapshot_in_background: true "
+     "snapshot_compress: true "
+     "snapshot_prefix: '" + snapshot_prefix + "' "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The last snapshot is complete once Solve returns, under its final name.
+  const string model_filename = snapshot_prefix + "_iter_10.caffemodel";
+  const string state_filename = snapshot_prefix + "_iter_10.solverstate";
+  NetParameter net_param;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(model_filename, &net_param));
+  SolverState state;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(state_filename, &state));
+  EXPECT_EQ(10, state.iter());
+  EXPECT_EQ(model_filename, state.learned_net());
+  EXPECT_EQ(-1, access((model_filename + ".tmp").c_str(), F_OK));
+  EXPECT_EQ(-1, access((state_filename + ".tmp").c_str(), F_OK));
+  // The snapshot holds the final weights.
+  const Blob<Dtype>& weights =
+      *this->solver_->net()->layer_by_name("innerprod")->blobs()[0];
+  const BlobProto* weights_proto = NULL;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (net_param.layer(i).name() == "innerprod") {
+      weights_proto = &net_param.layer(i).blobs(0);
+    }
+  }
+  ASSERT_TRUE(weights_proto != NULL);
+  ASSERT_EQ(weights.count(), weights_proto->data_size());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(static_cast<float>(weights.cpu_data()[i]),
+        weights_proto->data(i));
+  }
+  // The earlier snapshot was written too.
+  NetParameter earlier_param;
+  EXPECT_TRUE(ReadProtoFromBinaryFile(
+      snapshot_prefix + "_iter_5.caffemodel", &earlier_param));
+}
+
 }  // namespace caffe
@@ -0,0 +1,74 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/transform_row.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class TransformRowTest : public ::testing::Test {
+ protected:
+  TransformRowTest() : max_width_(45), mean_value_(12.5), scale_(0.017) {
+    for (int w = 0; w < max_width_; ++w) {
+      src_.push_back(static_cast<uint8_t>((w * 37 + 11) % 256));
+      mean_.push_back(Dtype(w * 3) / 7);
+    }
+  }
+
+  // Checks the kernel against the per-pixel definition, for every width up
+  // to max_width_, so that both the vector body and the tail are covered.
+  void CheckKernel(bool mirror, bool invert, TransformMeanMode mean_mode) {
+    typename TransformRowKernel<Dtype>::Func transform_row =
+        GetTransformRowKernel<Dtype>(mirror, invert, mean_mode);
+    for (int width = 1; width <= max_width_; ++width) {
+      vector<Dtype> dst(width);
+      transform_row(&src_[0], width, &mean_[0], mean_value_, scale_, &dst[0]);
+      for (int w = 0; w < width; ++w) {
+        Dtype x = src_[w];
+        if (invert) {
+          x = 255 - x;
+        }
+        if (mean_mode == TRANSFORM_MEAN_VALUE) {
+          x = (x - mean_value_) * scale_;
+        } else if (mean_mode == TRANSFORM_MEAN_ROW) {
+          x = (x - mean_[w]) * scale_;
+        } else {
+          x = x * scale_;
+        }
+        EXPECT_EQ(x, dst[mirror ? width - 1 - w : w]) << "width " << width;
+      }
+    }
+  }
+
+  const int max_width_;
+  const Dtype mean_value_;
+  const Dtype scale_;
+  vector<uint8_t> src_;
+  vector<Dtype> mean_;
+};
+
+TYPED_TEST_CASE(TransformRowTest, TestDtypes);
+
+TYPED_TEST(TransformRowTest, TestNoMean) {
+  this->CheckKernel(false, false, TRANSFORM_NO_MEAN);
+  this->CheckKernel(true, false, TRANSFORM_NO_MEAN);
+  this->CheckKernel(true, true, TRANSFORM_NO_MEAN);
+}
+
+TYPED_TEST(TransformRowTest, TestMeanValue) {
+  this->CheckKernel(false, false, TRANSFORM_MEAN_VALUE);
+  this->CheckKernel(true, false, TRANSFORM_MEAN_VALUE);
+  this->CheckKernel(true, true, TRANSFORM_MEAN_VALUE);
+}
+
+TYPED_TEST(TransformRowTest, TestMeanRow) {
+  this->CheckKernel(false, false, TRANSFORM_MEAN_ROW);
+  this->CheckKernel(true, false, TRANSFORM_MEAN_ROW);
+  this->CheckKernel(true, true, TRANSFORM_MEAN_ROW);
+}
+
+}  // namespace caffe
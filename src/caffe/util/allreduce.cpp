@@ -0,0 +1,244 @@
+#ifdef USE_MPI
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/allreduce.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype> static MPI_Datatype MPIType();
+template <> MPI_Datatype MPIType<float>() { return MPI_FLOAT; }
+template <> MPI_Datatype MPIType<double>() { return MPI_DOUBLE; }
+
+Allreducer::Allreducer(MPI_Comm comm, size_t chunk_bytes)
+    : chunk_bytes_(chunk_bytes) {
+  CHECK_GT(chunk_bytes_, 0);
+  // A communicator of our own, so our messages never match anybody else's.
+  MPI_CHECK(MPI_Comm_dup(comm, &comm_));
+  int rank;
+  MPI_Comm_rank(comm_, &rank);
+  MPI_CHECK(MPI_Comm_split_type(comm_, MPI_COMM_TYPE_SHARED, rank,
+      MPI_INFO_NULL, &node_comm_));
+  MPI_Comm_rank(node_comm_, &local_rank_);
+  MPI_Comm_size(node_comm_, &local_size_);
+  MPI_CHECK(MPI_Comm_split(comm_, local_rank_, rank, &cross_comm_));
+  int sizes[2] = {local_size_, -local_size_};
+  MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, sizes, 2, MPI_INT, MPI_MAX, comm_));
+  uniform_nodes_ = (sizes[0] == -sizes[1]);
+  if (!uniform_nodes_) {
+    LOG(WARNING) << "The hosts run different numbers of ranks, the "
+        << "hierarchical allreduce falls back to the ring.";
+  }
+
+  char* base;
+  MPI_CHECK(MPI_Win_allocate_shared(chunk_bytes_, 1, MPI_INFO_NULL,
+      node_comm_, &base, &window_));
+  slots_.resize(local_size_);
+  for (int i = 0; i < local_size_; ++i) {
+    MPI_Aint size;
+    int disp_unit;
+    MPI_CHECK(MPI_Win_shared_query(window_, i, &size, &disp_unit, &slots_[i]));
+  }
+  MPI_CHECK(MPI_Win_lock_all(MPI_MODE_NOCHECK, window_));
+}
+
+Allreducer::~Allreducer() {
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (finalized) {
+    return;
+  }
+  MPI_Win_unlock_all(window_);
+  MPI_Win_free(&window_);
+  MPI_Comm_free(&cross_comm_);
+  MPI_Comm_free(&node_comm_);
+  MPI_Comm_free(&comm_);
+}
+
+template <typename Dtype>
+void Allreducer::Allreduce(Dtype* data, int count,
+    AllreduceAlgorithm algorithm) {
+  switch (algorithm) {
+  case ALLREDUCE_RING:
+    Ring(data, count, comm_);
+    break;
+  case ALLREDUCE_HIERARCHICAL:
+    Hierarchical(data, count);
+    break;
+  default:
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, data, count, MPIType<Dtype>(),
+        MPI_SUM, comm_));
+  }
+}
+
+// The state of one ring allreduce. Segment i of the buffer is
+// [begin[i], begin[i + 1]), and chunk k of a segment starts at
+// begin[i] + k * chunk; chunks past the end of a segment are empty.
+//
+// Every chunk k goes around the ring on its own, through 2 (size - 1)
+// steps. Reduce-scatter, step s < size - 1: send segment rank - s, receive
+// segment rank - s - 1 and add it. Allgather, step s = size - 1 + t: send
+// segment rank + 1 - t, receive segment rank - t. What a step receives is
+// what the next one sends, so a chunk moves on as soon as it has arrived.
+// All the messages of chunk k use the tag k, and MPI keeps their order.
+template <typename Dtype>
+struct RingState {
+  Dtype* data;
+  Dtype* recv_buffer;
+  MPI_Comm comm;
+  int rank;
+  int size;
+  int chunk;
+  int num_steps;
+  vector<int> begin;
+  vector<MPI_Request> recv_requests;
+  vector<MPI_Request> send_requests;
+
+  int Segment(int segment) const { return (segment + size) % size; }
+  int ChunkBegin(int segment, int k) const {
+    return begin[Segment(segment)] + k * chunk;
+  }
+  int ChunkCount(int segment, int k) const {
+    const int chunk_begin = ChunkBegin(segment, k);
+    return std::max(0, std::min(begin[Segment(segment) + 1],
+        chunk_begin + chunk) - chunk_begin);
+  }
+  bool Reduces(int s) const { return s < size - 1; }
+  int SendSegment(int s) const {
+    return Reduces(s) ? rank - s : rank + 1 - (s - (size - 1));
+  }
+  int RecvSegment(int s) const {
+    return Reduces(s) ? rank - s - 1 : rank - (s - (size - 1));
+  }
+
+  void Post(int k, int s) {
+    const MPI_Datatype type = MPIType<Dtype>();
+    const int left = (rank + size - 1) % size;
+    const int right = (rank + 1) % size;
+    const int recv_segment = RecvSegment(s);
+    if (Reduces(s)) {
+      MPI_CHECK(MPI_Irecv(recv_buffer + k * chunk,
+          ChunkCount(recv_segment, k), type, left, k, comm,
+          &recv_requests[k]));
+    } else {
+      // The reduce-scatter sent this part of the segment at step t, and
+      // may still be reading it.
+      const int t = s - (size - 1);
+      MPI_CHECK(MPI_Wait(&send_requests[k * num_steps + t],
+          MPI_STATUS_IGNORE));
+      MPI_CHECK(MPI_Irecv(data + ChunkBegin(recv_segment, k),
+          ChunkCount(recv_segment, k), type, left, k, comm,
+          &recv_requests[k]));
+    }
+    const int send_segment = SendSegment(s);
+    MPI_CHECK(MPI_Isend(data + ChunkBegin(send_segment, k),
+        ChunkCount(send_segment, k), type, right, k, comm,
+        &send_requests[k * num_steps + s]));
+  }
+
+  // Adds chunk k received at step s, if s reduces.
+  void Finish(int k, int s) {
+    if (Reduces(s)) {
+      const int recv_segment = RecvSegment(s);
+      caffe_axpy(ChunkCount(recv_segment, k), Dtype(1),
+          recv_buffer + k * chunk, data + ChunkBegin(recv_segment, k));
+    }
+  }
+};
+
+template <typename Dtype>
+void Allreducer::Ring(Dtype* data, int count, MPI_Comm comm) {
+  RingState<Dtype> ring;
+  MPI_Comm_rank(comm, &ring.rank);
+  MPI_Comm_size(comm, &ring.size);
+  if (ring.size == 1 || count == 0) {
+    return;
+  }
+  const int size = ring.size;
+  ring.data = data;
+  ring.comm = comm;
+  ring.begin.resize(size + 1);
+  for (int i = 0; i <= size; ++i) {
+    ring.begin[i] = static_cast<int>(int64_t(count) * i / size);
+  }
+  ring.chunk = std::max<int>(1, chunk_bytes_ / sizeof(Dtype));
+  const int max_segment = (count + size - 1) / size;
+  const int num_chunks = (max_segment + ring.chunk - 1) / ring.chunk;
+  ring.num_steps = 2 * (size - 1);
+  const size_t buffer_bytes = size_t(num_chunks) * ring.chunk * sizeof(Dtype);
+  if (recv_buffer_.size() < buffer_bytes) {
+    recv_buffer_.resize(buffer_bytes);
+  }
+  ring.recv_buffer = reinterpret_cast<Dtype*>(&recv_buffer_[0]);
+  ring.recv_requests.resize(num_chunks, MPI_REQUEST_NULL);
+  ring.send_requests.resize(num_chunks * ring.num_steps, MPI_REQUEST_NULL);
+
+  vector<int> step(num_chunks, 0);
+  for (int k = 0; k < num_chunks; ++k) {
+    ring.Post(k, 0);
+  }
+  for (int remaining = num_chunks; remaining > 0; ) {
+    int k;
+    MPI_CHECK(MPI_Waitany(num_chunks, &ring.recv_requests[0], &k,
+        MPI_STATUS_IGNORE));
+    ring.Finish(k, step[k]);
+    if (++step[k] < ring.num_steps) {
+      ring.Post(k, step[k]);
+    } else {
+      --remaining;
+    }
+  }
+  MPI_CHECK(MPI_Waitall(ring.send_requests.size(), &ring.send_requests[0],
+      MPI_STATUSES_IGNORE));
+}
+
+void Allreducer::NodeBarrier() {
+  MPI_CHECK(MPI_Win_sync(window_));
+  MPI_CHECK(MPI_Barrier(node_comm_));
+  MPI_CHECK(MPI_Win_sync(window_));
+}
+
+template <typename Dtype>
+void Allreducer::Hierarchical(Dtype* data, int count) {
+  if (!uniform_nodes_) {
+    Ring(data, count, comm_);
+    return;
+  }
+  const int chunk = std::max<int>(1, chunk_bytes_ / sizeof(Dtype));
+  Dtype* result = reinterpret_cast<Dtype*>(slots_[0]);
+  for (int offset = 0; offset < count; offset += chunk) {
+    const int chunk_count = std::min(chunk, count - offset);
+    caffe_copy(chunk_count, data + offset,
+        reinterpret_cast<Dtype*>(slots_[local_rank_]));
+    NodeBarrier();
+    // Every local rank sums its slice over the host into the first slot,
+    // then over the hosts.
+    const int slice_begin =
+        static_cast<int>(int64_t(chunk_count) * local_rank_ / local_size_);
+    const int slice_end =
+        static_cast<int>(int64_t(chunk_count) * (local_rank_ + 1) / local_size_);
+    for (int i = 1; i < local_size_; ++i) {
+      caffe_axpy(slice_end - slice_begin, Dtype(1),
+          reinterpret_cast<Dtype*>(slots_[i]) + slice_begin,
+          result + slice_begin);
+    }
+    Ring(result + slice_begin, slice_end - slice_begin, cross_comm_);
+    NodeBarrier();
+    caffe_copy(chunk_count, result, data + offset);
+    // Nobody refills the slots before everybody has read the result.
+    NodeBarrier();
+  }
+}
+
+template void Allreducer::Allreduce<float>(float* data, int count,
+    AllreduceAlgorithm algorithm);
+template void Allreducer::Allreduce<double>(double* data, int count,
+    AllreduceAlgorithm algorithm);
+
+}  // namespace caffe
+
+#endif  // USE_MPI
@@ -8,6 +8,7 @@
 #include <boost/atomic.hpp>
 #include <boost/lockfree/queue.hpp>
 
+#include <cstring>
 
 #include "caffe/util/channel.hpp"
 
@@ -20,7 +21,9 @@ namespace caffe {
 shared_ptr<MPIComm> MPIComm::singleton_;
 
 MPIComm::MPIComm() :
-    running_(false), started_(false){}
+    task_queue_(128), running_(false), idle_(false), bucket_bytes_(0),
+    num_allreduce_(0), bucket_used_(0), allreduce_algorithm_(ALLREDUCE_MPI),
+    allreduce_chunk_bytes_(4 << 20){}
 
 MPIComm::~MPIComm() {
   if (IsRunning()){
@@ -32,18 +35,32 @@ bool MPIComm::IsRunning(){
  return running_.load();
 }
 
-bool MPIComm::IsIdle(){
-  mutex::scoped_lock lock(queue_mutex_);
-  return task_queue_.empty();
+void MPIJobFuture::Wait() {
+  if (flush_on_wait_) {
+    flush_on_wait_ = false;
+    MPIJob flush_job = {NULL, NULL, 0, 0, OP_FLUSH};
+    MPIComm::AddMPIJob(flush_job);
+  }
+  if (state_) {
+    MPIComm::Get().WaitFor(*state_);
+  }
 }
 
-void MPIComm::WaitAll() {
-
-  mutex::scoped_lock lock(queue_mutex_);
-  while (task_queue_.size()){
-    DLOG(INFO)<<"Waiting for tasks to finish, task size "<<task_queue_.size()<<"\n";
+void MPIComm::WaitFor(const MPIJobState& state) {
+  if (state.done_.load()) {
+    return;
+  }
+  mutex::scoped_lock lock(finish_mutex_);
+  while (!state.done_.load()) {
     cond_finish_.wait(lock);
   }
+}
+
+void MPIComm::WaitAll() {
+  // Have the communication thread reduce what is left in the bucket. The
+  // queue is in order, so all the jobs before the flush are done with it.
+  MPIJob flush_job = {NULL, NULL, 0, 0, OP_FLUSH};
+  AddJob(flush_job).Wait();
   DLOG(INFO)<<"all task done on "<<Caffe::MPI_my_rank()<<"\n";
 }
 
@@ -62,8 +79,11 @@ void MPIComm::StartProcessing() {
 void MPIComm::EndProcessing(){
   if (IsRunning()) {
     try {
-      cond_work_.notify_one();
       running_.store(false); //notify the transmission thread to finish and shutdown
+      {
+        mutex::scoped_lock lock(work_mutex_);
+        cond_work_.notify_one();
+      }
       thread_->join();
     } catch (...) {
       LOG(FATAL)<<"Cannot destroy MPI comminication thread";
@@ -71,30 +91,134 @@ void MPIComm::EndProcessing(){
   }
 }
 
-void MPIComm::AddJob(MPIJob new_job) {
-  if (IsRunning()) {
-    while(!started_.load());
-    mutex::scoped_lock lock(queue_mutex_);
-    DLOG(INFO) << "adding job on " << Caffe::MPI_my_rank() << " task queue size " << task_queue_.size() << " \n";
-    task_queue_.push(new_job);
-    lock.unlock();
-    cond_work_.notify_one();
-  }else{
+MPIJobFuture MPIComm::AddJob(MPIJob new_job) {
+  if (!IsRunning()) {
     LOG(FATAL)<<"Cannot push job while MPI Comm is shutting down";
   }
+  QueuedJob* queued = new QueuedJob;
+  queued->job_ = new_job;
+  queued->state_.reset(new MPIJobState());
+  const bool in_place_sum =
+      new_job.op_ == OP_SUM_ALL && new_job.src_ptr_ == new_job.dst_ptr_;
+  MPIJobFuture future(queued->state_, in_place_sum);
+  task_queue_.push(queued);
+  // Pairs with the fence in ThreadFunc: either the communication thread
+  // sees the job, or we see it idle and wake it up.
+  boost::atomic_thread_fence(boost::memory_order_seq_cst);
+  if (idle_.load()) {
+    mutex::scoped_lock lock(work_mutex_);
+    cond_work_.notify_one();
+  }
+  return future;
+}
+
+void MPIComm::CompleteJob(QueuedJob* queued) {
+  queued->state_->done_.store(true);
+  {
+    // Taken so that a waiter cannot miss the notification between its
+    // check of done_ and its wait.
+    mutex::scoped_lock lock(finish_mutex_);
+  }
+  cond_finish_.notify_all();
+  delete queued;
+}
+
+// Packs a small in-place sum into the bucket, reducing the bucket first if
+// the job does not fit. The decisions only depend on the sequence of jobs,
+// which is the same on all the ranks, so they all make the same calls.
+void MPIComm::AddToBucket(QueuedJob* queued) {
+  const MPIJob& job = queued->job_;
+  const size_t bytes = size_t(job.count_) * job.dtype_size_;
+  const size_t bucket_bytes = bucket_bytes_.load();
+  if (bucket_jobs_.size() && (bucket_used_ + bytes > bucket_bytes
+      || job.dtype_size_ != bucket_jobs_[0]->job_.dtype_size_)) {
+    FlushBucket();
+  }
+  if (bucket_buffer_.size() < bucket_bytes) {
+    bucket_buffer_.resize(bucket_bytes);
+  }
+  memcpy(&bucket_buffer_[bucket_used_], job.src_ptr_, bytes);
+  bucket_used_ += bytes;
+  bucket_jobs_.push_back(queued);
+}
+
+void MPIComm::FlushBucket() {
+  if (bucket_jobs_.empty()) {
+    return;
+  }
+  const int dtype_size = bucket_jobs_[0]->job_.dtype_size_;
+  DLOG(INFO) << "Running all reduce on a bucket of " << bucket_jobs_.size()
+             << " jobs, " << bucket_used_ << " bytes";
+  Sum(&bucket_buffer_[0], &bucket_buffer_[0], bucket_used_ / dtype_size,
+      dtype_size);
+  size_t offset = 0;
+  for (int i = 0; i < bucket_jobs_.size(); ++i) {
+    const MPIJob& job = bucket_jobs_[i]->job_;
+    const size_t bytes = size_t(job.count_) * dtype_size;
+    memcpy(job.dst_ptr_, &bucket_buffer_[offset], bytes);
+    offset += bytes;
+    CompleteJob(bucket_jobs_[i]);
+  }
+  bucket_jobs_.clear();
+  bucket_used_ = 0;
 }
 
-void MPIComm::DispatchJob(MPIJob &job) {
+// Sums count elements of src over the ranks into dst, with the selected
+// engine. The engine and the chunk size are the same on all the ranks.
+void MPIComm::Sum(void* src, void* dst, int count, int dtype_size) {
+  const AllreduceAlgorithm algorithm =
+      static_cast<AllreduceAlgorithm>(allreduce_algorithm_.load());
+  ++num_allreduce_;
+  if (algorithm == ALLREDUCE_MPI) {
+    MPI_Datatype data_type = (dtype_size == 4) ? MPI_FLOAT : MPI_DOUBLE;
+    MPI_CHECK(MPI_Allreduce((src == dst) ? MPI_IN_PLACE : src, dst, count,
+                            data_type, MPI_SUM, MPI_COMM_WORLD));
+    return;
+  }
+  const size_t chunk_bytes = allreduce_chunk_bytes_.load();
+  if (!allreducer_ || allreducer_->chunk_bytes() != chunk_bytes) {
+    allreducer_.reset();
+    allreducer_.reset(new Allreducer(MPI_COMM_WORLD, chunk_bytes));
+  }
+  if (src != dst) {
+    memcpy(dst, src, size_t(count) * dtype_size);
+  }
+  if (dtype_size == 4) {
+    allreducer_->Allreduce(static_cast<float*>(dst), count, algorithm);
+  } else {
+    allreducer_->Allreduce(static_cast<double*>(dst), count, algorithm);
+  }
+}
+
+void MPIComm::DispatchJob(QueuedJob* queued) {
+  MPIJob& job = queued->job_;
+  if (job.op_ == OP_FLUSH) {
+    FlushBucket();
+    CompleteJob(queued);
+    return;
+  }
+  // Only the in-place sums, i.e. the gradients, are packed. They are done
+  // when their bucket is reduced.
+  if (job.op_ == OP_SUM_ALL && job.src_ptr_ == job.dst_ptr_
+      && size_t(job.count_) * job.dtype_size_ < bucket_bytes_.load()) {
+    AddToBucket(queued);
+    return;
+  }
+  // Keep the order of the sums on all the ranks.
+  FlushBucket();
+
   MPI_Datatype data_type = (job.dtype_size_ == 4) ? MPI_FLOAT : MPI_DOUBLE;
 
   // call MPI APIs for real works
   switch (job.op_) {
     case OP_SUM_ALL: {
       DLOG(INFO)<<"Running all reduce\n";
-      MPI_CHECK(MPI_Allreduce((job.src_ptr_ == job.dst_ptr_) ? MPI_IN_PLACE : job.src_ptr_,
-                              job.dst_ptr_, job.count_, data_type,
-                              MPI_SUM, MPI_COMM_WORLD
-      ));
+      Sum(job.src_ptr_, job.dst_ptr_, job.count_, job.dtype_size_);
+      break;
+    }
+    case OP_SUM_COMPRESSED: {
+      CHECK_EQ(job.src_ptr_, job.dst_ptr_);
+      job.compressor_->Allreduce(job.dst_ptr_, job.count_, MPI_COMM_WORLD);
       break;
     }
     case OP_GATHER: {
@@ -119,42 +243,40 @@ void MPIComm::DispatchJob(MPIJob &job) {
       LOG(FATAL)<<"Unknown MPI job type";
     }
   }
+  CompleteJob(queued);
 }
+
 void MPIComm::ThreadFunc(){
-  CUDA_CHECK(cudaSetDevice(Caffe::device_id()));
-  started_.store(true);
-  MPIJob job;
+#ifndef CPU_ONLY
+  // In CPU mode there is no device to bind this thread to.
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaSetDevice(Caffe::device_id()));
+  }
+#endif
+  QueuedJob* queued;
   while (true){
-    mutex::scoped_lock lock(queue_mutex_);
-    while( task_queue_.empty() && IsRunning()){
-      DLOG(INFO)<<"no job running, waiting on cond";
-      cond_work_.wait(lock);
+    if (task_queue_.pop(queued)) {
+      DispatchJob(queued);
+      continue;
     }
-    lock.unlock();
-
-    DLOG(INFO)<<"Cond fulfilled, dispatching job";
-    if (IsRunning()){
-      job = task_queue_.front();
-      DLOG(INFO)<<task_queue_.size();
-      DispatchJob(job);
-      mutex::scoped_lock pop_lock(queue_mutex_);
-      task_queue_.pop();
-      pop_lock.unlock();
-      cond_finish_.notify_one();
-      DLOG(INFO)<<"job finished, poped taskqueue";
-    }else{
+    if (!IsRunning()) {
       break;
     }
-
+    mutex::scoped_lock lock(work_mutex_);
+    idle_.store(true);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    while (task_queue_.empty() && IsRunning()){
+      DLOG(INFO)<<"no job running, waiting on cond";
+      cond_work_.wait(lock);
+    }
+    idle_.store(false);
   }
 
   // finish remaining jobs
-  while (!task_queue_.empty()){
-    boost::lock_guard<mutex> lock(queue_mutex_);
-    job = task_queue_.front();
-    task_queue_.pop();
-    DispatchJob(job);
+  while (task_queue_.pop(queued)){
+    DispatchJob(queued);
   }
+  FlushBucket();
 }
 
 }
@@ -0,0 +1,135 @@
+#include <boost/thread.hpp>
+
+#include <string>
+
+#include "caffe/util/frame_cache.hpp"
+#include "caffe/util/shared_frame_cache.hpp"
+
+namespace caffe {
+
+class LocalFrameCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+static size_t FrameBytes(const cv::Mat& frame) {
+  return frame.total() * frame.elemSize();
+}
+
+LocalFrameCache::LocalFrameCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), size_bytes_(0), hits_(0), misses_(0),
+      evictions_(0), sync_(new sync()) {}
+
+static boost::mutex global_frame_cache_mutex;
+static shared_ptr<LocalFrameCache> global_frame_cache;
+#ifdef USE_MPI
+static shared_ptr<SharedFrameCache> global_shared_frame_cache;
+#endif
+
+shared_ptr<FrameCache> FrameCache::Global(size_t capacity_bytes,
+    bool node_shared, size_t slot_bytes) {
+  boost::mutex::scoped_lock lock(global_frame_cache_mutex);
+#ifdef USE_MPI
+  if (node_shared && Caffe::parallel_mode() == Caffe::MPI) {
+    if (!global_shared_frame_cache) {
+      global_shared_frame_cache =
+          SharedFrameCache::CreateNodeShared(capacity_bytes, slot_bytes);
+      LOG(INFO) << "Created a " << capacity_bytes / (1024 * 1024)
+                << " MB frame cache shared by the ranks of the node, "
+                << global_shared_frame_cache->num_slots() << " slots of "
+                << global_shared_frame_cache->slot_bytes() << " bytes.";
+    }
+    return global_shared_frame_cache;
+  }
+#endif
+  if (!global_frame_cache) {
+    global_frame_cache.reset(new LocalFrameCache(capacity_bytes));
+    LOG(INFO) << "Created a " << capacity_bytes / (1024 * 1024)
+              << " MB frame cache.";
+  } else if (capacity_bytes > global_frame_cache->capacity_bytes()) {
+    global_frame_cache->set_capacity_bytes(capacity_bytes);
+    LOG(INFO) << "Grew the frame cache to " << capacity_bytes / (1024 * 1024)
+              << " MB.";
+  }
+  return global_frame_cache;
+}
+
+float FrameCache::hit_rate() const {
+  const uint64_t cache_hits = hits();
+  const uint64_t lookups = cache_hits + misses();
+  return lookups ? static_cast<float>(cache_hits) / lookups : 0.f;
+}
+
+bool LocalFrameCache::Lookup(const string& key, cv::Mat* frame) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::map<string, FrameList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  frames_.splice(frames_.begin(), frames_, it->second);
+  *frame = it->second->second;
+  return true;
+}
+
+void LocalFrameCache::Insert(const string& key, const cv::Mat& frame) {
+  const size_t bytes = FrameBytes(frame);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (bytes > capacity_bytes_ || index_.count(key)) {
+    // Too large to cache, or another thread decoded it first.
+    return;
+  }
+  EvictTo(capacity_bytes_ - bytes);
+  frames_.push_front(std::make_pair(key, frame));
+  index_[key] = frames_.begin();
+  size_bytes_ += bytes;
+}
+
+void LocalFrameCache::EvictTo(size_t capacity_bytes) {
+  while (size_bytes_ > capacity_bytes) {
+    const FrameList::iterator last = --frames_.end();
+    size_bytes_ -= FrameBytes(last->second);
+    index_.erase(last->first);
+    frames_.erase(last);
+    ++evictions_;
+  }
+}
+
+void LocalFrameCache::set_capacity_bytes(size_t capacity_bytes) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  capacity_bytes_ = capacity_bytes;
+  EvictTo(capacity_bytes_);
+}
+
+size_t LocalFrameCache::capacity_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return capacity_bytes_;
+}
+
+size_t LocalFrameCache::size_bytes() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return size_bytes_;
+}
+
+size_t LocalFrameCache::num_frames() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return index_.size();
+}
+
+uint64_t LocalFrameCache::hits() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return hits_;
+}
+
+uint64_t LocalFrameCache::misses() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return misses_;
+}
+
+uint64_t LocalFrameCache::evictions() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return evictions_;
+}
+
+}  // namespace caffe
@@ -0,0 +1,262 @@
+#include <boost/thread.hpp>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <climits>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/frame_pack.hpp"
+
+namespace caffe {
+
+static const char kFramePackMagic[4] = {'F', 'P', 'K', '1'};
+// Magic, number of streams and frames, and a reserved word that keeps the
+// index 8-byte aligned.
+static const size_t kFramePackHeaderSize = 16;
+
+FramePack::FramePack()
+    : data_(NULL), size_(0), num_frames_(0), index_(NULL) {}
+
+FramePack::~FramePack() {
+  Close();
+}
+
+bool FramePack::Open(const string& filename) {
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "Could not open frame pack " << filename;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    LOG(ERROR) << "Could not stat frame pack " << filename;
+    close(fd);
+    return false;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid once the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Could not map frame pack " << filename;
+    return false;
+  }
+  filename_ = filename;
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = st.st_size;
+
+  const size_t header_size = kFramePackHeaderSize;
+  if (size_ < header_size ||
+      memcmp(data_, kFramePackMagic, sizeof(kFramePackMagic)) != 0) {
+    LOG(ERROR) << filename << " is not a frame pack";
+    Close();
+    return false;
+  }
+  uint32_t num_streams, num_frames;
+  memcpy(&num_streams, data_ + sizeof(kFramePackMagic), sizeof(uint32_t));
+  memcpy(&num_frames, data_ + sizeof(kFramePackMagic) + sizeof(uint32_t),
+      sizeof(uint32_t));
+  // Bound the counts by the file size before multiplying them, so that a
+  // corrupted header cannot overflow the sizes below.
+  const size_t entry_size = 2 * sizeof(uint64_t);
+  if (num_frames > INT_MAX ||
+      num_streams > (size_ - header_size) / kFramePackNameSize ||
+      (num_streams > 0 && num_frames > (size_ - header_size -
+          num_streams * kFramePackNameSize) / entry_size / num_streams)) {
+    LOG(ERROR) << "Truncated frame pack " << filename;
+    Close();
+    return false;
+  }
+  const size_t names_size = num_streams * kFramePackNameSize;
+  const size_t num_entries = static_cast<size_t>(num_streams) * num_frames;
+  const size_t frames_start = header_size + names_size +
+      num_entries * entry_size;
+  num_frames_ = num_frames;
+  const char* names = reinterpret_cast<const char*>(data_ + header_size);
+  for (uint32_t s = 0; s < num_streams; ++s) {
+    const char* name = names + s * kFramePackNameSize;
+    streams_.push_back(string(name, strnlen(name, kFramePackNameSize)));
+  }
+  index_ = reinterpret_cast<const uint64_t*>(
+      data_ + header_size + names_size);
+  // Every frame must lie between the index and the end of the file; the
+  // comparisons are arranged so that no sum can wrap around.
+  for (size_t i = 0; i < num_entries; ++i) {
+    const uint64_t offset = index_[2 * i];
+    const uint64_t size = index_[2 * i + 1];
+    if (size > 0 && (offset < frames_start || offset > size_ ||
+        size > size_ - offset)) {
+      LOG(ERROR) << "Corrupted index in frame pack " << filename;
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void FramePack::Close() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  filename_.clear();
+  data_ = NULL;
+  size_ = 0;
+  num_frames_ = 0;
+  streams_.clear();
+  index_ = NULL;
+}
+
+bool FramePack::FrameData(const string& stream, int frame_id,
+    const uint8_t** data, size_t* size) const {
+  CHECK(is_open());
+  int stream_id = 0;
+  while (stream_id < streams_.size() && streams_[stream_id] != stream) {
+    ++stream_id;
+  }
+  if (stream_id == streams_.size() || frame_id < 1 ||
+      frame_id > num_frames_) {
+    return false;
+  }
+  const uint64_t* entry = index_ +
+      2 * (static_cast<size_t>(stream_id) * num_frames_ + frame_id - 1);
+  if (entry[1] == 0) {
+    return false;
+  }
+  *data = data_ + entry[0];
+  *size = entry[1];
+  return true;
+}
+
+cv::Mat FramePack::DecodeFrame(const string& stream, int frame_id,
+    int cv_read_flag) const {
+  const uint8_t* data;
+  size_t size;
+  if (!FrameData(stream, frame_id, &data, &size)) {
+    return cv::Mat();
+  }
+  // Wraps the mapped bytes without copying them.
+  const cv::Mat encoded(1, size, CV_8UC1, const_cast<uint8_t*>(data));
+  return cv::imdecode(encoded, cv_read_flag);
+}
+
+class FramePackCache::sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+FramePackCache::FramePackCache(int capacity)
+    : capacity_(capacity), sync_(new sync()) {
+  CHECK_GT(capacity_, 0) << "The frame pack cache needs room for one pack.";
+}
+
+shared_ptr<const FramePack> FramePackCache::Open(const string& filename) {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    std::map<string, PackList::iterator>::iterator it = index_.find(filename);
+    if (it != index_.end()) {
+      packs_.splice(packs_.begin(), packs_, it->second);
+      return it->second->second;
+    }
+  }
+  // Map the pack without the lock, so that the other workers do not wait.
+  shared_ptr<FramePack> pack(new FramePack());
+  if (!pack->Open(filename)) {
+    return shared_ptr<const FramePack>();
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::map<string, PackList::iterator>::iterator it = index_.find(filename);
+  if (it != index_.end()) {
+    // Another thread opened it first.
+    return it->second->second;
+  }
+  if (packs_.size() >= static_cast<size_t>(capacity_)) {
+    // Callers still holding the evicted pack keep it mapped.
+    index_.erase(packs_.back().first);
+    packs_.pop_back();
+  }
+  packs_.push_front(std::make_pair(filename, pack));
+  index_[filename] = packs_.begin();
+  return pack;
+}
+
+int FramePackCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return packs_.size();
+}
+
+bool WriteFramePack(const string& filename, const vector<string>& streams,
+    const vector<vector<string> >& frame_files) {
+  CHECK_EQ(streams.size(), frame_files.size());
+  CHECK(!streams.empty());
+  const uint32_t num_streams = streams.size();
+  const uint32_t num_frames = frame_files[0].size();
+  for (uint32_t s = 0; s < num_streams; ++s) {
+    CHECK_LT(streams[s].size(), kFramePackNameSize)
+        << "Stream name too long: " << streams[s];
+    CHECK_EQ(frame_files[s].size(), num_frames)
+        << "All the streams must have the same number of frames";
+  }
+  CHECK_EQ(kFramePackNameSize % sizeof(uint64_t), 0);
+
+  // Load the encoded frames and lay them out after the index.
+  vector<string> frames(num_streams * num_frames);
+  vector<uint64_t> index(2 * num_streams * num_frames);
+  uint64_t offset = kFramePackHeaderSize + num_streams * kFramePackNameSize +
+      index.size() * sizeof(uint64_t);
+  for (uint32_t s = 0; s < num_streams; ++s) {
+    for (uint32_t f = 0; f < num_frames; ++f) {
+      const int i = s * num_frames + f;
+      const string& path = frame_files[s][f];
+      if (!path.empty()) {
+        std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+          LOG(ERROR) << "Could not read file " << path;
+          return false;
+        }
+        frames[i].assign(std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>());
+      }
+      index[2 * i] = offset;
+      index[2 * i + 1] = frames[i].size();
+      offset += frames[i].size();
+    }
+  }
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!output.is_open()) {
+    LOG(ERROR) << "Could not write frame pack " << filename;
+    return false;
+  }
+  output.write(kFramePackMagic, sizeof(kFramePackMagic));
+  output.write(reinterpret_cast<const char*>(&num_streams), sizeof(uint32_t));
+  output.write(reinterpret_cast<const char*>(&num_frames), sizeof(uint32_t));
+  const uint32_t reserved = 0;
+  output.write(reinterpret_cast<const char*>(&reserved), sizeof(uint32_t));
+  for (uint32_t s = 0; s < num_streams; ++s) {
+    char name[kFramePackNameSize] = {0};
+    memcpy(name, streams[s].data(), streams[s].size());
+    output.write(name, kFramePackNameSize);
+  }
+  output.write(reinterpret_cast<const char*>(&index[0]),
+      index.size() * sizeof(uint64_t));
+  for (int i = 0; i < frames.size(); ++i) {
+    output.write(frames[i].data(), frames[i].size());
+  }
+  return output.good();
+}
+
+}  // namespace caffe
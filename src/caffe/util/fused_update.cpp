@@ -0,0 +1,123 @@
+#include <cmath>
+
+#include "caffe/util/fused_update.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Below this many elements, a parameter is not worth waking up the threads.
+static const int kMinParallelCount = 16384;
+
+// The operations of each step are written as the BLAS and vector functions
+// of the separate passes compute them: axpy(alpha, x, y) as alpha * x + y,
+// axpby(alpha, x, beta, y) as alpha * x + beta * y. Do not reorder them, and
+// do not let the compiler contract them (see -ffp-contract=off in the build).
+template <typename Dtype, FusedUpdateRule rule, FusedUpdateDecay decay_type,
+    bool apply>
+static void FusedUpdate(const int n, const FusedUpdateParameter<Dtype>& param,
+    Dtype* data, Dtype* diff, Dtype* history) {
+  const Dtype normalization = param.normalization;
+  const Dtype decay = param.decay;
+  const Dtype rate = param.rate;
+  const Dtype momentum = param.momentum;
+  const Dtype one_plus_momentum = Dtype(1) + momentum;
+  const Dtype delta = param.delta;
+#ifdef _OPENMP
+#pragma omp parallel for simd if (parallel: n >= kMinParallelCount)
+#endif
+  for (int i = 0; i < n; ++i) {
+    // Normalize. A scale by 1 when iter_size is 1 changes nothing.
+    Dtype gradient = diff[i] * normalization;
+    // Regularize.
+    if (decay_type == FUSED_DECAY_L2) {
+      gradient = decay * data[i] + gradient;
+    } else if (decay_type == FUSED_DECAY_L1) {
+      gradient = decay * Dtype(caffe_sign(data[i])) + gradient;
+    }
+    // ComputeUpdateValue.
+    Dtype update;
+    if (rule == FUSED_UPDATE_SGD) {
+      update = rate * gradient + momentum * history[i];
+      history[i] = update;
+    } else if (rule == FUSED_UPDATE_NESTEROV) {
+      const Dtype previous = history[i];
+      const Dtype current = rate * gradient + momentum * previous;
+      history[i] = current;
+      // Step back, then over step.
+      update = one_plus_momentum * current + (-momentum) * previous;
+    } else {
+      const Dtype sum_squares = std::pow(gradient, Dtype(2)) + history[i];
+      history[i] = sum_squares;
+      update = rate * (gradient / (std::pow(sum_squares, Dtype(0.5)) + delta));
+    }
+    diff[i] = update;
+    // Blob::Update.
+    if (apply) {
+      data[i] = data[i] - update;
+    }
+  }
+}
+
+template <typename Dtype, FusedUpdateRule rule, FusedUpdateDecay decay_type>
+static void FusedUpdateDispatchApply(const int n,
+    const FusedUpdateParameter<Dtype>& param, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  if (param.apply) {
+    FusedUpdate<Dtype, rule, decay_type, true>(n, param, data, diff, history);
+  } else {
+    FusedUpdate<Dtype, rule, decay_type, false>(n, param, data, diff, history);
+  }
+}
+
+template <typename Dtype, FusedUpdateRule rule>
+static void FusedUpdateDispatchDecay(const int n,
+    const FusedUpdateParameter<Dtype>& param, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  switch (param.decay_type) {
+  case FUSED_DECAY_NONE:
+    FusedUpdateDispatchApply<Dtype, rule, FUSED_DECAY_NONE>(n, param, data,
+        diff, history);
+    break;
+  case FUSED_DECAY_L2:
+    FusedUpdateDispatchApply<Dtype, rule, FUSED_DECAY_L2>(n, param, data,
+        diff, history);
+    break;
+  case FUSED_DECAY_L1:
+    FusedUpdateDispatchApply<Dtype, rule, FUSED_DECAY_L1>(n, param, data,
+        diff, history);
+    break;
+  default:
+    LOG(FATAL) << "Unknown weight decay type: " << param.decay_type;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_fused_update(const int n,
+    const FusedUpdateParameter<Dtype>& param, Dtype* data, Dtype* diff,
+    Dtype* history) {
+  switch (param.rule) {
+  case FUSED_UPDATE_SGD:
+    FusedUpdateDispatchDecay<Dtype, FUSED_UPDATE_SGD>(n, param, data, diff,
+        history);
+    break;
+  case FUSED_UPDATE_NESTEROV:
+    FusedUpdateDispatchDecay<Dtype, FUSED_UPDATE_NESTEROV>(n, param, data,
+        diff, history);
+    break;
+  case FUSED_UPDATE_ADAGRAD:
+    FusedUpdateDispatchDecay<Dtype, FUSED_UPDATE_ADAGRAD>(n, param, data,
+        diff, history);
+    break;
+  default:
+    LOG(FATAL) << "Unknown update rule: " << param.rule;
+  }
+}
+
+template void caffe_cpu_fused_update<float>(const int n,
+    const FusedUpdateParameter<float>& param, float* data, float* diff,
+    float* history);
+template void caffe_cpu_fused_update<double>(const int n,
+    const FusedUpdateParameter<double>& param, double* data, double* diff,
+    double* history);
+
+}  // namespace caffe
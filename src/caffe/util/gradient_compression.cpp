@@ -0,0 +1,270 @@
+#ifdef USE_MPI
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "caffe/util/gradient_compression.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+void GradientCompressionStats::Add(const GradientCompressionStats& other) {
+  raw_bytes += other.raw_bytes;
+  sent_bytes += other.sent_bytes;
+  encode_seconds += other.encode_seconds;
+  exchange_seconds += other.exchange_seconds;
+}
+
+double GradientCompressionStats::saved_seconds() const {
+  if (sent_bytes == 0) {
+    return 0;
+  }
+  const double uncompressed_seconds =
+      exchange_seconds * raw_bytes / sent_bytes;
+  return uncompressed_seconds - exchange_seconds - encode_seconds;
+}
+
+uint16_t caffe_float_to_half(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  bits &= 0x7fffffff;
+  if (bits > 0x7f800000) {
+    return sign | 0x7e00;  // NaN
+  }
+  if (bits == 0x7f800000) {
+    return sign | 0x7c00;  // Infinity, as a diverging gradient would be.
+  }
+  if (bits >= 0x477fe000) {
+    // Saturate at the largest half, 65504, rather than overflow to infinity:
+    // the value is finite in float, and with error feedback the residual
+    // keeps the rest.
+    LOG_EVERY_N(WARNING, 1000) << "Half float overflow: " << value
+        << " saturated at " << (sign ? "-" : "") << "65504 ("
+        << google::COUNTER << " times)";
+    return sign | 0x7bff;
+  }
+  const uint32_t exponent = bits >> 23;
+  if (exponent >= 113) {
+    // Normal: rebias the exponent, and round the 13 dropped bits.
+    uint32_t half = (bits - (112u << 23)) >> 13;
+    const uint32_t rest = bits & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+  if (exponent < 102) {
+    return sign;  // Rounds to zero.
+  }
+  // Subnormal: value = mantissa * 2^(exponent - 150), in units of 2^-24.
+  const uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+  const int shift = 126 - exponent;
+  uint32_t half = mantissa >> shift;
+  const uint32_t rest = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  if (rest > halfway || (rest == halfway && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+float caffe_half_to_float(uint16_t half) {
+  const uint32_t sign = uint32_t(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1f;
+  const uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0) {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  } else if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// The MPI_Op summing half floats.
+static void HalfSum(void* in, void* inout, int* len, MPI_Datatype* type) {
+  const uint16_t* a = static_cast<const uint16_t*>(in);
+  uint16_t* b = static_cast<uint16_t*>(inout);
+  for (int i = 0; i < *len; ++i) {
+    b[i] = caffe_float_to_half(
+        caffe_half_to_float(a[i]) + caffe_half_to_float(b[i]));
+  }
+}
+
+template <typename Dtype>
+shared_ptr<GradientCompressor> CreateGradientCompressor(
+    const GradientCompressionParameter& param) {
+  switch (param.method()) {
+  case GradientCompressionParameter_Method_FP16:
+    return shared_ptr<GradientCompressor>(
+        new FP16GradientCompressor<Dtype>(param.error_feedback()));
+  case GradientCompressionParameter_Method_TOPK:
+    return shared_ptr<GradientCompressor>(
+        new TopKGradientCompressor<Dtype>(param.topk_ratio(),
+            param.error_feedback()));
+  default:
+    return shared_ptr<GradientCompressor>();
+  }
+}
+
+template <typename Dtype>
+FP16GradientCompressor<Dtype>::FP16GradientCompressor(bool error_feedback)
+    : error_feedback_(error_feedback) {
+  MPI_CHECK(MPI_Op_create(&HalfSum, 1, &sum_op_));
+}
+
+template <typename Dtype>
+FP16GradientCompressor<Dtype>::~FP16GradientCompressor() {
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (!finalized) {
+    MPI_Op_free(&sum_op_);
+  }
+}
+
+template <typename Dtype>
+void FP16GradientCompressor<Dtype>::Allreduce(void* data, int count,
+    MPI_Comm comm) {
+  if (count == 0) {
+    return;
+  }
+  Dtype* gradient = static_cast<Dtype*>(data);
+  const double start = MPI_Wtime();
+  halves_.resize(count);
+  if (error_feedback_ && residual_.size() != count) {
+    residual_.assign(count, Dtype(0));
+  }
+  for (int i = 0; i < count; ++i) {
+    const Dtype value = gradient[i] + (error_feedback_ ? residual_[i] : 0);
+    halves_[i] = caffe_float_to_half(static_cast<float>(value));
+    if (error_feedback_) {
+      residual_[i] = value - caffe_half_to_float(halves_[i]);
+    }
+  }
+  const double encoded = MPI_Wtime();
+  MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &halves_[0], count,
+      MPI_UNSIGNED_SHORT, sum_op_, comm));
+  const double exchanged = MPI_Wtime();
+  for (int i = 0; i < count; ++i) {
+    gradient[i] = caffe_half_to_float(halves_[i]);
+  }
+  stats_.raw_bytes += size_t(count) * sizeof(Dtype);
+  stats_.sent_bytes += size_t(count) * sizeof(uint16_t);
+  stats_.encode_seconds += (encoded - start) + (MPI_Wtime() - exchanged);
+  stats_.exchange_seconds += exchanged - encoded;
+}
+
+// The magnitude the elements are ranked by. NaN ranks with infinity, so that
+// it is sent and shows in the sum as it would uncompressed, and the ranking
+// stays the strict weak order nth_element needs.
+template <typename Dtype>
+static Dtype Magnitude(Dtype value) {
+  return value != value ? std::numeric_limits<Dtype>::infinity() :
+      std::fabs(value);
+}
+
+template <typename Dtype>
+TopKGradientCompressor<Dtype>::TopKGradientCompressor(float ratio,
+    bool error_feedback)
+    : ratio_(ratio), error_feedback_(error_feedback) {
+  CHECK_GT(ratio_, 0) << "topk_ratio must be in (0, 1].";
+  CHECK_LE(ratio_, 1) << "topk_ratio must be in (0, 1].";
+}
+
+template <typename Dtype>
+int TopKGradientCompressor<Dtype>::NumSent(int count) const {
+  return std::min(count, std::max(1,
+      static_cast<int>(std::ceil(double(ratio_) * count))));
+}
+
+template <typename Dtype>
+void TopKGradientCompressor<Dtype>::Allreduce(void* data, int count,
+    MPI_Comm comm) {
+  if (count == 0) {
+    return;
+  }
+  Dtype* gradient = static_cast<Dtype*>(data);
+  const double start = MPI_Wtime();
+  if (error_feedback_) {
+    if (residual_.size() != count) {
+      residual_.assign(count, Dtype(0));
+    }
+    // The residual becomes the full gradient, and loses what is sent.
+    caffe_add(count, gradient, &residual_[0], &residual_[0]);
+    gradient = &residual_[0];
+  }
+
+  // The k-th largest magnitude, and how many of the elements equal to it
+  // are sent after the larger ones.
+  const int k = NumSent(count);
+  magnitudes_.resize(count);
+  for (int i = 0; i < count; ++i) {
+    magnitudes_[i] = Magnitude(gradient[i]);
+  }
+  std::nth_element(magnitudes_.begin(), magnitudes_.begin() + (count - k),
+      magnitudes_.end());
+  const Dtype threshold = magnitudes_[count - k];
+  int num_ties = k;
+  for (int i = 0; i < count; ++i) {
+    if (Magnitude(gradient[i]) > threshold) {
+      --num_ties;
+    }
+  }
+  sent_.clear();
+  for (int i = 0; i < count && static_cast<int>(sent_.size()) < k; ++i) {
+    const Dtype magnitude = Magnitude(gradient[i]);
+    if (magnitude > threshold || (magnitude == threshold && num_ties-- > 0)) {
+      Element element = {i, static_cast<float>(gradient[i])};
+      sent_.push_back(element);
+      if (error_feedback_) {
+        residual_[i] -= element.value;
+      }
+    }
+  }
+  // The gather reads k elements from every rank.
+  CHECK_EQ(k, static_cast<int>(sent_.size()))
+      << "Top-k selection sent " << sent_.size() << " of " << k
+      << " elements.";
+  const double encoded = MPI_Wtime();
+
+  // Every rank sends k elements, so the gather needs no counts.
+  int size;
+  MPI_Comm_size(comm, &size);
+  received_.resize(size_t(k) * size);
+  MPI_CHECK(MPI_Allgather(&sent_[0], k * sizeof(Element), MPI_BYTE,
+      &received_[0], k * sizeof(Element), MPI_BYTE, comm));
+  const double exchanged = MPI_Wtime();
+
+  Dtype* sum = static_cast<Dtype*>(data);
+  caffe_set(count, Dtype(0), sum);
+  for (int i = 0; i < received_.size(); ++i) {
+    const int index = received_[i].index;
+    CHECK(index >= 0 && index < count) << "Rank " << i / k
+        << " sent the element " << index << " of " << count << ".";
+    sum[index] += received_[i].value;
+  }
+  stats_.raw_bytes += size_t(count) * sizeof(Dtype);
+  stats_.sent_bytes += size_t(k) * sizeof(Element);
+  stats_.encode_seconds += (encoded - start) + (MPI_Wtime() - exchanged);
+  stats_.exchange_seconds += exchanged - encoded;
+}
+
+template shared_ptr<GradientCompressor> CreateGradientCompressor<float>(
+    const GradientCompressionParameter& param);
+template shared_ptr<GradientCompressor> CreateGradientCompressor<double>(
+    const GradientCompressionParameter& param);
+INSTANTIATE_CLASS(FP16GradientCompressor);
+INSTANTIATE_CLASS(TopKGradientCompressor);
+
+}  // namespace caffe
+
+#endif  // USE_MPI
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -80,4 +81,152 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, double* data_im);
 
+// The columns w of a row of the column buffer that read the image for the
+// column kernel_w of the kernel, i.e. w * stride - pad + kernel_w in
+// [0, width): [w_begin, w_end), the same for every row.
+static inline void Im2colValidColumns(const int kernel_w, const int width,
+    const int width_col, const int stride, const int pad, int* w_begin,
+    int* w_end) {
+  const int first = pad - kernel_w;
+  const int last = width - 1 + pad - kernel_w;
+  *w_begin = std::min(width_col,
+      first > 0 ? (first + stride - 1) / stride : 0);
+  *w_end = last >= 0 ? std::min(width_col, last / stride + 1) : 0;
+  *w_end = std::max(*w_end, *w_begin);
+}
+
+// im2col_cpu for a square kernel whose size, stride and pad are known at
+// compile time. The padding is split out of each row: the interior is one
+// copy, contiguous for a stride of 1, and the rest zeroed, instead of a
+// bounds check per element. The runtime shape arguments are ignored.
+template <typename Dtype, int kKernel, int kStride, int kPad>
+static void Im2colFixed(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  const int height_col = (height + 2 * kPad - kKernel) / kStride + 1;
+  const int width_col = (width + 2 * kPad - kKernel) / kStride + 1;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* channel = data_im + c * height * width;
+    for (int kh = 0; kh < kKernel; ++kh) {
+      for (int kw = 0; kw < kKernel; ++kw) {
+        int w_begin, w_end;
+        Im2colValidColumns(kw, width, width_col, kStride, kPad, &w_begin,
+            &w_end);
+        const int w_offset = kw - kPad;
+        for (int h = 0; h < height_col; ++h) {
+          const int h_im = h * kStride - kPad + kh;
+          if (h_im < 0 || h_im >= height) {
+            memset(data_col, 0, sizeof(Dtype) * width_col);
+          } else {
+            const Dtype* row = channel + h_im * width;
+            memset(data_col, 0, sizeof(Dtype) * w_begin);
+            if (kStride == 1) {
+              memcpy(data_col + w_begin, row + w_begin + w_offset,
+                  sizeof(Dtype) * (w_end - w_begin));
+            } else {
+              for (int w = w_begin; w < w_end; ++w) {
+                data_col[w] = row[w * kStride + w_offset];
+              }
+            }
+            memset(data_col + w_end, 0, sizeof(Dtype) * (width_col - w_end));
+          }
+          data_col += width_col;
+        }
+      }
+    }
+  }
+}
+
+// col2im_cpu for the same shapes. Each pixel sums its columns in the same
+// order as col2im_cpu does, so the results are identical.
+template <typename Dtype, int kKernel, int kStride, int kPad>
+static void Col2imFixed(const Dtype* data_col, const int channels,
+    const int height, const int width, const int patch_h, const int patch_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  caffe_set(height * width * channels, Dtype(0), data_im);
+  const int height_col = (height + 2 * kPad - kKernel) / kStride + 1;
+  const int width_col = (width + 2 * kPad - kKernel) / kStride + 1;
+  for (int c = 0; c < channels; ++c) {
+    Dtype* channel = data_im + c * height * width;
+    for (int kh = 0; kh < kKernel; ++kh) {
+      for (int kw = 0; kw < kKernel; ++kw) {
+        int w_begin, w_end;
+        Im2colValidColumns(kw, width, width_col, kStride, kPad, &w_begin,
+            &w_end);
+        const int w_offset = kw - kPad;
+        for (int h = 0; h < height_col; ++h) {
+          const int h_im = h * kStride - kPad + kh;
+          if (h_im >= 0 && h_im < height) {
+            Dtype* row = channel + h_im * width;
+            for (int w = w_begin; w < w_end; ++w) {
+              row[w * kStride + w_offset] += data_col[w];
+            }
+          }
+          data_col += width_col;
+        }
+      }
+    }
+  }
+}
+
+// The shapes of our models with their own kernels: 3x3 stride 1 pad 1,
+// 1x1 stride 2, 5x5 stride 1 pad 2, 7x7 stride 2 pad 3 and 11x11 stride 4.
+template <typename Dtype>
+typename Im2colKernel<Dtype>::Func GetIm2colKernel(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w) {
+  if (kernel_h == kernel_w && pad_h == pad_w && stride_h == stride_w) {
+    const int kernel = kernel_h, pad = pad_h, stride = stride_h;
+    if (kernel == 3 && stride == 1 && pad == 1) {
+      return Im2colFixed<Dtype, 3, 1, 1>;
+    } else if (kernel == 1 && stride == 2 && pad == 0) {
+      return Im2colFixed<Dtype, 1, 2, 0>;
+    } else if (kernel == 5 && stride == 1 && pad == 2) {
+      return Im2colFixed<Dtype, 5, 1, 2>;
+    } else if (kernel == 7 && stride == 2 && pad == 3) {
+      return Im2colFixed<Dtype, 7, 2, 3>;
+    } else if (kernel == 11 && stride == 4 && pad == 0) {
+      return Im2colFixed<Dtype, 11, 4, 0>;
+    }
+  }
+  return im2col_cpu<Dtype>;
+}
+
+template <typename Dtype>
+typename Im2colKernel<Dtype>::Func GetCol2imKernel(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w) {
+  if (kernel_h == kernel_w && pad_h == pad_w && stride_h == stride_w) {
+    const int kernel = kernel_h, pad = pad_h, stride = stride_h;
+    if (kernel == 3 && stride == 1 && pad == 1) {
+      return Col2imFixed<Dtype, 3, 1, 1>;
+    } else if (kernel == 1 && stride == 2 && pad == 0) {
+      return Col2imFixed<Dtype, 1, 2, 0>;
+    } else if (kernel == 5 && stride == 1 && pad == 2) {
+      return Col2imFixed<Dtype, 5, 1, 2>;
+    } else if (kernel == 7 && stride == 2 && pad == 3) {
+      return Col2imFixed<Dtype, 7, 2, 3>;
+    } else if (kernel == 11 && stride == 4 && pad == 0) {
+      return Col2imFixed<Dtype, 11, 4, 0>;
+    }
+  }
+  return col2im_cpu<Dtype>;
+}
+
+// Explicit instantiation
+template Im2colKernel<float>::Func GetIm2colKernel<float>(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w);
+template Im2colKernel<double>::Func GetIm2colKernel<double>(
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w);
+template Im2colKernel<float>::Func GetCol2imKernel<float>(const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w);
+template Im2colKernel<double>::Func GetCol2imKernel<double>(
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w);
+
 }  // namespace caffe
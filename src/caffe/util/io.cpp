@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
 #include <opencv2/core/core.hpp>
@@ -7,14 +8,20 @@
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <stdint.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <fstream>  // NOLINT(readability/streams)
+#include <iterator>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/frame_cache.hpp"
+#include "caffe/util/frame_pack.hpp"
 #include "caffe/util/io.hpp"
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
@@ -27,6 +34,8 @@ using google::protobuf::io::ZeroCopyInputStream;
 using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::GzipInputStream;
+using google::protobuf::io::GzipOutputStream;
 using google::protobuf::Message;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
@@ -50,13 +59,26 @@ void WriteProtoToTextFile(const Message& proto, const char* filename) {
 bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
   CHECK_NE(fd, -1) << "File not found: " << filename;
+  // Gzipped files, as written by WriteProtoToBinaryFileAtomically, start
+  // with the gzip magic number. A serialized proto cannot: 0x1f is no valid
+  // field tag.
+  unsigned char magic[2] = {0, 0};
+  const bool gzipped = read(fd, magic, 2) == 2
+      && magic[0] == 0x1f && magic[1] == 0x8b;
+  CHECK_EQ(lseek(fd, 0, SEEK_SET), 0) << "Could not seek in " << filename;
   ZeroCopyInputStream* raw_input = new FileInputStream(fd);
-  CodedInputStream* coded_input = new CodedInputStream(raw_input);
+  ZeroCopyInputStream* gzip_input = NULL;
+  if (gzipped) {
+    gzip_input = new GzipInputStream(raw_input, GzipInputStream::GZIP);
+  }
+  CodedInputStream* coded_input =
+      new CodedInputStream(gzipped ? gzip_input : raw_input);
   coded_input->SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
 
   bool success = proto->ParseFromCodedStream(coded_input);
 
   delete coded_input;
+  delete gzip_input;
   delete raw_input;
   close(fd);
   return success;
@@ -67,6 +89,33 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+void WriteProtoToBinaryFileAtomically(const Message& proto,
+    const string& filename, bool compress) {
+  const string temp_filename = filename + ".tmp";
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Could not open " << temp_filename;
+  FileOutputStream* raw_output = new FileOutputStream(fd);
+  if (compress) {
+    GzipOutputStream::Options options;
+    options.format = GzipOutputStream::GZIP;
+    GzipOutputStream* gzip_output = new GzipOutputStream(raw_output, options);
+    CHECK(proto.SerializeToZeroCopyStream(gzip_output))
+        << "Could not write " << temp_filename;
+    CHECK(gzip_output->Close()) << "Could not compress " << temp_filename;
+    delete gzip_output;
+  } else {
+    CHECK(proto.SerializeToZeroCopyStream(raw_output))
+        << "Could not write " << temp_filename;
+  }
+  CHECK(raw_output->Flush()) << "Could not write " << temp_filename;
+  // On disk before the rename makes it visible.
+  CHECK_EQ(fsync(fd), 0) << "Could not sync " << temp_filename;
+  delete raw_output;
+  CHECK_EQ(close(fd), 0) << "Could not close " << temp_filename;
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Could not rename " << temp_filename << " to " << filename;
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color) {
   cv::Mat cv_img;
@@ -303,240 +352,338 @@ void hdf5_save_nd_dataset<double>(
   CHECK_GE(status, 0) << "Failed to make double dataset " << dataset_name;
 }
 
-bool ReadSegmentRGBToDatum(const string& filename, const int label,
-    const vector<int> offsets, const int height, const int width, const int length, Datum* datum, bool is_color){
-	cv::Mat cv_img;
-	string* datum_string;
+// Reads the size of a baseline or progressive JPEG from its SOF marker.
+static bool ReadJpegSize(const uchar* data, const size_t size, int* height, int* width){
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return false;
+	size_t pos = 2;
+	while (pos + 4 <= size){
+		if (data[pos] != 0xFF)
+			return false;
+		const uchar marker = data[pos + 1];
+		if (marker == 0xFF){  // fill byte
+			++pos;
+			continue;
+		}
+		// SOF0 to SOF15, except DHT, JPG and DAC which share the range.
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC){
+			if (pos + 9 > size)
+				return false;
+			*height = (data[pos + 5] << 8) | data[pos + 6];
+			*width = (data[pos + 7] << 8) | data[pos + 8];
+			return true;
+		}
+		pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+	}
+	return false;
+}
+
+// Returns the flag that makes libjpeg decode an image of the given size at
+// the smallest 1/2, 1/4 or 1/8 scale that is still at least height x width,
+// so that the resize that follows never upsamples. Needs OpenCV 3.
+static int ReducedReadFlag(const int cv_read_flag, const int full_height, const int full_width,
+    const int height, const int width){
+#if CV_MAJOR_VERSION >= 3
+	if (height <= 0 || width <= 0)
+		return cv_read_flag;
+	if (cv_read_flag != CV_LOAD_IMAGE_COLOR && cv_read_flag != CV_LOAD_IMAGE_GRAYSCALE)
+		return cv_read_flag;
+	const bool is_color = (cv_read_flag == CV_LOAD_IMAGE_COLOR);
+	int scale = 8;
+	while (scale > 1 && (full_height / scale < height || full_width / scale < width))
+		scale /= 2;
+	switch (scale){
+	case 8:
+		return is_color ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_REDUCED_GRAYSCALE_8;
+	case 4:
+		return is_color ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_GRAYSCALE_4;
+	case 2:
+		return is_color ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_REDUCED_GRAYSCALE_2;
+	}
+#endif
+	return cv_read_flag;
+}
+
+// Decodes an encoded frame, at a reduced scale if reduced_decode is set and
+// the frame is a JPEG large enough for it.
+static cv::Mat DecodeSegmentFrame(const uchar* data, const size_t size, const int cv_read_flag,
+    const int height, const int width, const bool reduced_decode){
+	int flag = cv_read_flag;
+	int full_height, full_width;
+	if (reduced_decode && ReadJpegSize(data, size, &full_height, &full_width))
+		flag = ReducedReadFlag(cv_read_flag, full_height, full_width, height, width);
+	// Wraps the bytes without copying them.
+	const cv::Mat encoded(1, size, CV_8UC1, const_cast<uchar*>(data));
+	return cv::imdecode(encoded, flag);
+}
+
+// cv::imread, with the reduced scale decoding of DecodeSegmentFrame.
+static cv::Mat ReadSegmentFrameFile(const string& path, const int cv_read_flag,
+    const int height, const int width, const bool reduced_decode){
+	if (!reduced_decode)
+		return cv::imread(path, cv_read_flag);
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return cv::Mat();
+	const vector<char> buffer((std::istreambuf_iterator<char>(file)),
+	    std::istreambuf_iterator<char>());
+	if (buffer.empty())
+		return cv::Mat();
+	return DecodeSegmentFrame(reinterpret_cast<const uchar*>(&buffer[0]), buffer.size(),
+	    cv_read_flag, height, width, reduced_decode);
+}
+
+// Loads frame frame_id of a segment stream ("image", "flow_x", "flow_y"),
+// either from the stream_%04d.jpg files under filename or from a frame pack.
+static cv::Mat ReadSegmentFrame(const string& filename, const FramePack* pack,
+    const char* stream, const int frame_id, const int cv_read_flag,
+    const int height, const int width, const bool reduced_decode){
+	if (pack) {
+		const uint8_t* data;
+		size_t size;
+		if (!pack->FrameData(stream, frame_id, &data, &size))
+			return cv::Mat();
+		return DecodeSegmentFrame(data, size, cv_read_flag, height, width, reduced_decode);
+	}
 	char tmp[30];
+	sprintf(tmp,"%s_%04d.jpg",stream,frame_id);
+	return ReadSegmentFrameFile(filename + "/" + tmp, cv_read_flag, height, width, reduced_decode);
+}
+
+// Appends frame frame_id of a segment stream to frames, decoded and resized
+// to height x width if both are set. The frame is taken from the cache if
+// there is one and it holds it, and stored there otherwise.
+static bool AppendSegmentFrame(const string& filename, const FramePack* pack,
+    const char* stream, const int frame_id, const int cv_read_flag,
+    const int height, const int width, const bool reduced_decode,
+    FrameCache* cache, vector<cv::Mat>* frames){
+	string key;
+	if (cache) {
+		std::ostringstream key_stream;
+		key_stream << filename << '|' << stream << '|' << frame_id << '|' << cv_read_flag
+		    << '|' << height << 'x' << width << (reduced_decode ? "|r" : "");
+		key = key_stream.str();
+		cv::Mat cached;
+		if (cache->Lookup(key, &cached)) {
+			frames->push_back(cached);
+			return true;
+		}
+	}
+	cv::Mat cv_img = ReadSegmentFrame(filename, pack, stream, frame_id, cv_read_flag,
+	    height, width, reduced_decode);
+	if (!cv_img.data)
+		return false;
+	if (height > 0 && width > 0){
+		cv::Mat cv_img_resized;
+		cv::resize(cv_img, cv_img_resized, cv::Size(width, height));
+		cv_img = cv_img_resized;
+	}
+	if (cache)
+		cache->Insert(key, cv_img);
+	frames->push_back(cv_img);
+	return true;
+}
+
+static bool ReadSegmentRGBToFrames(const string& filename, const FramePack* pack,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool is_color, bool reduced_decode, FrameCache* cache){
 	int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
 	    CV_LOAD_IMAGE_GRAYSCALE);
+	frames->clear();
 	for (int i = 0; i < offsets.size(); ++i){
 		int offset = offsets[i];
 		for (int file_id = 1; file_id < length+1; ++file_id){
-			sprintf(tmp,"image_%04d.jpg",int(file_id+offset));
-			string filename_t = filename + "/" + tmp;
-			cv::Mat cv_img_origin = cv::imread(filename_t, cv_read_flag);
-			if (!cv_img_origin.data){
+			if (!AppendSegmentFrame(filename, pack, "image", int(file_id+offset), cv_read_flag,
+			    height, width, reduced_decode, cache, frames)){
 				LOG(ERROR) << "Could not load file " << filename;
 				return false;
 			}
-			if (height > 0 && width > 0){
-				cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
-			}else{
-				cv_img = cv_img_origin;
-			}
-			int num_channels = (is_color ? 3 : 1);
-			if (file_id==1 && i==0){
-				datum->set_channels(num_channels*length*offsets.size());
-				datum->set_height(cv_img.rows);
-				datum->set_width(cv_img.cols);
-				datum->set_label(label);
-				datum->clear_data();
-				datum->clear_float_data();
-				datum_string = datum->mutable_data();
-			}
-			if (is_color) {
-			    for (int c = 0; c < num_channels; ++c) {
-			      for (int h = 0; h < cv_img.rows; ++h) {
-			        for (int w = 0; w < cv_img.cols; ++w) {
-			          datum_string->push_back(
-			            static_cast<char>(cv_img.at<cv::Vec3b>(h, w)[c]));
-			        }
-			      }
-			    }
-			  } else {  // Faster than repeatedly testing is_color for each pixel w/i loop
-			    for (int h = 0; h < cv_img.rows; ++h) {
-			      for (int w = 0; w < cv_img.cols; ++w) {
-			        datum_string->push_back(
-			          static_cast<char>(cv_img.at<uchar>(h, w)));
-			        }
-			      }
-			  }
 		}
 	}
 	return true;
 }
 
-bool ReadSegmentFlowToDatum(const string& filename, const int label,
-    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
-	cv::Mat cv_img_x, cv_img_y;
-	string* datum_string;
-	char tmp[30];
+// Appends the x and y fields of flow frame frame_id under filename.
+static bool AppendFlowFrame(const string& filename, const FramePack* pack, const int frame_id,
+    const int height, const int width, const bool reduced_decode, FrameCache* cache,
+    vector<cv::Mat>* frames){
+	if (!AppendSegmentFrame(filename, pack, "flow_x", frame_id, CV_LOAD_IMAGE_GRAYSCALE,
+	        height, width, reduced_decode, cache, frames) ||
+	    !AppendSegmentFrame(filename, pack, "flow_y", frame_id, CV_LOAD_IMAGE_GRAYSCALE,
+	        height, width, reduced_decode, cache, frames)){
+		LOG(ERROR) << "Could not load flow frame " << frame_id << " of " << filename;
+		return false;
+	}
+	return true;
+}
+
+static bool ReadSegmentFlowToFrames(const string& filename, const FramePack* pack,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool reduced_decode, FrameCache* cache){
+	frames->clear();
 	for (int i = 0; i < offsets.size(); ++i){
 		int offset = offsets[i];
 		for (int file_id = 1; file_id < length+1; ++file_id){
-			sprintf(tmp,"flow_x_%04d.jpg",int(file_id+offset));
-			string filename_x = filename + "/" + tmp;
-			cv::Mat cv_img_origin_x = cv::imread(filename_x, CV_LOAD_IMAGE_GRAYSCALE);
-			sprintf(tmp,"flow_y_%04d.jpg",int(file_id+offset));
-			string filename_y = filename + "/" + tmp;
-			cv::Mat cv_img_origin_y = cv::imread(filename_y, CV_LOAD_IMAGE_GRAYSCALE);
-			if (!cv_img_origin_x.data || !cv_img_origin_y.data){
-				LOG(ERROR) << "Could not load file " << filename_x << " or " << filename_y;
+			if (!AppendFlowFrame(filename, pack, int(file_id+offset), height, width,
+			    reduced_decode, cache, frames))
 				return false;
-			}
-			if (height > 0 && width > 0){
-				cv::resize(cv_img_origin_x, cv_img_x, cv::Size(width, height));
-				cv::resize(cv_img_origin_y, cv_img_y, cv::Size(width, height));
-			}else{
-				cv_img_x = cv_img_origin_x;
-				cv_img_y = cv_img_origin_y;
-			}
-			if (file_id==1 && i==0){
-				int num_channels = 2;
-				datum->set_channels(num_channels*length*offsets.size());
-				datum->set_height(cv_img_x.rows);
-				datum->set_width(cv_img_x.cols);
-				datum->set_label(label);
-				datum->clear_data();
-				datum->clear_float_data();
-				datum_string = datum->mutable_data();
-			}
-			for (int h = 0; h < cv_img_x.rows; ++h){
-				for (int w = 0; w < cv_img_x.cols; ++w){
-					datum_string->push_back(static_cast<char>(cv_img_x.at<uchar>(h,w)));
-				}
-			}
-			for (int h = 0; h < cv_img_y.rows; ++h){
-				for (int w = 0; w < cv_img_y.cols; ++w){
-					datum_string->push_back(static_cast<char>(cv_img_y.at<uchar>(h,w)));
-				}
-			}
 		}
 	}
 	return true;
 }
 
-bool ReadSegmentFlowToDatum_KD(const string& filename, const string& dir_mvs, const string& dir_tvl1, const int label,
-    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
-	cv::Mat cv_img_x, cv_img_y;
-	string* datum_string;
-	char tmp[30];
+bool ReadSegmentRGBToFrames(const string& filename, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames, bool is_color,
+    bool reduced_decode, FrameCache* cache){
+	return ReadSegmentRGBToFrames(filename, NULL, offsets, height, width, length, frames, is_color,
+	    reduced_decode, cache);
+}
+
+bool ReadSegmentRGBToFrames(const FramePack& pack, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames, bool is_color,
+    bool reduced_decode, FrameCache* cache){
+	return ReadSegmentRGBToFrames(pack.filename(), &pack, offsets, height, width, length, frames, is_color,
+	    reduced_decode, cache);
+}
+
+bool ReadSegmentFlowToFrames(const string& filename, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames,
+    bool reduced_decode, FrameCache* cache){
+	return ReadSegmentFlowToFrames(filename, NULL, offsets, height, width, length, frames,
+	    reduced_decode, cache);
+}
+
+bool ReadSegmentFlowToFrames(const FramePack& pack, const vector<int>& offsets,
+    const int height, const int width, const int length, vector<cv::Mat>* frames,
+    bool reduced_decode, FrameCache* cache){
+	return ReadSegmentFlowToFrames(pack.filename(), &pack, offsets, height, width, length, frames,
+	    reduced_decode, cache);
+}
+
+bool ReadSegmentFlowToFrames_KD(const string& filename, const string& dir_mvs, const string& dir_tvl1,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool reduced_decode, FrameCache* cache){
+	frames->clear();
 	for (int i = 0; i < offsets.size(); ++i){
 		int offset = offsets[i];
-//	            LOG(INFO)<< "Your turn" ;
 		for (int path = 0; path < 2; path++) {
-		string path_select;
-			if (path == 0)
-				path_select = dir_mvs;
-			if (path == 1)
-				path_select = dir_tvl1;
+			const string video_dir = (path == 0 ? dir_mvs : dir_tvl1) + filename;
 			for (int file_id = 1; file_id < length+1; ++file_id){
-				sprintf(tmp,"flow_x_%04d.jpg",int(file_id+offset));
-				string filename_x = path_select + filename + "/" + tmp;
-				cv::Mat cv_img_origin_x = cv::imread(filename_x, CV_LOAD_IMAGE_GRAYSCALE);
-				sprintf(tmp,"flow_y_%04d.jpg",int(file_id+offset));
-				string filename_y = path_select + filename + "/" + tmp;
-//                LOG(INFO)<< filename_x;
-//                LOG(INFO)<< filename_y;
-				cv::Mat cv_img_origin_y = cv::imread(filename_y, CV_LOAD_IMAGE_GRAYSCALE);
-				if (!cv_img_origin_x.data || !cv_img_origin_y.data){
-					LOG(ERROR) << "Could not load file " << filename_x << " or " << filename_y;
+				if (!AppendFlowFrame(video_dir, NULL, int(file_id+offset), height, width,
+				    reduced_decode, cache, frames))
 					return false;
-				}
-				if (height > 0 && width > 0){
-					cv::resize(cv_img_origin_x, cv_img_x, cv::Size(width, height));
-					cv::resize(cv_img_origin_y, cv_img_y, cv::Size(width, height));
-				}else{
-					cv_img_x = cv_img_origin_x;
-					cv_img_y = cv_img_origin_y;
-				}
-				if (file_id==1 && i==0 && path == 0){
-					int num_channels = 2;
-					datum->set_channels(2 * num_channels*length*offsets.size());
-					datum->set_height(cv_img_x.rows);
-					datum->set_width(cv_img_x.cols);
-					datum->set_label(label);
-					datum->clear_data();
-					datum->clear_float_data();
-					datum_string = datum->mutable_data();
-				}
-				for (int h = 0; h < cv_img_x.rows; ++h){
-					for (int w = 0; w < cv_img_x.cols; ++w){
-						datum_string->push_back(static_cast<char>(cv_img_x.at<uchar>(h,w)));
-					}
-				}
-				for (int h = 0; h < cv_img_y.rows; ++h){
-					for (int w = 0; w < cv_img_y.cols; ++w){
-						datum_string->push_back(static_cast<char>(cv_img_y.at<uchar>(h,w)));
-					}
-				}
 			}
 		}
 	}
 	return true;
 }
 
-bool ReadSegmentFlowToDatum_KDRF(const string& filename, const string& dir_img, const string& dir_tvl1, const int label,
-    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
-	cv::Mat cv_img_i, cv_img_x, cv_img_y;
-	string* datum_string;
-	char tmp[30];
-  int num_channels_rgb = 3;
-  int num_channels_flow = 2;
+bool ReadSegmentFlowToFrames_KDRF(const string& filename, const string& dir_img, const string& dir_tvl1,
+    const vector<int>& offsets, const int height, const int width, const int length,
+    vector<cv::Mat>* frames, bool reduced_decode, FrameCache* cache){
+	const string image_dir = dir_img + filename;
+	const string flow_dir = dir_tvl1 + filename;
+	frames->clear();
 	for (int i = 0; i < offsets.size(); ++i){
 		int offset = offsets[i];
-      sprintf(tmp,"image_%04d.jpg",int(1+offset));
-      string filename_i = dir_img + filename + "/" + tmp;
-      cv::Mat cv_img_origin_i = cv::imread(filename_i, CV_LOAD_IMAGE_GRAYSCALE);
-      if (!cv_img_origin_i.data){
-        LOG(ERROR) << "could not load file image field" << filename_i;
-        return false;
-      }
-      if (height > 0 && width > 0){
-        cv::resize(cv_img_origin_i, cv_img_i, cv::Size(width, height));
-      }else{
-        cv_img_i = cv_img_origin_i;
-      }
-      if (i==0){
-          datum->set_channels((num_channels_rgb + num_channels_flow*length)*offsets.size());
-          datum->set_height(cv_img_i.rows);
-          datum->set_width(cv_img_i.cols);
-          datum->set_label(label);
-          datum->clear_data();
-          datum->clear_float_data();
-          datum_string = datum->mutable_data();
-      }
-      for (int c = 0; c < num_channels_rgb; ++c) {
-	      for (int h = 0; h < cv_img_i.rows; ++h) {
-	        for (int w = 0; w < cv_img_i.cols; ++w) {
-	          datum_string->push_back(
-	            static_cast<char>(cv_img_i.at<cv::Vec3b>(h, w)[c]));
-	        }
-	      }
-	    }
+		if (!AppendSegmentFrame(image_dir, NULL, "image", int(1+offset), CV_LOAD_IMAGE_COLOR,
+		    height, width, reduced_decode, cache, frames)){
+			LOG(ERROR) << "could not load file image field " << image_dir;
+			return false;
+		}
+		for (int file_id = 1; file_id < length+1; ++file_id){
+			if (!AppendFlowFrame(flow_dir, NULL, int(file_id+offset), height, width,
+			    reduced_decode, cache, frames))
+				return false;
+		}
+	}
+	return true;
+}
 
-			for (int file_id = 1; file_id < length+1; ++file_id){
-				sprintf(tmp,"flow_x_%04d.jpg",int(file_id+offset));
-				string filename_x = dir_tvl1 + filename + "/" + tmp;
-				cv::Mat cv_img_origin_x = cv::imread(filename_x, CV_LOAD_IMAGE_GRAYSCALE);
-				sprintf(tmp,"flow_y_%04d.jpg",int(file_id+offset));
-				string filename_y = dir_tvl1 + filename + "/" + tmp;
-				cv::Mat cv_img_origin_y = cv::imread(filename_y, CV_LOAD_IMAGE_GRAYSCALE);
-				if (!cv_img_origin_x.data || !cv_img_origin_y.data){
-					LOG(ERROR) << "Could not load file " << filename_x << " or " << filename_y;
-					return false;
-				}
-				if (height > 0 && width > 0){
-					cv::resize(cv_img_origin_x, cv_img_x, cv::Size(width, height));
-					cv::resize(cv_img_origin_y, cv_img_y, cv::Size(width, height));
-				}else{
-					cv_img_x = cv_img_origin_x;
-					cv_img_y = cv_img_origin_y;
-				}
-				for (int h = 0; h < cv_img_x.rows; ++h){
-					for (int w = 0; w < cv_img_x.cols; ++w){
-						datum_string->push_back(static_cast<char>(cv_img_x.at<uchar>(h,w)));
-					}
-				}
-				for (int h = 0; h < cv_img_y.rows; ++h){
-					for (int w = 0; w < cv_img_y.cols; ++w){
-						datum_string->push_back(static_cast<char>(cv_img_y.at<uchar>(h,w)));
-					}
+void FramesToDatum(const vector<cv::Mat>& frames, const int label, Datum* datum){
+	CHECK(!frames.empty()) << "No frame to store";
+	const int rows = frames[0].rows;
+	const int cols = frames[0].cols;
+	int channels = 0;
+	for (int i = 0; i < frames.size(); ++i){
+		CHECK_EQ(frames[i].depth(), CV_8U) << "Frames must be 8-bit images";
+		CHECK_EQ(frames[i].rows, rows) << "All the frames must have the same size";
+		CHECK_EQ(frames[i].cols, cols) << "All the frames must have the same size";
+		channels += frames[i].channels();
+	}
+	datum->set_channels(channels);
+	datum->set_height(rows);
+	datum->set_width(cols);
+	datum->set_label(label);
+	datum->clear_data();
+	datum->clear_float_data();
+	string* datum_string = datum->mutable_data();
+	datum_string->reserve(channels * rows * cols);
+	// Each plane of each frame becomes one datum channel, in order.
+	for (int i = 0; i < frames.size(); ++i){
+		const int num_channels = frames[i].channels();
+		for (int c = 0; c < num_channels; ++c){
+			for (int h = 0; h < rows; ++h){
+				const uchar* ptr = frames[i].ptr<uchar>(h);
+				for (int w = 0; w < cols; ++w){
+					datum_string->push_back(static_cast<char>(ptr[w * num_channels + c]));
 				}
 			}
-
+		}
 	}
+}
+
+bool ReadSegmentRGBToDatum(const string& filename, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum, bool is_color){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentRGBToFrames(filename, offsets, height, width, length, &frames, is_color))
+		return false;
+	FramesToDatum(frames, label, datum);
+	return true;
+}
+
+bool ReadSegmentRGBToDatum(const FramePack& pack, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum, bool is_color){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentRGBToFrames(pack, offsets, height, width, length, &frames, is_color))
+		return false;
+	FramesToDatum(frames, label, datum);
+	return true;
+}
+
+bool ReadSegmentFlowToDatum(const string& filename, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentFlowToFrames(filename, offsets, height, width, length, &frames))
+		return false;
+	FramesToDatum(frames, label, datum);
+	return true;
+}
+
+bool ReadSegmentFlowToDatum(const FramePack& pack, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentFlowToFrames(pack, offsets, height, width, length, &frames))
+		return false;
+	FramesToDatum(frames, label, datum);
+	return true;
+}
+
+bool ReadSegmentFlowToDatum_KD(const string& filename, const string& dir_mvs, const string& dir_tvl1, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentFlowToFrames_KD(filename, dir_mvs, dir_tvl1, offsets, height, width, length, &frames))
+		return false;
+	FramesToDatum(frames, label, datum);
+	return true;
+}
+
+bool ReadSegmentFlowToDatum_KDRF(const string& filename, const string& dir_img, const string& dir_tvl1, const int label,
+    const vector<int> offsets, const int height, const int width, const int length, Datum* datum){
+	vector<cv::Mat> frames;
+	if (!ReadSegmentFlowToFrames_KDRF(filename, dir_img, dir_tvl1, offsets, height, width, length, &frames))
+		return false;
+	FramesToDatum(frames, label, datum);
 	return true;
 }
 }  // namespace caffe
@@ -10,60 +10,83 @@
 
 namespace caffe {
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* data, int count){
+  MPIJobFuture caffe_iallreduce(Dtype* data, int count){
     MPIJob job = {data, data, count, sizeof(Dtype), OP_SUM_ALL};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
 
-  template void caffe_iallreduce<float>(float* data, int count);
-  template void caffe_iallreduce<double>(double* data, int count);
+  template MPIJobFuture caffe_iallreduce<float>(float* data, int count);
+  template MPIJobFuture caffe_iallreduce<double>(double* data, int count);
 
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* data, int count, cudaStream_t stream){
+  MPIJobFuture caffe_iallreduce_compressed(Dtype* data, int count,
+                                           GradientCompressor* compressor){
+    MPIJob job = {data, data, count, sizeof(Dtype), OP_SUM_COMPRESSED};
+    job.compressor_ = compressor;
+    return MPIComm::AddMPIJob(job);
+  }
+
+  template MPIJobFuture caffe_iallreduce_compressed<float>(
+      float* data, int count, GradientCompressor* compressor);
+  template MPIJobFuture caffe_iallreduce_compressed<double>(
+      double* data, int count, GradientCompressor* compressor);
+
+#ifndef CPU_ONLY
+  template <typename Dtype>
+  MPIJobFuture caffe_iallreduce(Dtype* data, int count, cudaStream_t stream){
     MPIJob job = {data, data, count, sizeof(Dtype), OP_SUM_ALL, stream};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
 
-  template void caffe_iallreduce<float>(float* data, int count, cudaStream_t stream);
-  template void caffe_iallreduce<double>(double* data, int count, cudaStream_t stream);
+  template MPIJobFuture caffe_iallreduce<float>(float* data, int count, cudaStream_t stream);
+  template MPIJobFuture caffe_iallreduce<double>(double* data, int count, cudaStream_t stream);
+#endif
 
   template <typename Dtype>
-  void caffe_iallreduce(Dtype* src_data, Dtype* dst_data, int count){
+  MPIJobFuture caffe_iallreduce(Dtype* src_data, Dtype* dst_data, int count){
     MPIJob job = {src_data, dst_data, count, sizeof(Dtype), OP_SUM_ALL};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
 
-  template void caffe_iallreduce<float>(float* src_data, float* dst_data, int count);
-  template void caffe_iallreduce<double>(double* src_data, double* dst_data, int count);
+  template MPIJobFuture caffe_iallreduce<float>(float* src_data, float* dst_data, int count);
+  template MPIJobFuture caffe_iallreduce<double>(double* src_data, double* dst_data, int count);
 
   template <typename Dtype>
-  void caffe_iallgather(Dtype* src_data, Dtype* dst_data, int count){
+  MPIJobFuture caffe_iallgather(Dtype* src_data, Dtype* dst_data, int count){
     MPIJob job = {src_data, dst_data, count, sizeof(Dtype), OP_GATHER};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
-  template void caffe_iallgather<float>(float*, float*, int);
-  template void caffe_iallgather<double>(double*, double*, int);
+  template MPIJobFuture caffe_iallgather<float>(float*, float*, int);
+  template MPIJobFuture caffe_iallgather<double>(double*, double*, int);
 
   template <typename Dtype>
-  void caffe_iscatter(Dtype* src_data, Dtype* dst_data, int count){
+  MPIJobFuture caffe_iscatter(Dtype* src_data, Dtype* dst_data, int count){
     MPIJob job = {src_data, dst_data, count, sizeof(Dtype), OP_SCATTER};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
 
-  template void caffe_iscatter<float>(float*, float*, int);
-  template void caffe_iscatter<double>(double*, double*, int);
+  template MPIJobFuture caffe_iscatter<float>(float*, float*, int);
+  template MPIJobFuture caffe_iscatter<double>(double*, double*, int);
 
   template <typename Dtype>
-  void caffe_ibcast(Dtype* data, int count){
+  MPIJobFuture caffe_ibcast(Dtype* data, int count){
     MPIJob job = {data, data, count, sizeof(Dtype), OP_BROADCAST};
-    MPIComm::AddMPIJob(job);
+    return MPIComm::AddMPIJob(job);
   }
-  template void caffe_ibcast<float>(float* data, int count);
-  template void caffe_ibcast<double>(double* data, int count);
+  template MPIJobFuture caffe_ibcast<float>(float* data, int count);
+  template MPIJobFuture caffe_ibcast<double>(double* data, int count);
 
   void mpi_force_synchronize(){
     MPIComm::Syncrhonize();
   }
+
+  void mpi_set_bucket_bytes(size_t bytes){
+    MPIComm::SetBucketBytes(bytes);
+  }
+
+  void mpi_set_allreduce(AllreduceAlgorithm algorithm, size_t chunk_bytes){
+    MPIComm::SetAllreduce(algorithm, chunk_bytes);
+  }
 }
 
 #endif //USE_MPI
\ No newline at end of file
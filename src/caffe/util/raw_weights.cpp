@@ -0,0 +1,202 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/raw_weights.hpp"
+
+namespace caffe {
+
+static const char kRawWeightsMagic[4] = {'C', 'R', 'W', '1'};
+// Magic, index size and data offset.
+static const size_t kRawWeightsHeaderSize = 16;
+
+static uint64_t AlignRawWeightsOffset(uint64_t offset) {
+  return (offset + kRawWeightsAlignment - 1) / kRawWeightsAlignment *
+      kRawWeightsAlignment;
+}
+
+static uint64_t RawWeightsBlobCount(const BlobProto& blob) {
+  if (blob.has_num() || blob.has_channels() ||
+      blob.has_height() || blob.has_width()) {
+    // The 4D dimensions of old models.
+    return uint64_t(blob.num()) * blob.channels() * blob.height() *
+        blob.width();
+  }
+  uint64_t count = 1;
+  for (int i = 0; i < blob.shape().dim_size(); ++i) {
+    count *= blob.shape().dim(i);
+  }
+  return count;
+}
+
+RawWeights::RawWeights()
+    : data_(NULL), size_(0) {}
+
+RawWeights::~RawWeights() {
+  Close();
+}
+
+bool RawWeights::Open(const string& filename) {
+  Close();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "Could not open raw weights " << filename;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    LOG(ERROR) << "Could not stat raw weights " << filename;
+    close(fd);
+    return false;
+  }
+  // Private and writable: the pages are shared until a process writes to
+  // them, and the writes never reach the file.
+  void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+      fd, 0);
+  // The mapping stays valid once the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Could not map raw weights " << filename;
+    return false;
+  }
+  filename_ = filename;
+  data_ = static_cast<uint8_t*>(data);
+  size_ = st.st_size;
+
+  if (size_ < kRawWeightsHeaderSize ||
+      memcmp(data_, kRawWeightsMagic, sizeof(kRawWeightsMagic)) != 0) {
+    LOG(ERROR) << filename << " is not a raw weights file";
+    Close();
+    return false;
+  }
+  uint32_t index_size;
+  uint64_t data_offset;
+  memcpy(&index_size, data_ + sizeof(kRawWeightsMagic), sizeof(uint32_t));
+  memcpy(&data_offset, data_ + sizeof(kRawWeightsMagic) + sizeof(uint32_t),
+      sizeof(uint64_t));
+  if (data_offset < kRawWeightsHeaderSize + index_size ||
+      data_offset % kRawWeightsAlignment != 0 || data_offset > size_ ||
+      !index_.ParseFromArray(data_ + kRawWeightsHeaderSize, index_size)) {
+    LOG(ERROR) << "Corrupted index in raw weights " << filename;
+    Close();
+    return false;
+  }
+  uint64_t offset = data_offset;
+  blob_data_.resize(index_.layer_size());
+  for (int i = 0; i < index_.layer_size(); ++i) {
+    const LayerParameter& layer = index_.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      offset = AlignRawWeightsOffset(offset);
+      const uint64_t bytes = RawWeightsBlobCount(layer.blobs(j)) *
+          sizeof(float);
+      if (offset + bytes > size_) {
+        LOG(ERROR) << "Truncated raw weights " << filename;
+        Close();
+        return false;
+      }
+      blob_data_[i].push_back(reinterpret_cast<float*>(data_ + offset));
+      offset += bytes;
+    }
+  }
+  return true;
+}
+
+void RawWeights::Close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  filename_.clear();
+  data_ = NULL;
+  size_ = 0;
+  index_.Clear();
+  blob_data_.clear();
+}
+
+void RawWeights::ToProto(NetParameter* param) const {
+  CHECK(is_open());
+  param->CopyFrom(index_);
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer = param->mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      const uint64_t count = RawWeightsBlobCount(*blob);
+      const float* data = blob_data(i, j);
+      blob->mutable_data()->Reserve(count);
+      for (uint64_t k = 0; k < count; ++k) {
+        blob->add_data(data[k]);
+      }
+    }
+  }
+}
+
+bool IsRawWeightsFile(const string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kRawWeightsMagic)];
+  return file.read(magic, sizeof(magic)) &&
+      memcmp(magic, kRawWeightsMagic, sizeof(magic)) == 0;
+}
+
+bool WriteRawWeights(const string& filename, const NetParameter& param) {
+  // The index is the net without the data.
+  NetParameter index(param);
+  for (int i = 0; i < index.layer_size(); ++i) {
+    LayerParameter* layer = index.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      if (RawWeightsBlobCount(*blob) != blob->data_size()) {
+        LOG(ERROR) << "Blob " << j << " of layer " << layer->name()
+            << " has " << blob->data_size() << " values for its shape of "
+            << RawWeightsBlobCount(*blob);
+        return false;
+      }
+      blob->clear_data();
+      blob->clear_diff();
+    }
+  }
+  string serialized_index;
+  CHECK(index.SerializeToString(&serialized_index));
+  const uint32_t index_size = serialized_index.size();
+  const uint64_t data_offset =
+      AlignRawWeightsOffset(kRawWeightsHeaderSize + index_size);
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!output.is_open()) {
+    LOG(ERROR) << "Could not write raw weights " << filename;
+    return false;
+  }
+  output.write(kRawWeightsMagic, sizeof(kRawWeightsMagic));
+  output.write(reinterpret_cast<const char*>(&index_size), sizeof(uint32_t));
+  output.write(reinterpret_cast<const char*>(&data_offset), sizeof(uint64_t));
+  output.write(serialized_index.data(), index_size);
+  const vector<char> padding(kRawWeightsAlignment, 0);
+  uint64_t offset = kRawWeightsHeaderSize + index_size;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const uint64_t aligned = AlignRawWeightsOffset(offset);
+      output.write(&padding[0], aligned - offset);
+      const BlobProto& blob = layer.blobs(j);
+      if (blob.data_size() > 0) {
+        output.write(reinterpret_cast<const char*>(blob.data().data()),
+            blob.data_size() * sizeof(float));
+      }
+      offset = aligned + blob.data_size() * sizeof(float);
+    }
+  }
+  // A net without blobs still has its data offset within the file.
+  if (offset < data_offset) {
+    output.write(&padding[0], data_offset - offset);
+  }
+  return output.good();
+}
+
+}  // namespace caffe
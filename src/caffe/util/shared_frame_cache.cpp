@@ -0,0 +1,325 @@
+#ifdef USE_MPI
+
+#include <fcntl.h>
+#include <mpi.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "caffe/util/shared_frame_cache.hpp"
+
+namespace caffe {
+
+const int SharedFrameCache::kWays;
+const int SharedFrameCache::kMaxKeyLength;
+const size_t SharedFrameCache::kDefaultSlotBytes;
+
+static const uint64_t kSharedFrameCacheMagic = 0x4346434d52465343ULL;
+
+// The layout of the segment: one Header, then num_sets * kWays slots of
+// slot_stride bytes each, every Slot followed by slot_bytes of pixels.
+struct SharedFrameCache::Header {
+  uint64_t magic;
+  uint64_t mapped_bytes;
+  uint64_t slot_bytes;
+  uint64_t slot_stride;
+  uint64_t num_sets;
+  boost::atomic<uint64_t> clock;
+  boost::atomic<uint64_t> num_frames;
+  boost::atomic<uint64_t> size_bytes;
+  boost::atomic<uint64_t> evictions;
+};
+
+struct SharedFrameCache::Slot {
+  // Odd while a writer fills the slot.
+  boost::atomic<uint32_t> seq;
+  // Written under an odd seq only, so readers must check seq after them.
+  int32_t rows;
+  int32_t cols;
+  int32_t type;
+  uint64_t key_hash;
+  uint32_t key_length;
+  char key[kMaxKeyLength + 1];
+  // Clock of the last insert or hit, for the eviction.
+  boost::atomic<uint64_t> last_used;
+};
+
+static size_t AlignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// FNV-1a.
+static uint64_t HashKey(const string& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < key.size(); ++i) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+SharedFrameCache::SharedFrameCache(void* base, size_t mapped_bytes)
+    : base_(base), mapped_bytes_(mapped_bytes),
+      header_(static_cast<Header*>(base)),
+      slots_(static_cast<char*>(base) + AlignUp(sizeof(Header), 64)),
+      hits_(0), misses_(0) {}
+
+SharedFrameCache::~SharedFrameCache() {
+  munmap(base_, mapped_bytes_);
+}
+
+SharedFrameCache::Slot* SharedFrameCache::slot(size_t index) const {
+  return reinterpret_cast<Slot*>(slots_ + index * header_->slot_stride);
+}
+
+shared_ptr<SharedFrameCache> SharedFrameCache::Create(const string& name,
+    size_t capacity_bytes, size_t slot_bytes) {
+  if (slot_bytes == 0) {
+    slot_bytes = kDefaultSlotBytes;
+  }
+  const size_t slot_stride = AlignUp(sizeof(Slot) + slot_bytes, 64);
+  const size_t num_sets =
+      std::max<size_t>(1, capacity_bytes / (slot_stride * kWays));
+  const size_t mapped_bytes =
+      AlignUp(sizeof(Header), 64) + num_sets * kWays * slot_stride;
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    LOG(WARNING) << "Replacing the stale frame cache " << name;
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  CHECK_GE(fd, 0) << "Could not create the frame cache " << name << ": "
+      << strerror(errno);
+  CHECK_EQ(ftruncate(fd, mapped_bytes), 0) << "Could not size the frame "
+      << "cache " << name << ": " << strerror(errno);
+#ifdef __linux__
+  // Fail now rather than with a SIGBUS once /dev/shm is full.
+  const int error = posix_fallocate(fd, 0, mapped_bytes);
+  CHECK_EQ(error, 0) << "Could not allocate " << mapped_bytes / (1024 * 1024)
+      << " MB of shared memory for the frame cache: " << strerror(error);
+#endif
+  void* base = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0);
+  close(fd);
+  CHECK(base != MAP_FAILED) << "Could not map the frame cache " << name
+      << ": " << strerror(errno);
+
+  // The segment is zero filled, so the slots start empty.
+  Header* header = new (base) Header();
+  header->mapped_bytes = mapped_bytes;
+  header->slot_bytes = slot_bytes;
+  header->slot_stride = slot_stride;
+  header->num_sets = num_sets;
+  header->clock = 0;
+  header->num_frames = 0;
+  header->size_bytes = 0;
+  header->evictions = 0;
+  shared_ptr<SharedFrameCache> cache(new SharedFrameCache(base, mapped_bytes));
+  for (size_t i = 0; i < num_sets * kWays; ++i) {
+    Slot* slot = new (cache->slot(i)) Slot();
+    slot->seq = 0;
+    slot->last_used = 0;
+  }
+  // Publish the header last, Open checks the magic.
+  boost::atomic_thread_fence(boost::memory_order_release);
+  header->magic = kSharedFrameCacheMagic;
+  return cache;
+}
+
+shared_ptr<SharedFrameCache> SharedFrameCache::Open(const string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  CHECK_GE(fd, 0) << "Could not open the frame cache " << name << ": "
+      << strerror(errno);
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << strerror(errno);
+  void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0);
+  close(fd);
+  CHECK(base != MAP_FAILED) << "Could not map the frame cache " << name
+      << ": " << strerror(errno);
+  const Header* header = static_cast<const Header*>(base);
+  CHECK_EQ(header->magic, kSharedFrameCacheMagic) << name
+      << " is not a frame cache";
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  CHECK_EQ(header->mapped_bytes, st.st_size);
+  return shared_ptr<SharedFrameCache>(new SharedFrameCache(base, st.st_size));
+}
+
+void SharedFrameCache::Unlink(const string& name) {
+  shm_unlink(name.c_str());
+}
+
+shared_ptr<SharedFrameCache> SharedFrameCache::CreateNodeShared(
+    size_t capacity_bytes, size_t slot_bytes) {
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL,
+      &node_comm);
+  int node_rank;
+  MPI_Comm_rank(node_comm, &node_rank);
+  // The pid of the first rank names the segment uniquely on the host.
+  int root_pid = getpid();
+  MPI_Bcast(&root_pid, 1, MPI_INT, 0, node_comm);
+  std::ostringstream name;
+  name << "/caffe_frame_cache_" << root_pid;
+
+  shared_ptr<SharedFrameCache> cache;
+  if (node_rank == 0) {
+    cache = Create(name.str(), capacity_bytes, slot_bytes);
+  }
+  MPI_Barrier(node_comm);
+  if (node_rank != 0) {
+    cache = Open(name.str());
+  }
+  MPI_Barrier(node_comm);
+  if (node_rank == 0) {
+    Unlink(name.str());
+  }
+  MPI_Comm_free(&node_comm);
+  return cache;
+}
+
+bool SharedFrameCache::Lookup(const string& key, cv::Mat* frame) {
+  if (key.size() > kMaxKeyLength) {
+    ++misses_;
+    return false;
+  }
+  const uint64_t hash = HashKey(key);
+  const size_t first = (hash % header_->num_sets) * kWays;
+  for (int way = 0; way < kWays; ++way) {
+    Slot* s = slot(first + way);
+    const uint32_t seq = s->seq.load(boost::memory_order_acquire);
+    if ((seq & 1) || s->key_hash != hash) {
+      continue;
+    }
+    const int rows = s->rows;
+    const int cols = s->cols;
+    const int type = s->type;
+    const size_t key_length = s->key_length;
+    // A torn read can give any value: check them before using them.
+    if (rows <= 0 || cols <= 0 || key_length != key.size() ||
+        static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type) >
+        header_->slot_bytes) {
+      continue;
+    }
+    if (memcmp(s->key, key.data(), key_length) != 0) {
+      continue;
+    }
+    cv::Mat copy(rows, cols, type);
+    memcpy(copy.data, reinterpret_cast<const char*>(s + 1),
+        copy.total() * copy.elemSize());
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    if (s->seq.load(boost::memory_order_relaxed) != seq) {
+      // Overwritten while we copied it.
+      continue;
+    }
+    s->last_used.store(header_->clock.fetch_add(1, boost::memory_order_relaxed),
+        boost::memory_order_relaxed);
+    ++hits_;
+    *frame = copy;
+    return true;
+  }
+  ++misses_;
+  return false;
+}
+
+void SharedFrameCache::Insert(const string& key, const cv::Mat& frame) {
+  const size_t bytes = frame.total() * frame.elemSize();
+  if (bytes > header_->slot_bytes || key.size() > kMaxKeyLength) {
+    return;
+  }
+  const uint64_t hash = HashKey(key);
+  const size_t first = (hash % header_->num_sets) * kWays;
+  // Pick an empty slot, or else the least recently used one, unless another
+  // process already cached the frame.
+  Slot* victim = NULL;
+  uint64_t victim_used = 0;
+  for (int way = 0; way < kWays; ++way) {
+    Slot* s = slot(first + way);
+    if (s->key_hash == hash && s->key_length == key.size() &&
+        memcmp(s->key, key.data(), key.size()) == 0) {
+      return;
+    }
+    const uint64_t used = s->last_used.load(boost::memory_order_relaxed);
+    if (s->rows == 0) {
+      victim = s;
+      break;
+    }
+    if (!victim || used < victim_used) {
+      victim = s;
+      victim_used = used;
+    }
+  }
+  uint32_t seq = victim->seq.load(boost::memory_order_relaxed);
+  if ((seq & 1) || !victim->seq.compare_exchange_strong(seq, seq + 1,
+      boost::memory_order_acquire)) {
+    // Another process is writing it.
+    return;
+  }
+  boost::atomic_thread_fence(boost::memory_order_release);
+  if (victim->rows > 0) {
+    header_->size_bytes.fetch_sub(static_cast<size_t>(victim->rows) *
+        victim->cols * CV_ELEM_SIZE(victim->type));
+    header_->num_frames.fetch_sub(1);
+    header_->evictions.fetch_add(1);
+  }
+  victim->rows = frame.rows;
+  victim->cols = frame.cols;
+  victim->type = frame.type();
+  victim->key_hash = hash;
+  victim->key_length = key.size();
+  memcpy(victim->key, key.data(), key.size());
+  char* data = reinterpret_cast<char*>(victim + 1);
+  const size_t row_bytes = frame.cols * frame.elemSize();
+  for (int h = 0; h < frame.rows; ++h) {
+    memcpy(data + h * row_bytes, frame.ptr(h), row_bytes);
+  }
+  victim->last_used.store(header_->clock.fetch_add(1,
+      boost::memory_order_relaxed), boost::memory_order_relaxed);
+  header_->size_bytes.fetch_add(bytes);
+  header_->num_frames.fetch_add(1);
+  victim->seq.store(seq + 2, boost::memory_order_release);
+}
+
+size_t SharedFrameCache::capacity_bytes() const {
+  return header_->num_sets * kWays * header_->slot_bytes;
+}
+
+size_t SharedFrameCache::size_bytes() const {
+  return header_->size_bytes.load(boost::memory_order_relaxed);
+}
+
+size_t SharedFrameCache::num_frames() const {
+  return header_->num_frames.load(boost::memory_order_relaxed);
+}
+
+uint64_t SharedFrameCache::hits() const {
+  return hits_;
+}
+
+uint64_t SharedFrameCache::misses() const {
+  return misses_;
+}
+
+uint64_t SharedFrameCache::evictions() const {
+  return header_->evictions.load(boost::memory_order_relaxed);
+}
+
+size_t SharedFrameCache::slot_bytes() const {
+  return header_->slot_bytes;
+}
+
+size_t SharedFrameCache::num_slots() const {
+  return header_->num_sets * kWays;
+}
+
+}  // namespace caffe
+
+#endif  // USE_MPI
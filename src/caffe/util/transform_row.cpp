@@ -0,0 +1,141 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "caffe/util/transform_row.hpp"
+
+namespace caffe {
+
+// Scalar kernel, also used for the tail of the vectorized rows.
+template <typename Dtype, bool kMirror, bool kInvert, int kMean>
+inline void TransformRowScalar(const uint8_t* src, const int begin,
+    const int width, const Dtype* mean, const Dtype mean_value,
+    const Dtype scale, Dtype* dst) {
+  for (int w = begin; w < width; ++w) {
+    Dtype x = static_cast<Dtype>(src[w]);
+    if (kInvert) {
+      x = 255 - x;
+    }
+    if (kMean == TRANSFORM_MEAN_VALUE) {
+      x = (x - mean_value) * scale;
+    } else if (kMean == TRANSFORM_MEAN_ROW) {
+      x = (x - mean[w]) * scale;
+    } else {
+      x = x * scale;
+    }
+    dst[kMirror ? width - 1 - w : w] = x;
+  }
+}
+
+template <typename Dtype, bool kMirror, bool kInvert, int kMean>
+struct TransformRow {
+  static void Run(const uint8_t* src, const int width, const Dtype* mean,
+      const Dtype mean_value, const Dtype scale, Dtype* dst) {
+    TransformRowScalar<Dtype, kMirror, kInvert, kMean>(src, 0, width, mean,
+        mean_value, scale, dst);
+  }
+};
+
+// The float kernels do the same operations in the same order as the scalar
+// one, lane by lane, so the results are identical.
+template <bool kMirror, bool kInvert, int kMean>
+struct TransformRow<float, kMirror, kInvert, kMean> {
+  static void Run(const uint8_t* src, const int width, const float* mean,
+      const float mean_value, const float scale, float* dst) {
+    int w = 0;
+#if defined(__AVX2__)
+    const __m256 v_255 = _mm256_set1_ps(255.f);
+    const __m256 v_mean = _mm256_set1_ps(mean_value);
+    const __m256 v_scale = _mm256_set1_ps(scale);
+    const __m256i reverse = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (; w + 8 <= width; w += 8) {
+      const __m128i bytes =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + w));
+      __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+      if (kInvert) {
+        x = _mm256_sub_ps(v_255, x);
+      }
+      if (kMean == TRANSFORM_MEAN_VALUE) {
+        x = _mm256_sub_ps(x, v_mean);
+      } else if (kMean == TRANSFORM_MEAN_ROW) {
+        x = _mm256_sub_ps(x, _mm256_loadu_ps(mean + w));
+      }
+      x = _mm256_mul_ps(x, v_scale);
+      if (kMirror) {
+        _mm256_storeu_ps(dst + width - 8 - w,
+            _mm256_permutevar8x32_ps(x, reverse));
+      } else {
+        _mm256_storeu_ps(dst + w, x);
+      }
+    }
+#elif defined(__SSE2__)
+    const __m128 v_255 = _mm_set1_ps(255.f);
+    const __m128 v_mean = _mm_set1_ps(mean_value);
+    const __m128 v_scale = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for (; w + 8 <= width; w += 8) {
+      const __m128i bytes =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + w));
+      const __m128i words = _mm_unpacklo_epi8(bytes, zero);
+      __m128 x[2];
+      x[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+      x[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+      for (int i = 0; i < 2; ++i) {
+        if (kInvert) {
+          x[i] = _mm_sub_ps(v_255, x[i]);
+        }
+        if (kMean == TRANSFORM_MEAN_VALUE) {
+          x[i] = _mm_sub_ps(x[i], v_mean);
+        } else if (kMean == TRANSFORM_MEAN_ROW) {
+          x[i] = _mm_sub_ps(x[i], _mm_loadu_ps(mean + w + 4 * i));
+        }
+        x[i] = _mm_mul_ps(x[i], v_scale);
+        if (kMirror) {
+          _mm_storeu_ps(dst + width - 4 - (w + 4 * i),
+              _mm_shuffle_ps(x[i], x[i], _MM_SHUFFLE(0, 1, 2, 3)));
+        } else {
+          _mm_storeu_ps(dst + w + 4 * i, x[i]);
+        }
+      }
+    }
+#endif
+    TransformRowScalar<float, kMirror, kInvert, kMean>(src, w, width, mean,
+        mean_value, scale, dst);
+  }
+};
+
+template <typename Dtype, bool kMirror, bool kInvert>
+static typename TransformRowKernel<Dtype>::Func SelectMeanMode(
+    const TransformMeanMode mean_mode) {
+  switch (mean_mode) {
+  case TRANSFORM_MEAN_VALUE:
+    return &TransformRow<Dtype, kMirror, kInvert, TRANSFORM_MEAN_VALUE>::Run;
+  case TRANSFORM_MEAN_ROW:
+    return &TransformRow<Dtype, kMirror, kInvert, TRANSFORM_MEAN_ROW>::Run;
+  default:
+    return &TransformRow<Dtype, kMirror, kInvert, TRANSFORM_NO_MEAN>::Run;
+  }
+}
+
+template <typename Dtype, bool kMirror>
+static typename TransformRowKernel<Dtype>::Func SelectInvert(
+    const bool invert, const TransformMeanMode mean_mode) {
+  return invert ? SelectMeanMode<Dtype, kMirror, true>(mean_mode) :
+      SelectMeanMode<Dtype, kMirror, false>(mean_mode);
+}
+
+template <typename Dtype>
+typename TransformRowKernel<Dtype>::Func GetTransformRowKernel(
+    const bool mirror, const bool invert, const TransformMeanMode mean_mode) {
+  return mirror ? SelectInvert<Dtype, true>(invert, mean_mode) :
+      SelectInvert<Dtype, false>(invert, mean_mode);
+}
+
+template TransformRowKernel<float>::Func GetTransformRowKernel<float>(
+    const bool mirror, const bool invert, const TransformMeanMode mean_mode);
+template TransformRowKernel<double>::Func GetTransformRowKernel<double>(
+    const bool mirror, const bool invert, const TransformMeanMode mean_mode);
+
+}  // namespace caffe
@@ -0,0 +1,100 @@
+// This program times the sum of a float buffer over the MPI ranks with each
+// allreduce engine: the MPI_Allreduce of the MPI library, the pipelined ring
+// and the hierarchical shared memory + ring reduction of
+// caffe/util/allreduce.hpp, for buffer sizes growing by 4x, and checks that
+// they all give the exact sum.
+// Usage:
+//   mpirun -np <ranks> benchmark_allreduce [FLAGS]
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/allreduce.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::vector;
+
+DEFINE_int32(iterations, 20, "Number of sums to time per size and engine");
+DEFINE_int32(min_bytes, 4 << 10, "Size of the smallest buffer");
+DEFINE_int32(max_bytes, 256 << 20, "Size of the largest buffer");
+DEFINE_double(chunk_mb, 4, "Size of the chunks of the ring engines, in MB");
+
+#ifdef USE_MPI
+// Small integers, so that every engine gives the exact sum.
+static float Value(int rank, int i) {
+  return static_cast<float>((rank + i) % 17);
+}
+
+static void Benchmark() {
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  Allreducer allreducer(MPI_COMM_WORLD,
+      static_cast<size_t>(FLAGS_chunk_mb * 1024 * 1024));
+  const AllreduceAlgorithm algorithms[] = {
+      ALLREDUCE_MPI, ALLREDUCE_RING, ALLREDUCE_HIERARCHICAL};
+  const char* names[] = {"mpi", "ring", "hierarchical"};
+  if (rank == 0) {
+    LOG(INFO) << size << " ranks, chunks of " << FLAGS_chunk_mb << " MB";
+  }
+  for (int64_t bytes = FLAGS_min_bytes; bytes <= FLAGS_max_bytes;
+       bytes *= 4) {
+    const int count = static_cast<int>(bytes / sizeof(float));
+    vector<float> data(count);
+    for (int a = 0; a < 3; ++a) {
+      // One untimed sum to check the result and warm up the connections.
+      for (int i = 0; i < count; ++i) {
+        data[i] = Value(rank, i);
+      }
+      allreducer.Allreduce(&data[0], count, algorithms[a]);
+      for (int i = 0; i < count; ++i) {
+        float expected = 0;
+        for (int r = 0; r < size; ++r) {
+          expected += Value(r, i);
+        }
+        CHECK_EQ(expected, data[i]) << names[a] << " engine, element " << i;
+      }
+
+      MPI_Barrier(MPI_COMM_WORLD);
+      const double start = MPI_Wtime();
+      for (int it = 0; it < FLAGS_iterations; ++it) {
+        allreducer.Allreduce(&data[0], count, algorithms[a]);
+      }
+      const double seconds = (MPI_Wtime() - start) / FLAGS_iterations;
+      double max_seconds;
+      MPI_Allreduce(&seconds, &max_seconds, 1, MPI_DOUBLE, MPI_MAX,
+          MPI_COMM_WORLD);
+      if (rank == 0) {
+        // The bandwidth of a link, for the 2 (P - 1) / P of the buffer an
+        // optimal allreduce sends over each.
+        const double bus_bytes = 2. * (size - 1) / size * bytes;
+        LOG(INFO) << bytes << " bytes, " << names[a] << ": "
+            << max_seconds * 1000 << " ms, bus bandwidth "
+            << bus_bytes / max_seconds / (1 << 30) << " GB/s";
+      }
+    }
+  }
+}
+#endif  // USE_MPI
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+  gflags::SetUsageMessage("Time the allreduce engines over the MPI ranks.\n"
+        "Usage:\n"
+        "    mpirun -np <ranks> benchmark_allreduce [FLAGS]\n");
+  GlobalInit(&argc, &argv);
+#ifdef USE_MPI
+  CHECK_GT(FLAGS_min_bytes, 0);
+  CHECK_GT(FLAGS_chunk_mb, 0);
+  Benchmark();
+#else
+  LOG(FATAL) << "benchmark_allreduce needs Caffe built with USE_MPI.";
+#endif
+  GlobalFinalize();
+  return 0;
+}
@@ -0,0 +1,113 @@
+// This program times the CPU im2col and col2im kernels specialized for the
+// common convolution shapes against the generic im2col_cpu and col2im_cpu,
+// on an input of the size the shape usually sees, and checks that both give
+// the same output.
+// Usage:
+//   benchmark_im2col [FLAGS]
+
+#include <cstdlib>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::vector;
+
+DEFINE_int32(iterations, 20, "Number of calls to time");
+DEFINE_int32(channels, 0,
+    "Channels of the input; 0 for the usual channels of each shape");
+DEFINE_int32(size, 0, "Side of the input; 0 for the usual size of each shape");
+
+// The shapes with specialized kernels, and the input they see in VGG-16,
+// ResNet, GoogLeNet and AlexNet.
+struct Im2colShape {
+  const char* name;
+  int kernel, stride, pad;
+  int channels, size;
+};
+
+static const Im2colShape kShapes[] = {
+  {"3x3 s1 p1", 3, 1, 1, 64, 112},
+  {"1x1 s2", 1, 2, 0, 256, 56},
+  {"5x5 s1 p2", 5, 1, 2, 96, 27},
+  {"7x7 s2 p3", 7, 2, 3, 3, 224},
+  {"11x11 s4", 11, 4, 0, 3, 227},
+};
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time the specialized CPU im2col and col2im\n"
+        "kernels against the generic ones.\n"
+        "Usage:\n"
+        "    benchmark_im2col [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  CPUTimer timer;
+  for (int s = 0; s < sizeof(kShapes) / sizeof(kShapes[0]); ++s) {
+    const Im2colShape& shape = kShapes[s];
+    const int channels = FLAGS_channels ? FLAGS_channels : shape.channels;
+    const int size = FLAGS_size ? FLAGS_size : shape.size;
+    const int k = shape.kernel, p = shape.pad, st = shape.stride;
+    CHECK_GE(size + 2 * p, k) << "The input is smaller than the kernel";
+    const int size_col = (size + 2 * p - k) / st + 1;
+    vector<float> image(channels * size * size);
+    for (int i = 0; i < image.size(); ++i) {
+      image[i] = static_cast<float>(rand()) / RAND_MAX;  // NOLINT
+    }
+    vector<float> generic_col(channels * k * k * size_col * size_col);
+    vector<float> kernel_col(generic_col.size());
+    vector<float> generic_image(image.size()), kernel_image(image.size());
+    Im2colKernel<float>::Func im2col =
+        GetIm2colKernel<float>(k, k, p, p, st, st);
+    Im2colKernel<float>::Func col2im =
+        GetCol2imKernel<float>(k, k, p, p, st, st);
+
+    timer.Start();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      im2col_cpu(&image[0], channels, size, size, k, k, p, p, st, st,
+          &generic_col[0]);
+    }
+    const float generic_im2col_ms = timer.MilliSeconds() / FLAGS_iterations;
+    timer.Start();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      im2col(&image[0], channels, size, size, k, k, p, p, st, st,
+          &kernel_col[0]);
+    }
+    const float kernel_im2col_ms = timer.MilliSeconds() / FLAGS_iterations;
+    CHECK(generic_col == kernel_col)
+        << "The " << shape.name << " im2col does not match im2col_cpu";
+
+    timer.Start();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      col2im_cpu(&generic_col[0], channels, size, size, k, k, p, p, st, st,
+          &generic_image[0]);
+    }
+    const float generic_col2im_ms = timer.MilliSeconds() / FLAGS_iterations;
+    timer.Start();
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      col2im(&generic_col[0], channels, size, size, k, k, p, p, st, st,
+          &kernel_image[0]);
+    }
+    const float kernel_col2im_ms = timer.MilliSeconds() / FLAGS_iterations;
+    CHECK(generic_image == kernel_image)
+        << "The " << shape.name << " col2im does not match col2im_cpu";
+
+    LOG(INFO) << shape.name << " on " << channels << "x" << size << "x"
+        << size << ": im2col " << generic_im2col_ms << " ms, kernel "
+        << kernel_im2col_ms << " ms, speedup "
+        << generic_im2col_ms / kernel_im2col_ms << "x; col2im "
+        << generic_col2im_ms << " ms, kernel " << kernel_col2im_ms
+        << " ms, speedup " << generic_col2im_ms / kernel_col2im_ms << "x";
+  }
+  return 0;
+}
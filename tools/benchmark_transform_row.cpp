@@ -0,0 +1,154 @@
+// This program times the uint8 inner loop of DataTransformer::Transform on a
+// random flow stack: the per-channel row kernels of
+// caffe/util/transform_row.hpp against the per-pixel scalar loop they
+// replace, for every combination of mirror and mean mode, and checks that
+// both give the same output.
+// Usage:
+//   benchmark_transform_row [FLAGS]
+
+#include <cstdlib>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/transform_row.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::vector;
+
+DEFINE_int32(iterations, 200, "Number of transforms to time");
+DEFINE_int32(channels, 10, "Channels of the input, e.g. 2 x new_length");
+DEFINE_int32(height, 256, "Height of the input");
+DEFINE_int32(width, 340, "Width of the input");
+DEFINE_int32(crop_size, 224, "Side of the center crop");
+DEFINE_bool(is_flow, true, "Invert the x flow channels when mirroring");
+
+// The loop DataTransformer::Transform used to run, testing every option for
+// every pixel.
+static void ScalarTransform(const vector<uint8_t>& data, const int channels,
+    const int datum_height, const int datum_width, const int crop_size,
+    const int h_off, const int w_off, const bool do_mirror,
+    const bool is_flow, const bool is_RF, const float* mean,
+    const vector<float>& mean_values, const float scale,
+    float* transformed_data) {
+  const bool has_mean_file = mean != NULL;
+  const bool has_mean_values = !mean_values.empty();
+  const int height = crop_size;
+  const int width = crop_size;
+  float datum_element;
+  int top_index, data_index;
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      for (int w = 0; w < width; ++w) {
+        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
+        if (do_mirror) {
+          top_index = (c * height + h) * width + (width - 1 - w);
+        } else {
+          top_index = (c * height + h) * width + w;
+        }
+        if (is_flow && do_mirror && c % 2 == 0)
+          datum_element = 255 - static_cast<float>(data[data_index]);
+        else if (is_RF && do_mirror && c % 2 == 1 && c > 2)
+          datum_element = 255 - static_cast<float>(data[data_index]);
+        else
+          datum_element = static_cast<float>(data[data_index]);
+        if (has_mean_file) {
+          transformed_data[top_index] =
+              (datum_element - mean[data_index]) * scale;
+        } else if (has_mean_values) {
+          transformed_data[top_index] =
+              (datum_element - mean_values[c]) * scale;
+        } else {
+          transformed_data[top_index] = datum_element * scale;
+        }
+      }
+    }
+  }
+}
+
+// The same transform, with one row kernel picked per channel.
+static void KernelTransform(const vector<uint8_t>& data, const int channels,
+    const int datum_height, const int datum_width, const int crop_size,
+    const int h_off, const int w_off, const bool do_mirror,
+    const bool is_flow, const bool is_RF, const float* mean,
+    const vector<float>& mean_values, const float scale,
+    float* transformed_data) {
+  const TransformMeanMode mean_mode = mean ? TRANSFORM_MEAN_ROW :
+      (mean_values.empty() ? TRANSFORM_NO_MEAN : TRANSFORM_MEAN_VALUE);
+  const int height = crop_size;
+  const int width = crop_size;
+  for (int c = 0; c < channels; ++c) {
+    const bool invert = do_mirror && ((is_flow && c % 2 == 0) ||
+        (is_RF && c % 2 == 1 && c > 2));
+    TransformRowKernel<float>::Func transform_row =
+        GetTransformRowKernel<float>(do_mirror, invert, mean_mode);
+    const float mean_value = mean_values.empty() ? 0.f : mean_values[c];
+    for (int h = 0; h < height; ++h) {
+      const int offset = (c * datum_height + h_off + h) * datum_width + w_off;
+      transform_row(&data[offset], width, mean ? mean + offset : NULL,
+          mean_value, scale, transformed_data + (c * height + h) * width);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time the DataTransformer row kernels against the\n"
+        "per-pixel scalar loop.\n"
+        "Usage:\n"
+        "    benchmark_transform_row [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GE(FLAGS_height, FLAGS_crop_size);
+  CHECK_GE(FLAGS_width, FLAGS_crop_size);
+
+  const int size = FLAGS_channels * FLAGS_height * FLAGS_width;
+  const int crop_count = FLAGS_channels * FLAGS_crop_size * FLAGS_crop_size;
+  const int h_off = (FLAGS_height - FLAGS_crop_size) / 2;
+  const int w_off = (FLAGS_width - FLAGS_crop_size) / 2;
+  vector<uint8_t> data(size);
+  vector<float> mean_file(size);
+  for (int i = 0; i < size; ++i) {
+    data[i] = rand() % 256;  // NOLINT(runtime/threadsafe_fn)
+    mean_file[i] = 128.f + (i % 7);
+  }
+  vector<float> mean_values(FLAGS_channels, 128.f);
+  vector<float> scalar_output(crop_count), kernel_output(crop_count);
+
+  const char* mean_names[] = {"no mean", "mean values", "mean file"};
+  CPUTimer timer;
+  for (int mean_mode = 0; mean_mode < 3; ++mean_mode) {
+    const float* mean = (mean_mode == 2) ? &mean_file[0] : NULL;
+    const vector<float> values =
+        (mean_mode == 1) ? mean_values : vector<float>();
+    for (int mirror = 0; mirror < 2; ++mirror) {
+      timer.Start();
+      for (int i = 0; i < FLAGS_iterations; ++i) {
+        ScalarTransform(data, FLAGS_channels, FLAGS_height, FLAGS_width,
+            FLAGS_crop_size, h_off, w_off, mirror, FLAGS_is_flow, false,
+            mean, values, 0.017f, &scalar_output[0]);
+      }
+      const float scalar_ms = timer.MilliSeconds() / FLAGS_iterations;
+      timer.Start();
+      for (int i = 0; i < FLAGS_iterations; ++i) {
+        KernelTransform(data, FLAGS_channels, FLAGS_height, FLAGS_width,
+            FLAGS_crop_size, h_off, w_off, mirror, FLAGS_is_flow, false,
+            mean, values, 0.017f, &kernel_output[0]);
+      }
+      const float kernel_ms = timer.MilliSeconds() / FLAGS_iterations;
+      CHECK(scalar_output == kernel_output)
+          << "The row kernels do not match the scalar loop";
+      LOG(INFO) << mean_names[mean_mode] << (mirror ? ", mirror" : "")
+          << ": scalar " << scalar_ms << " ms, kernels " << kernel_ms
+          << " ms, speedup " << scalar_ms / kernel_ms << "x";
+    }
+  }
+  return 0;
+}
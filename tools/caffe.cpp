@@ -7,6 +7,8 @@
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/raw_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -30,6 +32,14 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(output, "",
+    "The file convert_weights writes.");
+DEFINE_int32(cpu_threads, 1,
+    "The number of threads the CPU convolutions and pooling split the "
+    "images among.");
+DEFINE_string(conv_engine, "",
+    "Optional; for time, the engine of the convolutions, or a comma separated "
+    "list of engines to compare: CAFFE, CUDNN or WINOGRAD.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -206,7 +216,11 @@ int test() {
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (caffe::IsRawWeightsFile(FLAGS_weights)) {
+    caffe_net.MapTrainedLayersFrom(FLAGS_weights);
+  } else {
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<Blob<float>* > bottom_vec;
@@ -256,38 +270,57 @@ int test() {
 RegisterBrewFunction(test);
 
 
-// Time: benchmark the execution time of a model.
-int time() {
-  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
-
-  // Set device id and mode
-  if (FLAGS_gpu >= 0) {
-    LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
-    Caffe::SetDevice(FLAGS_gpu);
-    Caffe::set_mode(Caffe::GPU);
-  } else {
-    LOG(INFO) << "Use CPU.";
-    Caffe::set_mode(Caffe::CPU);
+// Sets the engine of the convolutions of param that it can run: all of them
+// for CAFFE and CUDNN, those with 3x3 kernels and a stride of 1 for WINOGRAD.
+static void SetConvolutionEngine(const caffe::string& engine_name,
+    caffe::NetParameter* param) {
+  caffe::ConvolutionParameter_Engine engine;
+  CHECK(caffe::ConvolutionParameter_Engine_Parse(engine_name, &engine))
+      << "Unknown convolution engine " << engine_name;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    caffe::LayerParameter* layer = param->mutable_layer(i);
+    if (layer->type() != "Convolution") {
+      continue;
+    }
+    caffe::ConvolutionParameter* conv_param =
+        layer->mutable_convolution_param();
+    if (engine == caffe::ConvolutionParameter_Engine_WINOGRAD) {
+      const int kernel_h = conv_param->has_kernel_h() ?
+          conv_param->kernel_h() : conv_param->kernel_size();
+      const int kernel_w = conv_param->has_kernel_w() ?
+          conv_param->kernel_w() : conv_param->kernel_size();
+      const int stride_h = conv_param->has_stride_h() ?
+          conv_param->stride_h() : conv_param->stride();
+      const int stride_w = conv_param->has_stride_w() ?
+          conv_param->stride_w() : conv_param->stride();
+      if (kernel_h != 3 || kernel_w != 3 || stride_h != 1 || stride_w != 1) {
+        LOG(INFO) << "Keeping the engine of " << layer->name();
+        continue;
+      }
+    }
+    conv_param->set_engine(engine);
   }
-  // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TRAIN);
+}
 
+// Runs the forward and backward passes of the net, and returns the average
+// time of one iteration in ms.
+static double TimeNet(Net<float>* caffe_net) {
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
   LOG(INFO) << "Performing Forward";
   // Note that for the speed benchmark, we will assume that the network does
   // not take any input blobs.
   float initial_loss;
-  caffe_net.Forward(vector<Blob<float>*>(), &initial_loss);
+  caffe_net->Forward(vector<Blob<float>*>(), &initial_loss);
   LOG(INFO) << "Initial loss: " << initial_loss;
   LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
+  caffe_net->Backward();
 
-  const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
+  const vector<shared_ptr<Layer<float> > >& layers = caffe_net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = caffe_net->top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
+      caffe_net->bottom_need_backward();
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
@@ -339,10 +372,75 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  return total_timer.MilliSeconds() / FLAGS_iterations;
+}
+
+// Time: benchmark the execution time of a model.
+int time() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+
+  // Set device id and mode
+  if (FLAGS_gpu >= 0) {
+    LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  vector<caffe::string> engines;
+  if (FLAGS_conv_engine.size()) {
+    boost::split(engines, FLAGS_conv_engine, boost::is_any_of(","));
+  } else {
+    engines.push_back("");
+  }
+  vector<double> times;
+  for (int i = 0; i < engines.size(); ++i) {
+    // Instantiate the caffe net.
+    caffe::NetParameter net_param;
+    caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+    net_param.mutable_state()->set_phase(caffe::TRAIN);
+    if (engines[i].size()) {
+      LOG(INFO) << "Convolution engine: " << engines[i];
+      SetConvolutionEngine(engines[i], &net_param);
+    }
+    Net<float> caffe_net(net_param);
+    times.push_back(TimeNet(&caffe_net));
+  }
+  if (engines.size() > 1) {
+    LOG(INFO) << "Average Forward-Backward per convolution engine: ";
+    for (int i = 0; i < engines.size(); ++i) {
+      LOG(INFO) << std::setfill(' ') << std::setw(10) << engines[i] << "\t"
+        << times[i] << " ms, " << times[0] / times[i] << "x the speed of "
+        << engines[0] << ".";
+    }
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Convert weights: between a .caffemodel and a raw weights file, which can be
+// mapped instead of parsed (see caffe/util/raw_weights.hpp).
+int convert_weights() {
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to convert.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output file.";
+  caffe::NetParameter net_param;
+  if (caffe::IsRawWeightsFile(FLAGS_weights)) {
+    caffe::RawWeights weights;
+    CHECK(weights.Open(FLAGS_weights)) << "Could not read " << FLAGS_weights;
+    weights.ToProto(&net_param);
+    LOG(INFO) << "Writing the .caffemodel " << FLAGS_output;
+    caffe::WriteProtoToBinaryFile(net_param, FLAGS_output);
+  } else {
+    caffe::ReadNetParamsFromBinaryFileOrDie(FLAGS_weights, &net_param);
+    LOG(INFO) << "Writing the raw weights " << FLAGS_output;
+    CHECK(caffe::WriteRawWeights(FLAGS_output, net_param))
+        << "Could not write " << FLAGS_output;
+  }
+  return 0;
+}
+RegisterBrewFunction(convert_weights);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -353,9 +451,11 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  convert_weights convert weights between .caffemodel and raw");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_cpu_threads(FLAGS_cpu_threads);
 
   if (argc == 2) {
     int ret = GetBrewFunction(caffe::string(argv[1]))();
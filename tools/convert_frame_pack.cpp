@@ -0,0 +1,144 @@
+// This program packs the extracted frames of a set of videos into frame
+// packs, one file per video, to be read by the VideoData layer with
+// frame_storage: PACK.
+// Usage:
+//   convert_frame_pack [FLAGS] ROOTFOLDER/ LISTFILE OUTFOLDER/ OUTLISTFILE
+//
+// where LISTFILE is a VideoData source list, in the format
+//   subfolder1/video1 150 7
+//   ....
+// i.e. the folder holding the image_%04d.jpg / flow_x_%04d.jpg /
+// flow_y_%04d.jpg frames of a video, its number of frames and its label.
+// Each video is written to OUTFOLDER/<video folder>.fpk, mirroring the
+// subfolders of the list so that videos with the same folder name under
+// different classes get different packs. OUTLISTFILE lists the packs in the
+// same format, to be used as source.
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/util/frame_pack.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using std::string;
+using std::vector;
+
+DEFINE_bool(rgb, true, "Pack the image_%04d.jpg frames");
+DEFINE_bool(flow, true, "Pack the flow_x_%04d.jpg and flow_y_%04d.jpg frames");
+
+// Returns the paths of frames 1 to num_frames of a stream, with an empty path
+// for the missing ones. Returns false if the stream has no frame at all.
+static bool ListStreamFrames(const string& folder, const string& stream,
+    int num_frames, vector<string>* frame_files) {
+  frame_files->clear();
+  bool found = false;
+  char tmp[30];
+  for (int frame_id = 1; frame_id <= num_frames; ++frame_id) {
+    snprintf(tmp, sizeof(tmp), "%s_%04d.jpg", stream.c_str(), frame_id);
+    const string path = folder + "/" + tmp;
+    if (access(path.c_str(), R_OK) == 0) {
+      frame_files->push_back(path);
+      found = true;
+    } else {
+      frame_files->push_back("");
+    }
+  }
+  return found;
+}
+
+// Creates the directories of path up to its last '/', like mkdir -p.
+static void MakeParentFolders(const string& path) {
+  for (size_t slash = path.find('/', 1); slash != string::npos;
+       slash = path.find('/', slash + 1)) {
+    const string folder = path.substr(0, slash);
+    CHECK(mkdir(folder.c_str(), 0755) == 0 || errno == EEXIST)
+        << "Could not create " << folder;
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Pack the frames of each video into a single file\n"
+        "read by the VideoData layer with frame_storage: PACK.\n"
+        "Usage:\n"
+        "    convert_frame_pack [FLAGS] ROOTFOLDER/ LISTFILE OUTFOLDER/ "
+        "OUTLISTFILE\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 5) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_frame_pack");
+    return 1;
+  }
+  CHECK(FLAGS_rgb || FLAGS_flow) << "Nothing to pack.";
+
+  vector<string> stream_names;
+  if (FLAGS_rgb) {
+    stream_names.push_back("image");
+  }
+  if (FLAGS_flow) {
+    stream_names.push_back("flow_x");
+    stream_names.push_back("flow_y");
+  }
+
+  const string root_folder(argv[1]);
+  const string out_folder(argv[3]);
+  std::ifstream infile(argv[2]);
+  std::ofstream outlist(argv[4]);
+  CHECK(outlist.is_open()) << "Could not open " << argv[4];
+
+  string folder;
+  int length, label;
+  int count = 0;
+  while (infile >> folder >> length >> label) {
+    vector<string> streams;
+    vector<vector<string> > frame_files;
+    for (int s = 0; s < stream_names.size(); ++s) {
+      vector<string> files;
+      if (ListStreamFrames(root_folder + folder, stream_names[s], length,
+          &files)) {
+        streams.push_back(stream_names[s]);
+        frame_files.push_back(files);
+      }
+    }
+    if (streams.empty()) {
+      LOG(WARNING) << "No frame found in " << root_folder + folder;
+      continue;
+    }
+    string name = folder;
+    while (!name.empty() && name[name.size() - 1] == '/') {
+      name.erase(name.size() - 1);
+    }
+    name.erase(0, name.find_first_not_of('/'));
+    CHECK(!name.empty()) << "No video folder in " << folder;
+    CHECK(("/" + name + "/").find("/../") == string::npos)
+        << "The video folder " << folder << " leaves ROOTFOLDER";
+    const string pack = out_folder + name + ".fpk";
+    MakeParentFolders(pack);
+    if (!WriteFramePack(pack, streams, frame_files)) {
+      LOG(ERROR) << "Failed to pack " << root_folder + folder;
+      continue;
+    }
+    outlist << pack << " " << length << " " << label << "\n";
+    if (++count % 1000 == 0) {
+      LOG(ERROR) << "Processed " << count << " videos.";
+    }
+  }
+  if (count % 1000 != 0) {
+    LOG(ERROR) << "Processed " << count << " videos.";
+  }
+  return 0;
+}